@@ -38,6 +38,13 @@ struct Config {
     bool force_vsync_off;          // Override: always disable VSync
     bool force_vsync_on;           // Override: always enable VSync
     int vsync_hysteresis_frames;   // Frames before switching (default 5)
+    double refresh_rate_override;  // Monitor refresh in Hz (0 = detect via XRandR)
+    bool frame_pacing;             // Start frames as late as possible before vblank
+    float frame_pacing_margin_ms;  // Slack left between predicted frame end and vblank
+    size_t search_match_memory;    // Bytes of match offsets a search keeps (0 = no limit)
+    size_t undo_max_entries;       // Undo history length
+    size_t undo_memory;            // Bytes of undo text before the oldest entries are dropped
+    size_t undo_snapshot_bytes;    // Edits this large are undone by swapping rope versions (0 = never)
 
     // TODO: Keybindings map
 };
@@ -79,6 +86,13 @@ inline void config_set_defaults(Config* config) {
     config->force_vsync_off = false;
     config->force_vsync_on = false;
     config->vsync_hysteresis_frames = 5;
+    config->refresh_rate_override = 0.0;
+    config->frame_pacing = true;
+    config->frame_pacing_margin_ms = 2.0f;
+    config->search_match_memory = 64 << 20;  // 8M literal matches
+    config->undo_max_entries = 1000;
+    config->undo_memory = 256 << 20;
+    config->undo_snapshot_bytes = 1 << 20;
 }
 
 // Load configuration from JSON file
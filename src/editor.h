@@ -12,28 +12,17 @@
 #include "platform.h"
 #include "renderer.h"
 #include "rope.h"
+#include "search_job.h"
+#include "undo.h"
 #include "font.h"
 
+#include <string>
 #include <vector>
 
 // Debug logging control - set to 1 to enable verbose mouse/click/layout logging
 #define EDITOR_DEBUG_MOUSE 0
 #define EDITOR_DEBUG_LAYOUT 0
 
-// Command types for undo/redo
-enum CommandType {
-    CMD_INSERT,
-    CMD_DELETE
-};
-
-// Command for undo/redo
-struct Command {
-    CommandType type;
-    size_t pos;
-    char* content;
-    size_t length;
-};
-
 // Text layout cache for accurate cursor positioning
 struct TextLayout {
     std::vector<float> char_positions;  // X position for each character
@@ -41,6 +30,40 @@ struct TextLayout {
     bool valid;
 };
 
+// Redraw reasons accumulated in Editor::dirty
+enum EditorDirtyFlags {
+    EDITOR_DIRTY_TEXT    = (1 << 0),  // Document contents changed
+    EDITOR_DIRTY_CURSOR  = (1 << 1),  // Cursor moved/blinked or selection changed
+    EDITOR_DIRTY_SCROLL  = (1 << 2),  // Viewport scrolled or line height changed
+    EDITOR_DIRTY_OVERLAY = (1 << 3),  // Search box or context menu changed
+    EDITOR_DIRTY_ALL     = 0xF,
+};
+
+// Snapshot of the state editor_render() draws (compared to derive dirty flags)
+struct EditorViewState {
+    size_t rope_version;
+    size_t cursor_pos;
+    bool cursor_visible;
+    bool has_selection;
+    size_t selection_start;
+    size_t selection_end;
+    float scroll_y;
+    float line_height;
+    bool search_active;
+    size_t query_len;
+    size_t match_count;
+    size_t current_match;
+    bool case_sensitive;
+    bool regex;
+    bool search_running;
+    bool replace_active;
+    bool replace_focus;
+    size_t replacement_len;
+    bool menu_active;
+    int menu_x, menu_y;
+    int menu_selected;
+};
+
 // Editor state
 struct Editor {
     Config* config;
@@ -62,9 +85,8 @@ struct Editor {
     bool mouse_dragging;  // Track if we're dragging to select
 
     // Undo/redo system
-    std::vector<Command> undo_stack;
-    std::vector<Command> redo_stack;
-    static constexpr size_t MAX_UNDO_STACK = 1000;
+    UndoHistory undo;
+    double clock;             // Seconds of editor_update() time, for merging typing into one undo entry
 
     // Viewport/scrolling
     float scroll_y;           // Vertical scroll offset in pixels
@@ -76,35 +98,90 @@ struct Editor {
 
     // Text caching to avoid rope_to_string() every frame
     char* cached_text;
+    size_t cached_text_length;  // strlen(cached_text)
     size_t rope_version;        // Incremented on rope modifications
     size_t cached_text_version; // Version of cached_text
+    std::vector<size_t> line_starts;  // Byte offset of each line in cached_text
 
     // Search state
     struct SearchState* search_state;
 
     // Context menu
     struct ContextMenu* context_menu;
+
+    // Damage tracking (EditorDirtyFlags since the last editor_render)
+    uint32_t dirty;
+
+    // What the last editor_render() put on screen (for damage reporting)
+    bool drawn_valid;
+    EditorViewState drawn_state;
+    size_t drawn_cursor_line;
+    size_t drawn_first_line;
+    std::vector<uint64_t> drawn_row_hashes;  // Per visible row, from drawn_first_line
 };
 
 // Search functionality
 #define SEARCH_QUERY_MAX_LEN 256
 
+// How often a running background search is polled for new matches
+constexpr float EDITOR_SEARCH_POLL_SECONDS = 0.016f;
+
+// Every this many matches the offset is kept as a checkpoint, so a windowed
+// match list can be rebuilt from any point by a short scan
+constexpr size_t SEARCH_CHECKPOINT_MATCHES = 1024;
+
+// Matches a windowed list reloads around the viewport or the match navigated
+// to (more if the viewport holds more): a short scan, done within the frame
+constexpr size_t SEARCH_WINDOW_MATCHES = 4 * SEARCH_CHECKPOINT_MATCHES;
+
 struct SearchState {
     bool active;                        // Is search box visible?
     char query[SEARCH_QUERY_MAX_LEN];  // Current search query
     size_t query_len;                   // Length of query string
 
     // Match tracking
+    // match_positions holds matches window_first .. window_first + stored_count - 1.
+    // That is all of them unless storing them would pass max_stored (from
+    // Config::search_match_memory); then only a window is kept: the first
+    // max_stored matches as the search finds them, later a few checkpoints'
+    // worth rebuilt around the viewport or the match navigated to as needed.
     size_t* match_positions;            // Array of match positions in rope
-    size_t match_count;                 // Number of matches found
+    size_t match_count;                 // Number of matches found (stored or not)
     size_t match_capacity;              // Allocated capacity
-    size_t current_match_index;         // Which match is selected (0-based)
+    size_t current_match_index;         // Which match is selected (0-based, of match_count)
+    size_t stored_count;                // Matches in match_positions
+    size_t max_stored;                  // Most matches match_positions may hold
+    size_t window_first;                // Index of the match in match_positions[0]
+    size_t window_end;                  // Stored: every match starting before this offset (from window_first)
+    std::vector<size_t> checkpoints;    // Offset of every SEARCH_CHECKPOINT_MATCHES-th match
 
     // Options
     bool case_sensitive;                // Match case exactly
+    bool regex;                         // Query is a regular expression (see regex.h)
+    bool regex_error;                   // Query doesn't compile; no matches until it's fixed
+
+    // Regex mode: length of each stored match (parallel to match_positions; literal
+    // matches are all query_len long)
+    std::vector<size_t> match_lengths;
 
     // Version tracking
     size_t rope_version_at_search;      // Invalidate matches when rope changes
+
+    // Query the match list is complete for (refined instead of rescanned when
+    // the query grows); empty while a search runs or after the text changed
+    char matched_query[SEARCH_QUERY_MAX_LEN];
+    size_t matched_query_len;
+    bool matched_case_sensitive;
+
+    // Background search (large documents); matches stream in as it runs
+    SearchJob* job;                     // nullptr when no search is running
+    bool jump_to_first;                 // Move the cursor to the first match when it arrives
+
+    // Replace row (Ctrl+H); Tab moves typing between the two fields
+    bool replace_active;
+    bool replace_focus;                 // Typing goes to the replacement
+    char replacement[SEARCH_QUERY_MAX_LEN];
+    size_t replacement_len;
 };
 
 // Context menu
@@ -118,13 +195,20 @@ struct ContextMenu {
 inline void editor_search_open(Editor* editor);
 inline void editor_search_close(Editor* editor);
 inline void editor_search_update_matches(Editor* editor);
+inline void editor_search_poll(Editor* editor);
+inline void editor_search_after_edit(Editor* editor, size_t pos, size_t removed, size_t inserted);
 inline void editor_search_next_match(Editor* editor);
 inline void editor_search_prev_match(Editor* editor);
+inline size_t editor_replace_all(Editor* editor);
+inline size_t editor_search_match_length(const SearchState* search, size_t i);
+inline void editor_search_load_range(Editor* editor, size_t range_start, size_t range_end);
 
 // Initialize editor
 inline void editor_init(Editor* editor, Config* config) {
     editor->config = config;
     rope_init(&editor->rope);
+    undo_init(&editor->undo, config->undo_max_entries, config->undo_memory);
+    editor->clock = 0.0;
     editor->file_path = nullptr;
     editor->cursor_pos = 0;
     editor->cursor_blink_time = 0.0f;
@@ -146,8 +230,10 @@ inline void editor_init(Editor* editor, Config* config) {
 
     // Initialize text cache
     editor->cached_text = nullptr;
+    editor->cached_text_length = 0;
     editor->rope_version = 0;
     editor->cached_text_version = 0;
+    editor->line_starts.clear();
 
     // Initialize search state
     editor->search_state = new SearchState();
@@ -158,8 +244,22 @@ inline void editor_init(Editor* editor, Config* config) {
     editor->search_state->match_count = 0;
     editor->search_state->match_capacity = 0;
     editor->search_state->current_match_index = 0;
+    editor->search_state->stored_count = 0;
+    editor->search_state->max_stored = SIZE_MAX;
+    editor->search_state->window_first = 0;
+    editor->search_state->window_end = SIZE_MAX;
     editor->search_state->case_sensitive = false;
+    editor->search_state->regex = false;
+    editor->search_state->regex_error = false;
     editor->search_state->rope_version_at_search = 0;
+    editor->search_state->matched_query_len = 0;
+    editor->search_state->matched_case_sensitive = false;
+    editor->search_state->job = nullptr;
+    editor->search_state->jump_to_first = false;
+    editor->search_state->replace_active = false;
+    editor->search_state->replace_focus = false;
+    editor->search_state->replacement[0] = '\0';
+    editor->search_state->replacement_len = 0;
 
     // Initialize context menu
     editor->context_menu = new ContextMenu();
@@ -170,6 +270,65 @@ inline void editor_init(Editor* editor, Config* config) {
 
     // Start with empty buffer (welcome text removed for automated testing)
     rope_from_string(&editor->rope, "");
+
+    editor->dirty = EDITOR_DIRTY_ALL;
+    editor->drawn_valid = false;
+    editor->drawn_cursor_line = 0;
+    editor->drawn_first_line = 0;
+}
+
+// Capture what the editor currently draws
+inline EditorViewState editor_view_state(Editor* editor) {
+    EditorViewState state;
+    state.rope_version = editor->rope_version;
+    state.cursor_pos = editor->cursor_pos;
+    state.cursor_visible = editor->cursor_visible;
+    state.has_selection = editor->has_selection;
+    state.selection_start = editor->selection_start;
+    state.selection_end = editor->selection_end;
+    state.scroll_y = editor->scroll_y;
+    state.line_height = editor->line_height;
+    state.search_active = editor->search_state->active;
+    state.query_len = editor->search_state->query_len;
+    state.match_count = editor->search_state->match_count;
+    state.current_match = editor->search_state->current_match_index;
+    state.case_sensitive = editor->search_state->case_sensitive;
+    state.regex = editor->search_state->regex;
+    state.search_running = editor->search_state->job != nullptr;
+    state.replace_active = editor->search_state->replace_active;
+    state.replace_focus = editor->search_state->replace_focus;
+    state.replacement_len = editor->search_state->replacement_len;
+    state.menu_active = editor->context_menu->active;
+    state.menu_x = editor->context_menu->x;
+    state.menu_y = editor->context_menu->y;
+    state.menu_selected = editor->context_menu->selected_item;
+    return state;
+}
+
+// Mark whatever differs between two snapshots as dirty
+inline void editor_mark_changes(Editor* editor, const EditorViewState& before, const EditorViewState& after) {
+    if (before.rope_version != after.rope_version) {
+        editor->dirty |= EDITOR_DIRTY_TEXT;
+    }
+    if (before.cursor_pos != after.cursor_pos || before.cursor_visible != after.cursor_visible ||
+        before.has_selection != after.has_selection ||
+        before.selection_start != after.selection_start || before.selection_end != after.selection_end) {
+        editor->dirty |= EDITOR_DIRTY_CURSOR;
+    }
+    if (before.scroll_y != after.scroll_y || before.line_height != after.line_height) {
+        editor->dirty |= EDITOR_DIRTY_SCROLL;
+    }
+    if (before.search_active != after.search_active || before.query_len != after.query_len ||
+        before.match_count != after.match_count || before.current_match != after.current_match ||
+        before.case_sensitive != after.case_sensitive || before.regex != after.regex ||
+        before.search_running != after.search_running ||
+        before.replace_active != after.replace_active || before.replace_focus != after.replace_focus ||
+        before.replacement_len != after.replacement_len ||
+        before.menu_active != after.menu_active ||
+        before.menu_x != after.menu_x || before.menu_y != after.menu_y ||
+        before.menu_selected != after.menu_selected) {
+        editor->dirty |= EDITOR_DIRTY_OVERLAY;
+    }
 }
 
 // Synchronize font metrics from renderer (call after zoom changes)
@@ -239,7 +398,86 @@ inline void editor_get_text_origin_screen(Editor* editor, Renderer* renderer,
 inline bool editor_save_file(Editor* editor, const char* path = nullptr);
 inline size_t editor_mouse_to_pos(Editor* editor, const char* text, float mouse_x, float mouse_y,
                                    float start_x, float start_y, float line_height);
-inline void editor_push_command(Editor* editor, CommandType type, size_t pos, const char* content, size_t length);
+inline Command* editor_push_command(Editor* editor, CommandType type, size_t pos, const char* content, size_t length,
+                                    ReplaceAllCommand* replace_all = nullptr);
+
+// Edit the document; every change to the rope goes through these so the cache
+// invalidation and search match upkeep stay in one place
+inline void editor_rope_insert(Editor* editor, size_t pos, const char* text, size_t length) {
+    rope_insert(&editor->rope, pos, text, length);
+    editor->rope_version++;  // Invalidate cache
+    editor_search_after_edit(editor, pos, 0, length);
+}
+
+inline void editor_rope_delete(Editor* editor, size_t pos, size_t length) {
+    rope_delete(&editor->rope, pos, length);
+    editor->rope_version++;  // Invalidate cache
+    editor_search_after_edit(editor, pos, length, 0);
+}
+
+// Many edits in one rope rebuild (see rope_splice); the cursor keeps its place
+// in the surrounding text. Search matches are left to the rerun in editor_update().
+inline void editor_rope_splice(Editor* editor, const RopeSplice* splices, size_t count) {
+    size_t cursor = editor->cursor_pos;
+    for (size_t i = 0; i < count && splices[i].pos < editor->cursor_pos; i++) {
+        if (editor->cursor_pos < splices[i].pos + splices[i].removed) {
+            cursor -= editor->cursor_pos - splices[i].pos;  // Inside a replaced range: its start
+            break;
+        }
+        cursor = cursor - splices[i].removed + splices[i].length;
+    }
+
+    rope_splice(&editor->rope, splices, count);
+    editor->rope_version++;  // Invalidate cache
+    editor->cursor_pos = cursor;
+    editor->has_selection = false;
+}
+
+// Swap a snapshot undo entry's rope version in for the document's (see
+// undo_swap_version). Search matches are left to the rerun in editor_update().
+inline void editor_rope_swap(Editor* editor, Command* cmd) {
+    undo_swap_version(cmd, &editor->rope);
+    editor->rope_version++;  // Invalidate cache
+    editor->has_selection = false;
+}
+
+// Is an edit of this many bytes recorded for undo as a rope snapshot?
+inline bool editor_undo_snapshots(Editor* editor, size_t length) {
+    size_t threshold = editor->config->undo_snapshot_bytes;
+    return threshold > 0 && length >= threshold;
+}
+
+// Delete text and record it for undo: copied into the history, or for a large
+// deletion, the rope from before it kept as a snapshot (nothing copied)
+inline void editor_delete_recorded(Editor* editor, size_t start, size_t length) {
+    if (editor_undo_snapshots(editor, length)) {
+        Rope before;
+        rope_snapshot(&editor->rope, &before);
+        editor_rope_delete(editor, start, length);
+        undo_push_snapshot(&editor->undo, CMD_DELETE, start, length, &before);
+        return;
+    }
+
+    char* deleted_text = new char[length + 1];
+    rope_copy(&editor->rope, start, deleted_text, length);
+    editor_push_command(editor, CMD_DELETE, start, deleted_text, length);
+    editor_rope_delete(editor, start, length);
+    delete[] deleted_text;
+}
+
+// Insert text and record it for undo, the same way
+inline void editor_insert_recorded(Editor* editor, size_t pos, const char* text, size_t length) {
+    if (editor_undo_snapshots(editor, length)) {
+        Rope before;
+        rope_snapshot(&editor->rope, &before);
+        editor_rope_insert(editor, pos, text, length);
+        undo_push_snapshot(&editor->undo, CMD_INSERT, pos, length, &before);
+        return;
+    }
+
+    editor_push_command(editor, CMD_INSERT, pos, text, length);
+    editor_rope_insert(editor, pos, text, length);
+}
 
 // Copy selected text to clipboard
 inline void editor_copy(Editor* editor, Platform* platform) {
@@ -278,20 +516,10 @@ inline void editor_cut(Editor* editor, Platform* platform) {
     size_t end = editor->selection_start < editor->selection_end ? editor->selection_end : editor->selection_start;
     size_t length = end - start;
 
-    // Get text for undo
-    char* deleted_text = new char[length + 1];
-    rope_substr(&editor->rope, start, length, deleted_text);
-
-    // Record command
-    editor_push_command(editor, CMD_DELETE, start, deleted_text, length);
-
-    // Delete
-    rope_delete(&editor->rope, start, length);
+    // Delete (recorded for undo)
+    editor_delete_recorded(editor, start, length);
     editor->cursor_pos = start;
     editor->has_selection = false;
-    editor->rope_version++;  // Invalidate cache
-
-    delete[] deleted_text;
 }
 
 // Paste from clipboard
@@ -309,28 +537,23 @@ inline void editor_paste(Editor* editor, Platform* platform) {
         return;
     }
 
-    // If there's a selection, delete it first
+    // If there's a selection, delete it first (undone together with the insert)
+    undo_begin_group(&editor->undo);
     if (editor->has_selection) {
         size_t start = editor->selection_start < editor->selection_end ? editor->selection_start : editor->selection_end;
         size_t end = editor->selection_start < editor->selection_end ? editor->selection_end : editor->selection_start;
         size_t length = end - start;
 
-        char* deleted_text = new char[length + 1];
-        rope_substr(&editor->rope, start, length, deleted_text);
-        editor_push_command(editor, CMD_DELETE, start, deleted_text, length);
-        rope_delete(&editor->rope, start, length);
+        editor_delete_recorded(editor, start, length);
         editor->cursor_pos = start;
         editor->has_selection = false;
-        editor->rope_version++;  // Invalidate cache
-        delete[] deleted_text;
     }
 
     // Insert clipboard content
     printf("[PASTE DEBUG] Inserting at cursor_pos=%zu\n", editor->cursor_pos);
-    editor_push_command(editor, CMD_INSERT, editor->cursor_pos, clipboard_text, paste_len);
-    rope_insert(&editor->rope, editor->cursor_pos, clipboard_text, paste_len);
+    editor_insert_recorded(editor, editor->cursor_pos, clipboard_text, paste_len);
+    undo_commit_group(&editor->undo);
     editor->cursor_pos += paste_len;
-    editor->rope_version++;  // Invalidate cache
 
     // Debug: Check rope length after paste
     size_t new_len = rope_length(&editor->rope);
@@ -439,6 +662,194 @@ inline void editor_calculate_layout(Editor* editor, Renderer* renderer, const ch
 #endif
 }
 
+// Rebuild the line start index for cached_text
+inline void editor_index_lines(Editor* editor) {
+    editor->line_starts.clear();
+    editor->line_starts.push_back(0);
+
+    const char* text = editor->cached_text;
+    if (!text) return;
+
+    const char* end = text + editor->cached_text_length;
+    const char* p = text;
+    while ((p = (const char*)memchr(p, '\n', end - p)) != nullptr) {
+        p++;
+        editor->line_starts.push_back(p - text);
+    }
+}
+
+// Byte range [start, end) of a line in cached_text, excluding its newline
+inline void editor_line_range(Editor* editor, size_t line, size_t* start, size_t* end) {
+    *start = editor->line_starts[line];
+    *end = (line + 1 < editor->line_starts.size()) ? editor->line_starts[line + 1] - 1
+                                                    : editor->cached_text_length;
+}
+
+// Grow the renderer's resident document to cover lines [first, last)
+// Returns false if the document layer is full
+inline bool editor_document_extend(Editor* editor, Renderer* renderer, size_t first, size_t last, Color color) {
+    DocumentLayer* doc = &renderer->document;
+    size_t start, end;
+
+    while (doc->last_line < last) {
+        size_t line = doc->last_line;
+        editor_line_range(editor, line, &start, &end);
+        if (!renderer_document_add_line(renderer, line, editor->cached_text + start, end - start, color)) {
+            return false;
+        }
+    }
+
+    while (doc->first_line > first) {
+        size_t line = doc->first_line - 1;
+        editor_line_range(editor, line, &start, &end);
+        if (!renderer_document_add_line(renderer, line, editor->cached_text + start, end - start, color)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Regenerate cached_text and its line index if the rope changed
+// Returns true if the cache was rebuilt
+inline bool editor_refresh_text_cache(Editor* editor) {
+    if (editor->rope_version == editor->cached_text_version && editor->cached_text) {
+        return false;
+    }
+
+    if (editor->cached_text) {
+        delete[] editor->cached_text;
+    }
+    editor->cached_text = rope_to_string(&editor->rope);
+    editor->cached_text_length = editor->cached_text ? strlen(editor->cached_text) : 0;
+    editor->cached_text_version = editor->rope_version;
+    editor_index_lines(editor);
+    editor->layout_cache.valid = false;  // Layout is derived from cached_text
+    return true;
+}
+
+// Line containing a byte offset of cached_text (O(log n) over line_starts)
+inline size_t editor_line_of_offset(Editor* editor, size_t pos) {
+    auto it = std::upper_bound(editor->line_starts.begin(), editor->line_starts.end(), pos);
+    return (size_t)(it - editor->line_starts.begin()) - 1;
+}
+
+// X offset of a byte position within its line (cached glyph positions, or a
+// per-character approximation while the layout cache is invalid)
+inline float editor_line_x(Editor* editor, size_t line, size_t pos) {
+    const std::vector<float>& positions = editor->layout_cache.char_positions;
+    if (editor->layout_cache.valid && pos < positions.size()) {
+        return positions[pos];
+    }
+
+    size_t line_start = editor->line_starts[line];
+    float x = 0.0f;
+    for (size_t i = line_start; i < pos; i = utf8_next_char_boundary(editor->cached_text, i, pos)) {
+        x += 8.4f;  // Fallback approximation per character
+    }
+    return x;
+}
+
+// Document lines intersecting the viewport: [first, last)
+inline void editor_visible_lines(Editor* editor, Renderer* renderer, float text_y,
+                                 size_t* first, size_t* last) {
+    float line_height = editor->line_height;
+    size_t line_count = editor->line_starts.size();
+    size_t visible = (size_t)(renderer->viewport_height / line_height) + 2;
+    size_t top = (text_y < 0.0f) ? (size_t)(-text_y / line_height) : 0;
+    *first = std::min(top, line_count);
+    *last = std::min(line_count, *first + visible);
+}
+
+// Hash each visible line (compared across frames to find changed rows)
+inline void editor_hash_rows(Editor* editor, size_t first, size_t last, std::vector<uint64_t>* hashes) {
+    hashes->clear();
+    for (size_t line = first; line < last; line++) {
+        size_t start, end;
+        editor_line_range(editor, line, &start, &end);
+        hashes->push_back(renderer_hash_bytes(editor->cached_text + start, end - start));
+    }
+}
+
+// Damage the screen band of one document line
+inline void editor_damage_line(Editor* editor, Renderer* renderer, float text_y, size_t line) {
+    float y = text_y + (float)((double)line * editor->line_height);
+    // Pad by a couple of pixels for glyphs that overhang the line box
+    renderer_damage_rect(renderer, 0.0f, y - 2.0f, (float)renderer->viewport_width,
+                         editor->line_height + 4.0f);
+}
+
+// Report the screen regions that changed since the last editor_render()
+// Must run before renderer_begin_frame(). Anything not worth tracking
+// precisely (scrolling, overlays, zoom) damages the whole window.
+inline void editor_report_damage(Editor* editor, Renderer* renderer) {
+    uint32_t dirty = editor->dirty;
+    if (!dirty) return;
+
+    const EditorViewState& drawn = editor->drawn_state;
+    EditorViewState now = editor_view_state(editor);
+    bool selection_changed = drawn.has_selection != now.has_selection ||
+                             (now.has_selection && (drawn.selection_start != now.selection_start ||
+                                                    drawn.selection_end != now.selection_end));
+
+    if (!editor->drawn_valid || (dirty & (EDITOR_DIRTY_SCROLL | EDITOR_DIRTY_OVERLAY)) ||
+        (selection_changed && (dirty & EDITOR_DIRTY_TEXT))) {
+        renderer_damage_full(renderer);
+        return;
+    }
+
+    editor_refresh_text_cache(editor);
+
+    float text_x, text_y;
+    editor_get_text_origin_screen(editor, renderer, &text_x, &text_y);
+
+    size_t first, last;
+    editor_visible_lines(editor, renderer, text_y, &first, &last);
+    if (first != editor->drawn_first_line) {
+        renderer_damage_full(renderer);
+        return;
+    }
+
+    // Old and new cursor rows
+    editor_damage_line(editor, renderer, text_y, editor->drawn_cursor_line);
+    editor_damage_line(editor, renderer, text_y,
+                      editor_line_of_offset(editor, std::min(now.cursor_pos, editor->cached_text_length)));
+
+    // Rows covered by the old or new selection (text is unchanged here)
+    if (selection_changed) {
+        size_t lo = SIZE_MAX, hi = 0;
+        if (drawn.has_selection) {
+            lo = std::min(drawn.selection_start, drawn.selection_end);
+            hi = std::max(drawn.selection_start, drawn.selection_end);
+        }
+        if (now.has_selection) {
+            lo = std::min(lo, std::min(now.selection_start, now.selection_end));
+            hi = std::max(hi, std::max(now.selection_start, now.selection_end));
+        }
+        if (lo <= hi) {
+            size_t line_lo = std::max(editor_line_of_offset(editor, std::min(lo, editor->cached_text_length)), first);
+            size_t line_hi = std::min(editor_line_of_offset(editor, std::min(hi, editor->cached_text_length)), last);
+            for (size_t line = line_lo; line <= line_hi; line++) {
+                editor_damage_line(editor, renderer, text_y, line);
+            }
+        }
+    }
+
+    // Rows whose text changed (lines shifted by an inserted newline all differ)
+    if (dirty & EDITOR_DIRTY_TEXT) {
+        std::vector<uint64_t> hashes;
+        editor_hash_rows(editor, first, last, &hashes);
+        size_t rows = std::max(hashes.size(), editor->drawn_row_hashes.size());
+        for (size_t row = 0; row < rows; row++) {
+            bool same = row < hashes.size() && row < editor->drawn_row_hashes.size() &&
+                        hashes[row] == editor->drawn_row_hashes[row];
+            if (!same) {
+                editor_damage_line(editor, renderer, text_y, first + row);
+            }
+        }
+    }
+}
+
 // Calculate maximum scroll position (don't scroll past end of document)
 inline float editor_get_max_scroll(Editor* editor) {
     // Count total lines in document
@@ -574,6 +985,23 @@ inline size_t editor_get_line_number(Rope* rope, size_t pos) {
     return line;
 }
 
+// Helper: Move cursor left by count characters (UTF-8 aware)
+inline void editor_move_chars_left(Editor* editor, int count) {
+    editor_refresh_text_cache(editor);
+    for (int i = 0; i < count && editor->cursor_pos > 0; i++) {
+        editor->cursor_pos = utf8_prev_char_boundary(editor->cached_text, editor->cursor_pos);
+    }
+}
+
+// Helper: Move cursor right by count characters (UTF-8 aware)
+inline void editor_move_chars_right(Editor* editor, int count) {
+    editor_refresh_text_cache(editor);
+    for (int i = 0; i < count && editor->cursor_pos < editor->cached_text_length; i++) {
+        editor->cursor_pos = utf8_next_char_boundary(editor->cached_text, editor->cursor_pos,
+                                                     editor->cached_text_length);
+    }
+}
+
 // Helper: Move cursor up one line
 inline void editor_move_up(Editor* editor) {
     size_t line_start = editor_line_start(&editor->rope, editor->cursor_pos);
@@ -638,87 +1066,114 @@ inline void editor_page_down(Editor* editor) {
     }
 }
 
-// Push command to undo stack
-inline void editor_push_command(Editor* editor, CommandType type, size_t pos, const char* content, size_t length) {
-    // Clear redo stack when new edit is made
-    for (auto& cmd : editor->redo_stack) {
-        delete[] cmd.content;
-    }
-    editor->redo_stack.clear();
-
-    // Create command
-    Command cmd;
-    cmd.type = type;
-    cmd.pos = pos;
-    cmd.length = length;
-    cmd.content = new char[length + 1];
-    memcpy(cmd.content, content, length);
-    cmd.content[length] = '\0';
-
-    // Add to undo stack
-    editor->undo_stack.push_back(cmd);
+// Push command to undo stack (clears the redo entries)
+inline Command* editor_push_command(Editor* editor, CommandType type, size_t pos, const char* content, size_t length,
+                                    ReplaceAllCommand* replace_all) {
+    return undo_push(&editor->undo, type, pos, content, length, replace_all);
+}
 
-    // Limit stack size
-    while (editor->undo_stack.size() > Editor::MAX_UNDO_STACK) {
-        delete[] editor->undo_stack[0].content;
-        editor->undo_stack.erase(editor->undo_stack.begin());
-    }
+// Record an insert or delete typed at the cursor; it joins the typing before
+// it when that was next to it and recent (see undo_record)
+inline void editor_push_typing(Editor* editor, CommandType type, size_t pos, const char* content, size_t length) {
+    undo_record(&editor->undo, type, pos, content, length, editor->clock);
 }
 
-// Undo last command
-inline void editor_undo(Editor* editor) {
-    if (editor->undo_stack.empty()) {
-        printf("Nothing to undo\n");
-        return;
+// Rebuild the rope with every match of a replace-all replaced, or when
+// undoing, every replacement turned back into the text it replaced (old_text,
+// the replaced texts back to back)
+inline void editor_apply_replace_all(Editor* editor, const ReplaceAllCommand* replace, const char* old_text,
+                                     bool undo) {
+    size_t count = replace->positions.size();
+    size_t replacement_length = replace->replacement.size();
+
+    std::vector<RopeSplice> splices(count);
+    size_t removed_before = 0;  // Bytes of earlier matches
+    for (size_t i = 0; i < count; i++) {
+        size_t pos = replace->positions[i];
+        size_t length = replace->lengths[i];
+        if (undo) {
+            // Where replacement i is in the replaced text
+            splices[i] = {pos - removed_before + i * replacement_length, replacement_length, old_text, length};
+        } else {
+            splices[i] = {pos, length, replace->replacement.data(), replacement_length};
+        }
+        old_text += length;
+        removed_before += length;
     }
+    editor_rope_splice(editor, splices.data(), count);
+}
 
-    Command cmd = editor->undo_stack.back();
-    editor->undo_stack.pop_back();
-
-    if (cmd.type == CMD_INSERT) {
+// Reverse one command
+inline void editor_undo_command(Editor* editor, Command& cmd) {
+    if (cmd.snapshot) {
+        editor_rope_swap(editor, &cmd);
+        size_t cursor = cmd.type == CMD_DELETE ? cmd.pos + cmd.length : cmd.pos;
+        editor->cursor_pos = std::min(cursor, rope_length(&editor->rope));
+    } else if (cmd.type == CMD_INSERT) {
         // Undo insert by deleting
-        rope_delete(&editor->rope, cmd.pos, cmd.length);
+        editor_rope_delete(editor, cmd.pos, cmd.length);
         editor->cursor_pos = cmd.pos;
     } else if (cmd.type == CMD_DELETE) {
         // Undo delete by inserting
-        rope_insert(&editor->rope, cmd.pos, cmd.content, cmd.length);
+        std::string scratch;
+        editor_rope_insert(editor, cmd.pos, undo_command_text(&cmd, &scratch), cmd.length);
         editor->cursor_pos = cmd.pos + cmd.length;
+    } else if (cmd.type == CMD_REPLACE_ALL) {
+        editor_apply_replace_all(editor, cmd.replace_all, cmd.content, true);
     }
-
-    editor->rope_version++;  // Invalidate cache
-
-    // Move command to redo stack
-    editor->redo_stack.push_back(cmd);
 }
 
-// Redo last undone command
-inline void editor_redo(Editor* editor) {
-    if (editor->redo_stack.empty()) {
-        printf("Nothing to redo\n");
-        return;
-    }
-
-    Command cmd = editor->redo_stack.back();
-    editor->redo_stack.pop_back();
-
-    if (cmd.type == CMD_INSERT) {
+// Apply one command again
+inline void editor_redo_command(Editor* editor, Command& cmd) {
+    if (cmd.snapshot) {
+        editor_rope_swap(editor, &cmd);
+        size_t cursor = cmd.type == CMD_INSERT ? cmd.pos + cmd.length : cmd.pos;
+        editor->cursor_pos = std::min(cursor, rope_length(&editor->rope));
+    } else if (cmd.type == CMD_INSERT) {
         // Redo insert
-        rope_insert(&editor->rope, cmd.pos, cmd.content, cmd.length);
+        editor_rope_insert(editor, cmd.pos, cmd.content, cmd.length);
         editor->cursor_pos = cmd.pos + cmd.length;
     } else if (cmd.type == CMD_DELETE) {
         // Redo delete
-        rope_delete(&editor->rope, cmd.pos, cmd.length);
+        editor_rope_delete(editor, cmd.pos, cmd.length);
         editor->cursor_pos = cmd.pos;
+    } else if (cmd.type == CMD_REPLACE_ALL) {
+        editor_apply_replace_all(editor, cmd.replace_all, cmd.content, false);
     }
+}
 
-    editor->rope_version++;  // Invalidate cache
+// Undo last command
+// A group is undone newest entry first, back to its first
+inline void editor_undo(Editor* editor) {
+    Command* entry = undo_step_back(&editor->undo);
+    if (!entry) {
+        printf("Nothing to undo\n");
+        return;
+    }
+    for (;;) {
+        editor_undo_command(editor, *entry);
+        if (!entry->joined) break;
+        entry = undo_step_back(&editor->undo);
+    }
+}
 
-    // Move command back to undo stack
-    editor->undo_stack.push_back(cmd);
+// Redo last undone command (with the rest of its group)
+inline void editor_redo(Editor* editor) {
+    Command* entry = undo_step_forward(&editor->undo);
+    if (!entry) {
+        printf("Nothing to redo\n");
+        return;
+    }
+    editor_redo_command(editor, *entry);
+    while (undo_next_joined(&editor->undo)) {
+        editor_redo_command(editor, *undo_step_forward(&editor->undo));
+    }
 }
 
 // Handle platform event
 inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer* renderer, Platform* platform) {
+    EditorViewState before = editor_view_state(editor);
+
     switch (event->type) {
         case PLATFORM_EVENT_KEY_PRESS: {
             // Reset cursor blink on any key
@@ -730,6 +1185,25 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
             bool shift = event->key.mods & PLATFORM_MOD_SHIFT;
             bool alt = event->key.mods & PLATFORM_MOD_ALT;
 
+            // Auto-repeats merged by platform_coalesce_events(). Navigation, deletion
+            // and typing apply the whole run as one batched move or edit; any other
+            // key is simply replayed once per press.
+            int repeat_count = 1 + std::max(0, event->key.repeat);
+            if (repeat_count > 1) {
+                bool batched = editor->search_state->active ||
+                               (key >= 0xff50 && key <= 0xff57) ||  // Home, arrows, Page Up/Down, End
+                               key == 0xff08 || key == 0xff7f || key == 0xff0d ||
+                               (event->key.text[0] && !ctrl);
+                if (!batched) {
+                    PlatformEvent single = *event;
+                    single.key.repeat = 0;
+                    for (int i = 0; i < repeat_count; i++) {
+                        editor_handle_event(editor, &single, renderer, platform);
+                    }
+                    break;
+                }
+            }
+
             // Debug: Log Ctrl key combos
             if (ctrl && key >= 'a' && key <= 'z') {
                 printf("[DEBUG] Ctrl+%c (key=%d, text='%s')\n", (char)key, key, event->key.text);
@@ -745,20 +1219,42 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                     break;
                 }
 
-                // Enter/Return navigates to next match
+                // Tab switches between the find and replace fields
+                if (key == 0xff09 && search->replace_active) {  // Tab
+                    search->replace_focus = !search->replace_focus;
+                    break;
+                }
+
+                // Enter in the replace field replaces every match
+                if (key == 0xff0d && search->replace_focus) {
+                    editor_replace_all(editor);
+                    break;
+                }
+
+                // Enter/Return navigates to next match, once per repeat
                 if (key == 0xff0d) {  // Return/Enter
-                    if (shift) {
-                        editor_search_prev_match(editor);
-                    } else {
-                        editor_search_next_match(editor);
+                    for (int i = 0; i < repeat_count; i++) {
+                        if (shift) {
+                            editor_search_prev_match(editor);
+                        } else {
+                            editor_search_next_match(editor);
+                        }
                     }
                     break;
                 }
 
+                // Backspace in the replace field edits the replacement
+                if (key == 0xff08 && search->replace_focus) {
+                    search->replacement_len -= std::min((size_t)repeat_count, search->replacement_len);
+                    search->replacement[search->replacement_len] = '\0';
+                    break;
+                }
+
                 // Backspace removes character from query
                 if (key == 0xff08) {  // Backspace
                     if (search->query_len > 0) {
-                        search->query[--search->query_len] = '\0';
+                        search->query_len -= std::min((size_t)repeat_count, search->query_len);
+                        search->query[search->query_len] = '\0';
                         editor_search_update_matches(editor);
                     }
                     break;  // Always break, even if query is empty
@@ -766,10 +1262,12 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
 
                 // Ctrl+G for next/previous match (even when search active)
                 if (ctrl && (key == 'g' || key == 'G')) {
-                    if (shift) {
-                        editor_search_prev_match(editor);
-                    } else {
-                        editor_search_next_match(editor);
+                    for (int i = 0; i < repeat_count; i++) {
+                        if (shift) {
+                            editor_search_prev_match(editor);
+                        } else {
+                            editor_search_next_match(editor);
+                        }
                     }
                     break;
                 }
@@ -783,6 +1281,33 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                     break;
                 }
 
+                // Toggle regular expression mode (Ctrl+Alt+R)
+                if (ctrl && alt && (key == 'r' || key == 'R')) {
+                    search->regex = !search->regex;
+                    editor_search_update_matches(editor);
+                    printf("Search regex mode: %s\n", search->regex ? "ON" : "OFF");
+                    break;
+                }
+
+                // Ctrl+H shows the replace row (or moves to it)
+                if (ctrl && (key == 'h' || key == 'H')) {
+                    search->replace_active = true;
+                    search->replace_focus = true;
+                    break;
+                }
+
+                // Text typed in the replace field
+                if (search->replace_focus && event->key.text[0] != '\0' && !ctrl) {
+                    size_t text_len = strlen(event->key.text);
+                    for (int i = 0; i < repeat_count &&
+                                    search->replacement_len + text_len < SEARCH_QUERY_MAX_LEN - 1; i++) {
+                        memcpy(search->replacement + search->replacement_len, event->key.text, text_len);
+                        search->replacement_len += text_len;
+                        search->replacement[search->replacement_len] = '\0';
+                    }
+                    break;
+                }
+
                 // Regular text input adds to query
                 if (event->key.text[0] != '\0' &&
                     search->query_len < SEARCH_QUERY_MAX_LEN - 1) {
@@ -791,14 +1316,13 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                     const char* text = event->key.text;
                     size_t text_len = strlen(text);
 
-                    if (search->query_len + text_len < SEARCH_QUERY_MAX_LEN - 1) {
+                    for (int i = 0; i < repeat_count &&
+                                    search->query_len + text_len < SEARCH_QUERY_MAX_LEN - 1; i++) {
                         memcpy(search->query + search->query_len, text, text_len);
                         search->query_len += text_len;
                         search->query[search->query_len] = '\0';
-
-                        printf("[Search] Input: '%s' (len=%zu)\n", text, text_len);
-                        editor_search_update_matches(editor);
                     }
+                    editor_search_update_matches(editor);
                     break;
                 }
 
@@ -812,6 +1336,15 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                 break;
             }
 
+            // Ctrl+H: Open search with the replace row (typing starts in find
+            // unless there is already a query)
+            if (ctrl && (key == 'h' || key == 'H')) {
+                editor_search_open(editor);
+                editor->search_state->replace_active = true;
+                editor->search_state->replace_focus = editor->search_state->query_len > 0;
+                break;
+            }
+
             // Ctrl+G: Find next (when search not active but has query)
             if (ctrl && (key == 'g' || key == 'G')) {
                 if (editor->search_state->match_count > 0) {
@@ -881,21 +1414,13 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                         editor->selection_start = editor->cursor_pos;
                     }
                     // UTF-8 aware: move to previous character boundary
-                    if (editor->cursor_pos > 0) {
-                        char* text = rope_to_string(&editor->rope);
-                        editor->cursor_pos = utf8_prev_char_boundary(text, editor->cursor_pos);
-                        delete[] text;
-                    }
+                    editor_move_chars_left(editor, repeat_count);
                     editor->selection_end = editor->cursor_pos;
                 } else {
                     // Clear selection and move
                     editor->has_selection = false;
                     // UTF-8 aware: move to previous character boundary
-                    if (editor->cursor_pos > 0) {
-                        char* text = rope_to_string(&editor->rope);
-                        editor->cursor_pos = utf8_prev_char_boundary(text, editor->cursor_pos);
-                        delete[] text;
-                    }
+                    editor_move_chars_left(editor, repeat_count);
                 }
                 // Update preferred column for up/down
                 editor->cursor_preferred_col = editor_get_column(&editor->rope, editor->cursor_pos);
@@ -907,23 +1432,13 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                         editor->selection_start = editor->cursor_pos;
                     }
                     // UTF-8 aware: move to next character boundary
-                    if (editor->cursor_pos < rope_length(&editor->rope)) {
-                        char* text = rope_to_string(&editor->rope);
-                        size_t len = rope_length(&editor->rope);
-                        editor->cursor_pos = utf8_next_char_boundary(text, editor->cursor_pos, len);
-                        delete[] text;
-                    }
+                    editor_move_chars_right(editor, repeat_count);
                     editor->selection_end = editor->cursor_pos;
                 } else {
                     // Clear selection and move
                     editor->has_selection = false;
                     // UTF-8 aware: move to next character boundary
-                    if (editor->cursor_pos < rope_length(&editor->rope)) {
-                        char* text = rope_to_string(&editor->rope);
-                        size_t len = rope_length(&editor->rope);
-                        editor->cursor_pos = utf8_next_char_boundary(text, editor->cursor_pos, len);
-                        delete[] text;
-                    }
+                    editor_move_chars_right(editor, repeat_count);
                 }
                 // Update preferred column for up/down
                 editor->cursor_preferred_col = editor_get_column(&editor->rope, editor->cursor_pos);
@@ -934,12 +1449,12 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                         editor->has_selection = true;
                         editor->selection_start = editor->cursor_pos;
                     }
-                    editor_move_up(editor);
+                    for (int i = 0; i < repeat_count; i++) editor_move_up(editor);
                     editor->selection_end = editor->cursor_pos;
                 } else {
                     // Clear selection and move
                     editor->has_selection = false;
-                    editor_move_up(editor);
+                    for (int i = 0; i < repeat_count; i++) editor_move_up(editor);
                 }
                 // Preferred column is maintained by move_up
                 editor_ensure_cursor_visible(editor);
@@ -950,12 +1465,12 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                         editor->has_selection = true;
                         editor->selection_start = editor->cursor_pos;
                     }
-                    editor_move_down(editor);
+                    for (int i = 0; i < repeat_count; i++) editor_move_down(editor);
                     editor->selection_end = editor->cursor_pos;
                 } else {
                     // Clear selection and move
                     editor->has_selection = false;
-                    editor_move_down(editor);
+                    for (int i = 0; i < repeat_count; i++) editor_move_down(editor);
                 }
                 // Preferred column is maintained by move_down
                 editor_ensure_cursor_visible(editor);
@@ -1000,11 +1515,11 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                         editor->has_selection = true;
                         editor->selection_start = editor->cursor_pos;
                     }
-                    editor_page_up(editor);
+                    for (int i = 0; i < repeat_count; i++) editor_page_up(editor);
                     editor->selection_end = editor->cursor_pos;
                 } else {
                     editor->has_selection = false;
-                    editor_page_up(editor);
+                    for (int i = 0; i < repeat_count; i++) editor_page_up(editor);
                 }
                 editor_ensure_cursor_visible(editor);
             }
@@ -1016,11 +1531,11 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                         editor->has_selection = true;
                         editor->selection_start = editor->cursor_pos;
                     }
-                    editor_page_down(editor);
+                    for (int i = 0; i < repeat_count; i++) editor_page_down(editor);
                     editor->selection_end = editor->cursor_pos;
                 } else {
                     editor->has_selection = false;
-                    editor_page_down(editor);
+                    for (int i = 0; i < repeat_count; i++) editor_page_down(editor);
                 }
                 editor_ensure_cursor_visible(editor);
             }
@@ -1028,81 +1543,65 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                 // Clear selection
                 editor->has_selection = false;
 
-                if (key == 0xff08 && editor->cursor_pos > 0) { // Backspace
-                    // UTF-8 aware: find the start of the previous character
-                    char* text = rope_to_string(&editor->rope);
-                    size_t prev_pos = utf8_prev_char_boundary(text, editor->cursor_pos);
-                    size_t char_len = editor->cursor_pos - prev_pos;
-
-                    // Get character to delete for undo (up to 4 bytes for UTF-8)
-                    char deleted_char[5];
-                    rope_substr(&editor->rope, prev_pos, char_len, deleted_char);
-                    deleted_char[char_len] = '\0';
-
-                    // Record command
-                    editor_push_command(editor, CMD_DELETE, prev_pos, deleted_char, char_len);
-
-                    rope_delete(&editor->rope, prev_pos, char_len);
-                    editor->cursor_pos = prev_pos;
-                    editor->rope_version++;  // Invalidate cache
-                    delete[] text;
-                } else if (key == 0xff7f && editor->cursor_pos < rope_length(&editor->rope)) { // Delete
-                    // UTF-8 aware: find the length of the character at cursor
-                    char* text = rope_to_string(&editor->rope);
-                    size_t char_len = utf8_char_length(text, editor->cursor_pos);
-
-                    // Get character to delete for undo (up to 4 bytes for UTF-8)
-                    char deleted_char[5];
-                    rope_substr(&editor->rope, editor->cursor_pos, char_len, deleted_char);
-                    deleted_char[char_len] = '\0';
-
-                    // Record command
-                    editor_push_command(editor, CMD_DELETE, editor->cursor_pos, deleted_char, char_len);
-
-                    rope_delete(&editor->rope, editor->cursor_pos, char_len);
-                    editor->rope_version++;  // Invalidate cache
-                    delete[] text;
+                // UTF-8 aware: the span covers repeat_count whole characters
+                // before (Backspace) or after (Delete) the cursor, removed as one edit
+                editor_refresh_text_cache(editor);
+                const char* text = editor->cached_text;
+                size_t start = editor->cursor_pos;
+                size_t end = editor->cursor_pos;
+                for (int i = 0; i < repeat_count; i++) {
+                    if (key == 0xff08 && start > 0) {  // Backspace
+                        start = utf8_prev_char_boundary(text, start);
+                    } else if (key == 0xff7f && end < editor->cached_text_length) {  // Delete
+                        end = utf8_next_char_boundary(text, end, editor->cached_text_length);
+                    }
+                }
+
+                if (end > start) {
+                    // Record command (deleted text kept for undo)
+                    editor_push_typing(editor, CMD_DELETE, start, text + start, end - start);
+
+                    editor_rope_delete(editor, start, end - start);
+                    editor->cursor_pos = start;
                 }
             } else if (key == 0xff0d) { // Return/Enter
                 // Clear selection
                 editor->has_selection = false;
 
+                std::string newlines((size_t)repeat_count, '\n');
+
                 // Record command
-                editor_push_command(editor, CMD_INSERT, editor->cursor_pos, "\n", 1);
+                editor_push_typing(editor, CMD_INSERT, editor->cursor_pos, newlines.c_str(), newlines.size());
 
-                rope_insert(&editor->rope, editor->cursor_pos, "\n", 1);
-                editor->cursor_pos++;
-                editor->rope_version++;  // Invalidate cache
+                editor_rope_insert(editor, editor->cursor_pos, newlines.c_str(), newlines.size());
+                editor->cursor_pos += newlines.size();
             } else if (event->key.text[0] && !ctrl) {
-                // Delete selection if active
-                if (editor->has_selection) {
+                // Delete selection if active (undone together with the typing)
+                bool replacing = editor->has_selection;
+                if (replacing) {
+                    undo_begin_group(&editor->undo);
                     size_t start = editor->selection_start < editor->selection_end ?
                                    editor->selection_start : editor->selection_end;
                     size_t end = editor->selection_start < editor->selection_end ?
                                  editor->selection_end : editor->selection_start;
                     size_t length = end - start;
 
-                    char* deleted_text = new char[length + 1];
-                    rope_copy(&editor->rope, start, deleted_text, length);
-                    deleted_text[length] = '\0';
-
-                    editor_push_command(editor, CMD_DELETE, start, deleted_text, length);
-                    rope_delete(&editor->rope, start, length);
+                    editor_delete_recorded(editor, start, length);
                     editor->cursor_pos = start;
                     editor->has_selection = false;
-                    editor->rope_version++;
-                    delete[] deleted_text;
                 }
 
-                // Printable characters
-                size_t text_len = strlen(event->key.text);
+                // Printable characters (a held key inserts its whole run at once)
+                std::string typed;
+                for (int i = 0; i < repeat_count; i++) typed += event->key.text;
+                size_t text_len = typed.size();
 
                 // Record command
-                editor_push_command(editor, CMD_INSERT, editor->cursor_pos, event->key.text, text_len);
+                editor_push_typing(editor, CMD_INSERT, editor->cursor_pos, typed.c_str(), text_len);
+                if (replacing) undo_commit_group(&editor->undo);
 
-                rope_insert(&editor->rope, editor->cursor_pos, event->key.text, text_len);
+                editor_rope_insert(editor, editor->cursor_pos, typed.c_str(), text_len);
                 editor->cursor_pos += text_len;
-                editor->rope_version++;  // Invalidate cache
             }
 
             // Ensure cursor is visible after any key press
@@ -1128,8 +1627,9 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                 break;
             }
 
-            // Convert rope to string to calculate positions
-            char* text = rope_to_string(&editor->rope);
+            // Hit test against the cached text (refreshed only if edited)
+            editor_refresh_text_cache(editor);
+            const char* text = editor->cached_text;
 
             // CRITICAL: Ensure layout cache is valid before processing click
             // The cache might be invalid after zoom/text changes, and we need
@@ -1207,7 +1707,6 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                 printf("[CLICK] Result: pos=%zu (END OF FILE)\n", clicked_pos);
             }
 #endif
-            delete[] text;
 
             if (event->mouse_button.pressed && event->mouse_button.button == 1) { // Left click
                 // Check if clicking on context menu
@@ -1311,8 +1810,9 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
                     editor_clamp_scroll(editor);
                 }
 
-                // Convert rope to string to calculate positions
-                char* text = rope_to_string(&editor->rope);
+                // Hit test against the cached text (refreshed only if edited)
+                editor_refresh_text_cache(editor);
+                const char* text = editor->cached_text;
 
                 // CRITICAL: Ensure layout cache is valid before processing drag
                 if (renderer && (!editor->layout_cache.valid || editor->layout_cache.char_positions.size() == 0)) {
@@ -1358,7 +1858,6 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
 #if EDITOR_DEBUG_MOUSE
                 printf("[DRAG] Result: drag_pos=%zu\n", mouse_pos);
 #endif
-                delete[] text;
 
                 // Update selection end and cursor
                 editor->selection_end = mouse_pos;
@@ -1397,16 +1896,21 @@ inline void editor_handle_event(Editor* editor, PlatformEvent* event, Renderer*
         default:
             break;
     }
+
+    editor_mark_changes(editor, before, editor_view_state(editor));
 }
 
 // Update editor state
 inline void editor_update(Editor* editor, float delta_time) {
-    // Update cursor blink (0.5s on, 0.5s off)
-    editor->cursor_blink_time += delta_time;
-    if (editor->cursor_blink_time >= 1.0f) {
-        editor->cursor_blink_time -= 1.0f;
-    }
+    EditorViewState before = editor_view_state(editor);
+
+    // Update cursor blink (0.5s on, 0.5s off); delta may span several periods after idling
+    editor->cursor_blink_time = fmodf(editor->cursor_blink_time + delta_time, 1.0f);
     editor->cursor_visible = editor->cursor_blink_time < 0.5f;
+    editor->clock += delta_time;
+
+    // Take matches found by a background search since the last frame
+    editor_search_poll(editor);
 
     // Re-run search if rope changed and search is active
     if (editor->search_state->active &&
@@ -1414,6 +1918,19 @@ inline void editor_update(Editor* editor, float delta_time) {
         editor->search_state->query_len > 0) {
         editor_search_update_matches(editor);
     }
+
+    editor_mark_changes(editor, before, editor_view_state(editor));
+}
+
+// Seconds until editor_update() will next change what is drawn (cursor blink,
+// or matches arriving from a background search)
+inline float editor_time_until_update(Editor* editor) {
+    float t = editor->cursor_blink_time;
+    float wait = (t < 0.5f) ? 0.5f - t : 1.0f - t;
+    if (editor->search_state->job) {
+        wait = std::min(wait, EDITOR_SEARCH_POLL_SECONDS);
+    }
+    return wait;
 }
 
 // Helper: Calculate cursor screen position
@@ -1469,116 +1986,67 @@ inline size_t editor_mouse_to_pos(Editor* editor, const char* text, float mouse_
            mouse_x, mouse_y, start_x, start_y, line_height, editor->layout_cache.valid);
 #endif
 
-    // Use layout cache if available
-    if (editor->layout_cache.valid && editor->layout_cache.char_positions.size() > 0) {
-        float y = start_y;
-        size_t pos = 0;
-        size_t line_start = 0;
-        size_t line_num = 0;
-
-#if EDITOR_DEBUG_MOUSE
-        printf("[LINE_SEARCH] Starting at y=%.1f, looking for mouse_y=%.1f\n", y, mouse_y);
-#endif
-
-        // First, find which line was clicked based on Y coordinate
-        while (text[pos] && pos < editor->layout_cache.char_positions.size()) {
-            // Y represents the top of the line in document space
-            // Check if mouse is within this line's full height
-            float line_top = y;
-            float line_bottom = y + line_height;
-
-#if EDITOR_DEBUG_MOUSE
-            // DEBUG: Show line boundaries
-            if (line_num % 5 == 0 || (mouse_y >= line_top && mouse_y < line_bottom)) {
-                printf("[LINE %zu] y_range=[%.1f, %.1f) pos_range=[%zu-%zu) %s\n",
-                       line_num, line_top, line_bottom, line_start, pos,
-                       (mouse_y >= line_top && mouse_y < line_bottom) ? "<<< MATCH" : "");
-            }
-#endif
-
-            // Check if mouse Y is on this line
-            if (mouse_y >= line_top && mouse_y < line_bottom) {
-#if EDITOR_DEBUG_MOUSE
-                printf("[LINE_FOUND] Line %zu at pos %zu, searching for X position\n", line_num, line_start);
-#endif
-
-                // Found the line! Now find best X position within this line
-                size_t best_pos = line_start;
-                float best_distance = 1e9f;
-                size_t line_pos = line_start;
-                float actual_line_end_x = start_x;  // Track the true line end position
-
-                // Search within this line only
-                while (text[line_pos] && line_pos < editor->layout_cache.char_positions.size()) {
-                    if (text[line_pos] == '\n') {
-                        // End of line - check if click is beyond line end
-                        // Use the tracked actual line end, NOT the stored newline position
+    // Use layout cache if it covers this text: O(log n) via the line index and
+    // the per-line x prefix sums in char_positions (x restarts at 0 on each line)
+    const std::vector<float>& positions = editor->layout_cache.char_positions;
+    if (editor->layout_cache.valid && text == editor->cached_text &&
+        positions.size() > editor->cached_text_length) {
+        // Clicks above the first line or below the last one land at end of text
+        double row = floor(((double)mouse_y - start_y) / line_height);
+        if (row < 0.0 || row >= (double)editor->line_starts.size()) {
 #if EDITOR_DEBUG_MOUSE
-                        printf("[LINE_END] pos=%zu actual_end_x=%.1f (mouse_x=%.1f) %s\n",
-                               line_pos, actual_line_end_x, mouse_x,
-                               mouse_x >= actual_line_end_x ? "BEYOND" : "WITHIN");
+            printf("[BEYOND_ALL_LINES] Returning pos=%zu\n", editor->cached_text_length);
 #endif
+            return editor->cached_text_length;
+        }
 
-                        if (mouse_x >= actual_line_end_x) {
-                            // Clicked beyond line end - position at newline
-                            return line_pos;
-                        }
-                        break;
-                    }
-
-                    float x = start_x + editor->layout_cache.char_positions[line_pos];
-                    actual_line_end_x = x;  // Update the actual line end as we go
-                    float dx = mouse_x - x;
-                    float distance = dx * dx;
+        size_t line = (size_t)row;
+        size_t line_start, line_end;
+        editor_line_range(editor, line, &line_start, &line_end);
+        bool has_newline = line_end < editor->cached_text_length;
 
 #if EDITOR_DEBUG_MOUSE
-                    // DEBUG: Show character positions every 5 chars or when finding best match
-                    if ((line_pos - line_start) % 5 == 0 || distance < best_distance) {
-                        printf("[CHAR] pos=%zu offset=%zu x=%.1f dx=%.1f dist=%.1f char='%c' %s\n",
-                               line_pos, line_pos - line_start, x, dx, distance,
-                               isprint(text[line_pos]) ? text[line_pos] : '?',
-                               distance < best_distance ? "<<< NEW BEST" : "");
-                    }
+        printf("[LINE_FOUND] Line %zu at pos %zu-%zu, searching for X position\n", line, line_start, line_end);
 #endif
 
-                    if (distance < best_distance) {
-                        best_distance = distance;
-                        best_pos = line_pos;
-                    }
-
-                    line_pos++;
-                }
+        // Clicked at or past the last character's start: position at the newline
+        if (has_newline) {
+            float line_end_x = (line_end > line_start) ? start_x + positions[line_end - 1] : start_x;
+            if (mouse_x >= line_end_x) {
+                return line_end;
+            }
+        }
 
-                // If we're at end of file (no newline), check if click is beyond
-                if (!text[line_pos] && mouse_x >= start_x + editor->layout_cache.char_positions[line_pos]) {
-#if EDITOR_DEBUG_MOUSE
-                    printf("[EOF] pos=%zu x=%.1f (beyond)\n",
-                           line_pos, start_x + editor->layout_cache.char_positions[line_pos]);
-#endif
-                    return line_pos;
+        // Nearest character start. Bytes of one UTF-8 character share an x, so
+        // lower_bound lands on the first byte of each candidate character.
+        auto first = positions.begin() + line_start;
+        auto last = positions.begin() + line_end;
+        auto next = std::lower_bound(first, last, mouse_x - start_x);
+        size_t best_pos = line_start;
+        if (next != first) {
+            auto prev = std::lower_bound(first, next, *(next - 1));
+            float dx_prev = mouse_x - (start_x + *prev);
+            best_pos = prev - positions.begin();
+            if (next != last) {
+                float dx_next = mouse_x - (start_x + *next);
+                if (dx_next * dx_next < dx_prev * dx_prev) {
+                    best_pos = next - positions.begin();
                 }
+            }
+        }
 
+        // Last line (no newline): past the end of the text
+        if (!has_newline && mouse_x >= start_x + positions[line_end]) {
 #if EDITOR_DEBUG_MOUSE
-                printf("[BEST_MATCH] pos=%zu offset=%zu distance=%.1f\n",
-                       best_pos, best_pos - line_start, best_distance);
+            printf("[EOF] pos=%zu x=%.1f (beyond)\n", line_end, start_x + positions[line_end]);
 #endif
-                return best_pos;
-            }
-
-            // Move to next line
-            if (text[pos] == '\n') {
-                y += line_height;
-                line_start = pos + 1;
-                line_num++;
-            }
-            pos++;
+            return line_end;
         }
 
-        // Click was beyond all lines - return end of text
 #if EDITOR_DEBUG_MOUSE
-        printf("[BEYOND_ALL_LINES] Returning pos=%zu\n", pos);
+        printf("[BEST_MATCH] pos=%zu offset=%zu\n", best_pos, best_pos - line_start);
 #endif
-        return pos;
+        return best_pos;
     } else {
         // Fallback: use approximation if cache is invalid (UTF-8 aware)
         float x = start_x;
@@ -1657,19 +2125,13 @@ inline size_t editor_mouse_to_pos(Editor* editor, const char* text, float mouse_
 // Render editor
 inline void editor_render(Editor* editor, Renderer* renderer) {
     // Use cached text string to avoid rope_to_string() every frame
-    if (editor->rope_version != editor->cached_text_version || !editor->cached_text) {
-        // Cache is invalid, regenerate text
-        printf("[RENDER DEBUG] Regenerating cached text (rope_version=%zu, cached_version=%zu)\n",
-               editor->rope_version, editor->cached_text_version);
-        if (editor->cached_text) {
-            delete[] editor->cached_text;
-        }
-        editor->cached_text = rope_to_string(&editor->rope);
-        editor->cached_text_version = editor->rope_version;
-        printf("[RENDER DEBUG] New cached text length: %zu\n", strlen(editor->cached_text ? editor->cached_text : ""));
-
-        // Also recalculate layout when text changes
-        editor_calculate_layout(editor, renderer, editor->cached_text);
+    size_t previous_version = editor->cached_text_version;
+    if (editor_refresh_text_cache(editor)) {
+        // Cache was invalid and has been regenerated
+        printf("[RENDER DEBUG] Regenerated cached text (rope_version=%zu, cached_version=%zu)\n",
+               editor->rope_version, previous_version);
+        printf("[RENDER DEBUG] New cached text length: %zu (%zu lines)\n",
+               editor->cached_text_length, editor->line_starts.size());
 
         static bool first_render = true;
         if (first_render) {
@@ -1677,9 +2139,10 @@ inline void editor_render(Editor* editor, Renderer* renderer) {
             first_render = false;
         }
     }
-    // CRITICAL: Also rebuild layout cache when zoom changes (even if text doesn't change)
-    else if (!editor->layout_cache.valid && editor->cached_text) {
-        printf("[RENDER DEBUG] Rebuilding layout cache (zoom/font changed)\n");
+
+    // Rebuild layout cache when the text changed (the refresh invalidates it)
+    // or zoom changed (even if text doesn't change)
+    if (!editor->layout_cache.valid && editor->cached_text) {
         editor_calculate_layout(editor, renderer, editor->cached_text);
     }
 
@@ -1694,75 +2157,22 @@ inline void editor_render(Editor* editor, Renderer* renderer) {
         size_t sel_start = editor->selection_start < editor->selection_end ? editor->selection_start : editor->selection_end;
         size_t sel_end = editor->selection_start < editor->selection_end ? editor->selection_end : editor->selection_start;
 
-        // Calculate selection rectangles
-        float sel_start_x = text_x;
-        float sel_start_y = text_y;
-        float sel_end_x = text_x;
-        float sel_end_y = text_y;
+        // Calculate selection endpoints from the line index: O(log n) per endpoint
         float line_height = editor->line_height;
-
-        // Use layout cache if available
-        if (editor->layout_cache.valid && editor->layout_cache.char_positions.size() > 0) {
-            // Fast path: use cached positions
-            float y = text_y;
-
-            // Find selection start position
-            for (size_t i = 0; i < sel_start && text[i]; i++) {
-                if (text[i] == '\n') {
-                    y += line_height;
-                }
-            }
-            if (sel_start < editor->layout_cache.char_positions.size()) {
-                sel_start_x = text_x + editor->layout_cache.char_positions[sel_start];
-                sel_start_y = y;
-            }
-
-            // Find selection end position
-            y = text_y;
-            for (size_t i = 0; i < sel_end && text[i]; i++) {
-                if (text[i] == '\n') {
-                    y += line_height;
-                }
-            }
-            if (sel_end < editor->layout_cache.char_positions.size()) {
-                sel_end_x = text_x + editor->layout_cache.char_positions[sel_end];
-                sel_end_y = y;
-            }
-        } else {
-            // Fallback: calculate manually (UTF-8 aware)
-            float x = text_x;
-            float y = text_y;
-            size_t pos = 0;
-            size_t len = strlen(text);
-
-            while (pos <= sel_end && pos < len && text[pos]) {
-                if (pos == sel_start) {
-                    sel_start_x = x;
-                    sel_start_y = y;
-                }
-                if (pos == sel_end) {
-                    sel_end_x = x;
-                    sel_end_y = y;
-                    break;
-                }
-
-                if (text[pos] == '\n') {
-                    x = text_x;
-                    y += line_height;
-                    pos++;
-                } else {
-                    x += 8.4f;  // Fallback approximation per character
-                    // UTF-8 aware: skip to next character boundary
-                    pos = utf8_next_char_boundary(text, pos, len);
-                }
-            }
-        }
+        sel_start = std::min(sel_start, editor->cached_text_length);
+        sel_end = std::min(sel_end, editor->cached_text_length);
+        size_t start_line = editor_line_of_offset(editor, sel_start);
+        size_t end_line = editor_line_of_offset(editor, sel_end);
+        float sel_start_y = text_y + (float)((double)start_line * line_height);
+        float sel_end_y = text_y + (float)((double)end_line * line_height);
+        float sel_start_x = text_x + editor_line_x(editor, start_line, sel_start);
+        float sel_end_x = text_x + editor_line_x(editor, end_line, sel_end);
 
         // Render selection rectangles
         Color sel_color = {0.3f, 0.5f, 0.8f, 0.3f}; // Semi-transparent blue
         float sel_y_offset = 0.0f;  // No offset needed - text_y is already top-of-line
 
-        if (sel_start_y == sel_end_y) {
+        if (start_line == end_line) {
             // Single line selection
             renderer_add_rect(renderer, sel_start_x, sel_start_y - sel_y_offset,
                             sel_end_x - sel_start_x, line_height, sel_color);
@@ -1773,12 +2183,13 @@ inline void editor_render(Editor* editor, Renderer* renderer) {
             renderer_add_rect(renderer, sel_start_x, sel_start_y - sel_y_offset,
                             viewport_width - sel_start_x, line_height, sel_color);
 
-            // Middle lines: full width
-            float current_y = sel_start_y + line_height;
-            while (current_y < sel_end_y - 0.1f) {
-                renderer_add_rect(renderer, text_x, current_y - sel_y_offset,
-                                viewport_width - text_x, line_height, sel_color);
-                current_y += line_height;
+            // Middle lines: full width, as one band clipped to the viewport
+            // (select-all on a huge file must not emit a rect per line)
+            float middle_top = std::max(sel_start_y + line_height, 0.0f);
+            float middle_bottom = std::min(sel_end_y, (float)renderer->viewport_height);
+            if (middle_bottom > middle_top) {
+                renderer_add_rect(renderer, text_x, middle_top - sel_y_offset,
+                                viewport_width - text_x, middle_bottom - middle_top, sel_color);
             }
 
             // Last line: from start of line to selection end
@@ -1787,63 +2198,103 @@ inline void editor_render(Editor* editor, Renderer* renderer) {
         }
     }
 
-    // Render text
-    renderer_add_text(renderer, text, text_x, text_y, editor->config->foreground);
+    // Render text: a window of lines around the viewport stays resident on the
+    // GPU, so scrolling only moves its view offset and adds newly exposed lines
+    {
+        float line_height = editor->line_height;
+        size_t line_count = editor->line_starts.size();
+        size_t visible_lines = (size_t)(renderer->viewport_height / line_height) + 2;
+        size_t visible_first, visible_last;
+        editor_visible_lines(editor, renderer, text_y, &visible_first, &visible_last);
+
+        // Keep one screen of lines resident above and below the viewport
+        size_t want_first = visible_first > visible_lines ? visible_first - visible_lines : 0;
+        size_t want_last = std::min(line_count, visible_last + visible_lines);
+
+        Color color = editor->config->foreground;
+        DocumentLayer* doc = &renderer->document;
+        uint64_t key = renderer_document_key(renderer, editor->cached_text_version, color);
+
+        bool resident = doc->key == key && doc->first_line < doc->last_line;
+        bool covered = resident && doc->first_line <= visible_first && doc->last_line >= visible_last;
+        if (!covered) {
+            // Extend the window if it touches the wanted range and stays a few screens
+            // tall; otherwise rebuild it around the viewport (runs are cached, so cheap)
+            size_t span = std::max(doc->last_line, want_last) - std::min(doc->first_line, want_first);
+            bool extend = resident && want_last >= doc->first_line && want_first <= doc->last_line &&
+                          span <= visible_lines * 8;
+            if (!extend) {
+                renderer_document_reset(renderer, key, visible_first);
+            }
+            if (!editor_document_extend(editor, renderer, want_first, want_last, color)) {
+                renderer_document_reset(renderer, key, visible_first);
+                editor_document_extend(editor, renderer, visible_first, visible_last, color);
+            }
+        }
+
+        // Screen position of the layer's base line (double keeps huge offsets exact)
+        float base_y = (float)((double)text_y + (double)doc->base_line * line_height);
+        renderer_queue_document(renderer, text_x, base_y);
+    }
 
     // Render search match highlights
+    // Only matches starting on visible lines are placed (regex matches that run
+    // onto later lines are highlighted to the end of their first line):
+    // binary search the sorted match_positions for the visible byte range, then
+    // one O(log n) offset-to-line lookup per match drawn. A windowed match list
+    // is first moved to cover the visible range.
     if (editor->search_state->active && editor->search_state->match_count > 0) {
         SearchState* search = editor->search_state;
-        size_t query_len = search->query_len;
-        size_t text_len = strlen(text);
+        size_t text_len = editor->cached_text_length;
         float line_height = editor->line_height;
 
-        for (size_t i = 0; i < search->match_count; i++) {
-            size_t match_pos = search->match_positions[i];
+        size_t visible_first, visible_last;
+        editor_visible_lines(editor, renderer, text_y, &visible_first, &visible_last);
+        size_t range_start = (visible_first < visible_last) ? editor->line_starts[visible_first] : text_len;
+        size_t range_end = (visible_last < editor->line_starts.size()) ? editor->line_starts[visible_last] : text_len;
+        editor_search_load_range(editor, range_start, range_end);
+
+        const size_t* matches_begin = search->match_positions;
+        const size_t* matches_end = search->match_positions + search->stored_count;
+        const size_t* first_match = std::lower_bound(matches_begin, matches_end, range_start);
+        const size_t* last_match = std::lower_bound(first_match, matches_end, range_end);
+
+        for (const size_t* match = first_match; match != last_match; match++) {
+            size_t i = match - matches_begin;
+            size_t match_pos = *match;
             if (match_pos >= text_len) continue;  // Safety check
 
-            bool is_current = (i == search->current_match_index);
+            bool is_current = (search->window_first + i == search->current_match_index);
             Color highlight_color = is_current ?
                 editor->config->search_current_match_bg : editor->config->search_match_bg;
 
-            // Calculate match start position using layout cache
+            // Calculate match start position using the line index and layout cache
+            size_t line_num = editor_line_of_offset(editor, match_pos);
+            float match_y = text_y + (float)((double)line_num * line_height);
             float match_x = text_x;
-            float match_y = text_y;
 
             if (editor->layout_cache.valid && match_pos < editor->layout_cache.char_positions.size()) {
                 // Use layout cache for accurate positioning
-                size_t line_num = 0;
-                for (size_t j = 0; j < match_pos; j++) {
-                    if (text[j] == '\n') {
-                        line_num++;
-                    }
-                }
-                match_y = text_y + line_num * line_height;
                 match_x = text_x + editor->layout_cache.char_positions[match_pos];
             } else {
                 // Fallback: approximate positioning
-                size_t line_num = 0;
-                size_t pos = 0;
-                for (size_t j = 0; j < match_pos; j++) {
-                    if (text[j] == '\n') {
-                        line_num++;
-                        pos = j + 1;
-                    }
-                }
-                match_y = text_y + line_num * line_height;
-                size_t col = match_pos - pos;
+                size_t col = match_pos - editor->line_starts[line_num];
                 match_x = text_x + col * 8.4f;  // Fallback approximation
             }
 
-            // Calculate width from match_pos to match_pos + query_len
+            // Calculate width from match_pos to the match end (or its line's end)
             float match_width = 0.0f;
-            size_t match_end = match_pos + query_len;
+            size_t match_end = match_pos + editor_search_match_length(search, i);
+            size_t line_end = line_num + 1 < editor->line_starts.size() ?
+                editor->line_starts[line_num + 1] - 1 : text_len;
+            match_end = std::min(match_end, line_end);
             if (editor->layout_cache.valid && match_end < editor->layout_cache.char_positions.size()) {
                 // Use layout cache for accurate width
                 match_width = editor->layout_cache.char_positions[match_end] -
                              editor->layout_cache.char_positions[match_pos];
             } else {
                 // Fallback
-                match_width = query_len * 8.4f;
+                match_width = (match_end - match_pos) * 8.4f;
             }
 
             // Draw highlight rectangle - no Y offset needed
@@ -1872,31 +2323,46 @@ inline void editor_render(Editor* editor, Renderer* renderer) {
         float box_x = 10.0f;
         float box_y = 10.0f;
         float box_width = 400.0f;
-        float box_height = 35.0f;
+        float row_height = 30.0f;  // Second row for the replace field
+        float box_height = search->replace_active ? 35.0f + row_height : 35.0f;
         float padding = 8.0f;
 
         // Background
         renderer_add_rect(renderer, box_x, box_y, box_width, box_height,
                          editor->config->search_box_bg);
 
-        // "Find:" label
+        // "Find:" label ("Regex:" in regex mode)
         Color label_color = {0.8f, 0.8f, 0.8f, 1.0f};
-        renderer_add_text(renderer, "Find: ", box_x + padding,
+        renderer_add_text(renderer, search->regex ? "Regex:" : "Find: ", box_x + padding,
                          box_y + padding + 2.0f, label_color);
 
-        // Query text
-        float query_x = box_x + padding + 50.0f;
+        // Query text (fields move right to make room for the "Replace:" label)
+        float query_x = box_x + padding + (search->replace_active ? 72.0f : 50.0f);
         if (search->query_len > 0) {
             renderer_add_text(renderer, search->query, query_x,
                              box_y + padding + 2.0f, editor->config->foreground);
         }
 
-        // Cursor in search box (blinking)
+        // Replace row
+        if (search->replace_active) {
+            renderer_add_text(renderer, "Replace:", box_x + padding,
+                             box_y + row_height + padding + 2.0f, label_color);
+            if (search->replacement_len > 0) {
+                renderer_add_text(renderer, search->replacement, query_x,
+                                 box_y + row_height + padding + 2.0f, editor->config->foreground);
+            }
+        }
+
+        // Cursor in the focused field (blinking)
         if (editor->cursor_blink_time < 0.5f) {
-            // Calculate cursor X position after query text using actual glyph metrics (UTF-8 aware)
+            const char* field = search->replace_focus ? search->replacement : search->query;
+            size_t field_len = search->replace_focus ? search->replacement_len : search->query_len;
+            float field_y = search->replace_focus ? box_y + row_height : box_y;
+
+            // Calculate cursor X position after the field text using actual glyph metrics (UTF-8 aware)
             float text_width = 0.0f;
-            const char* p = search->query;
-            while (*p && (size_t)(p - search->query) < search->query_len) {
+            const char* p = field;
+            while (*p && (size_t)(p - field) < field_len) {
                 uint32_t codepoint = utf8_decode(&p);
                 if (codepoint == 0) break;
 
@@ -1908,8 +2374,8 @@ inline void editor_render(Editor* editor, Renderer* renderer) {
                 }
             }
             float cursor_x_offset = query_x + text_width;
-            // Align cursor with text baseline (text is at box_y + padding + 2.0f)
-            float cursor_y = box_y + padding + 2.0f - 12.0f;  // Baseline minus font ascent
+            // Align cursor with text baseline (text is at field_y + padding + 2.0f)
+            float cursor_y = field_y + padding + 2.0f - 12.0f;  // Baseline minus font ascent
             renderer_add_rect(renderer, cursor_x_offset, cursor_y,
                              2.0f, 16.0f, editor->config->cursor);
         }
@@ -1917,7 +2383,12 @@ inline void editor_render(Editor* editor, Renderer* renderer) {
         // Match counter
         if (search->query_len > 0) {
             char match_info[64];
-            if (search->match_count > 0) {
+            if (search->regex_error) {
+                snprintf(match_info, sizeof(match_info), "Bad regex");
+            } else if (search->job) {
+                // Still scanning: the total is a lower bound
+                snprintf(match_info, sizeof(match_info), "%zu found...", search->match_count);
+            } else if (search->match_count > 0) {
                 snprintf(match_info, sizeof(match_info), "%zu of %zu",
                         search->current_match_index + 1, search->match_count);
             } else {
@@ -1975,6 +2446,16 @@ inline void editor_render(Editor* editor, Renderer* renderer) {
     }
 
     // Note: Don't delete text here - it's cached in editor->cached_text
+
+    // Everything is now on screen; remember it for the next damage report
+    size_t first_line, last_line;
+    editor_visible_lines(editor, renderer, text_y, &first_line, &last_line);
+    editor_hash_rows(editor, first_line, last_line, &editor->drawn_row_hashes);
+    editor->drawn_first_line = first_line;
+    editor->drawn_cursor_line = editor_line_of_offset(editor, std::min(editor->cursor_pos, editor->cached_text_length));
+    editor->drawn_state = editor_view_state(editor);
+    editor->drawn_valid = true;
+    editor->dirty = 0;
 }
 
 // Open file
@@ -2001,6 +2482,7 @@ inline bool editor_open_file(Editor* editor, const char* path) {
     rope_from_string(&editor->rope, buffer);
     editor->cursor_pos = 0;
     editor->rope_version++;  // Invalidate cache
+    editor->dirty |= EDITOR_DIRTY_TEXT | EDITOR_DIRTY_CURSOR;
 
     // Store file path
     if (editor->file_path) {
@@ -2068,24 +2550,18 @@ inline void editor_shutdown(Editor* editor) {
     }
 
     // Clean up undo/redo stacks
-    for (auto& cmd : editor->undo_stack) {
-        delete[] cmd.content;
-    }
-    editor->undo_stack.clear();
-
-    for (auto& cmd : editor->redo_stack) {
-        delete[] cmd.content;
-    }
-    editor->redo_stack.clear();
+    undo_free(&editor->undo);
 
     // Clean up cached text
     if (editor->cached_text) {
         delete[] editor->cached_text;
         editor->cached_text = nullptr;
+        editor->cached_text_length = 0;
     }
 
     // Clean up search state
     if (editor->search_state) {
+        search_job_free(editor->search_state->job);
         if (editor->search_state->match_positions) {
             delete[] editor->search_state->match_positions;
         }
@@ -2114,115 +2590,551 @@ inline void editor_search_open(Editor* editor) {
 // Close search box and clear highlights
 inline void editor_search_close(Editor* editor) {
     editor->search_state->active = false;
+    editor->search_state->replace_active = false;
     editor->search_state->match_count = 0;
+    editor->search_state->stored_count = 0;
+    editor->search_state->matched_query_len = 0;
+    std::vector<size_t>().swap(editor->search_state->checkpoints);
+    search_job_free(editor->search_state->job);
+    editor->search_state->job = nullptr;
 }
 
-// Find all matches in rope
-inline void editor_search_update_matches(Editor* editor) {
+// Grow the match array to hold at least `needed` positions (keeps the current ones)
+inline void editor_search_reserve(SearchState* search, size_t needed) {
+    if (needed <= search->match_capacity) return;
+
+    size_t capacity = search->match_capacity == 0 ? 16 : search->match_capacity;
+    while (capacity < needed) capacity *= 2;
+    size_t* positions = new size_t[capacity];
+    if (search->stored_count > 0) {
+        memcpy(positions, search->match_positions, search->stored_count * sizeof(size_t));
+    }
+    delete[] search->match_positions;
+    search->match_positions = positions;
+    search->match_capacity = capacity;
+}
+
+// Append matches (ascending, after any already present), growing the array as
+// needed; regex matches come with their lengths. Past max_stored the matches
+// are only counted (and checkpointed): the window stays at the start.
+inline void editor_search_append_matches(SearchState* search, const size_t* matches, size_t count,
+                                         const size_t* lengths = nullptr) {
+    if (count == 0) return;
+
+    size_t next_checkpoint = (SEARCH_CHECKPOINT_MATCHES - search->match_count % SEARCH_CHECKPOINT_MATCHES) %
+                             SEARCH_CHECKPOINT_MATCHES;
+    for (size_t i = next_checkpoint; i < count; i += SEARCH_CHECKPOINT_MATCHES) {
+        search->checkpoints.push_back(matches[i]);
+    }
+
+    size_t room = 0;
+    if (search->stored_count == search->match_count) {
+        room = std::min(count, search->max_stored - search->stored_count);
+    }
+    if (room > 0) {
+        editor_search_reserve(search, search->stored_count + room);
+        memcpy(search->match_positions + search->stored_count, matches, room * sizeof(size_t));
+        if (lengths) {
+            search->match_lengths.resize(search->stored_count);
+            search->match_lengths.insert(search->match_lengths.end(), lengths, lengths + room);
+        }
+        search->stored_count += room;
+    }
+    if (room < count && search->window_end == SIZE_MAX) {
+        search->window_end = matches[room];
+    }
+    search->match_count += count;
+}
+
+// Is only a window of the matches stored?
+inline bool editor_search_windowed(const SearchState* search) {
+    return search->stored_count < search->match_count;
+}
+
+// Length of stored match i (match window_first + i) in bytes
+inline size_t editor_search_match_length(const SearchState* search, size_t i) {
+    return search->regex ? search->match_lengths[i] : search->query_len;
+}
+
+// Move the cursor to the first match once one is known
+inline void editor_search_jump_to_first(Editor* editor) {
     SearchState* search = editor->search_state;
+    if (!search->jump_to_first || search->match_count == 0) return;
 
-    // Check if query is empty
-    if (search->query_len == 0) {
-        search->match_count = 0;
+    search->jump_to_first = false;
+    editor->cursor_pos = search->match_positions[0];
+    editor_ensure_cursor_visible(editor);
+}
+
+// Remember that the match list is complete for the current query
+// Regex lists are never refined or patched (a match can span any amount of
+// text), so edits and new queries simply rerun the search; neither are
+// windowed lists, which lack most of the matches to refine or shift.
+inline void editor_search_mark_complete(SearchState* search) {
+    if (search->regex || editor_search_windowed(search)) {
+        search->matched_query_len = 0;
+        return;
+    }
+    memcpy(search->matched_query, search->query, search->query_len);
+    search->matched_query_len = search->query_len;
+    search->matched_case_sensitive = search->case_sensitive;
+}
+
+// Regex counterpart of the scan in editor_search_update_matches()
+inline void editor_search_run_regex(Editor* editor) {
+    SearchState* search = editor->search_state;
+
+    // Compiled here even for background searches, to report errors right away
+    Regex* regex = new Regex();
+    if (!regex_compile(regex, search->query, search->query_len, search->case_sensitive)) {
+        printf("[Search] Regex \"%s\": %s\n", search->query, regex->error);
+        search->regex_error = true;
+        search->jump_to_first = false;
+        delete regex;
         return;
     }
 
+    if (rope_length(&editor->rope) >= SEARCH_BACKGROUND_MIN_BYTES) {
+        delete regex;
+        search->job = search_job_start_regex(&editor->rope, search->query, search->query_len,
+                                             search->case_sensitive);
+        printf("[Search] Regex: \"%s\" - searching %zu bytes in the background\n",
+               search->query, rope_length(&editor->rope));
+        return;
+    }
+
+    std::vector<size_t> starts;
+    std::vector<size_t> lengths;
+    regex_search_rope(regex, &editor->rope, &starts, &lengths);
+    delete regex;
+    editor_search_append_matches(search, starts.data(), starts.size(), lengths.data());
+    editor_search_mark_complete(search);
+
+    printf("[Search] Regex: \"%s\" - Found %zu matches (case_sensitive=%d)\n",
+           search->query, search->match_count, search->case_sensitive);
+
+    editor_search_jump_to_first(editor);
+}
+
+// Find all matches in rope
+// Small documents are scanned right away; larger ones on a background thread
+// whose matches are taken by editor_search_poll() as they are found.
+inline void editor_search_update_matches(Editor* editor) {
+    SearchState* search = editor->search_state;
+
+    // Every match of the grown query extends a match of the old one, so only
+    // those positions need checking (same text, options, and a finished search
+    // for a query that doesn't end mid-character)
+    bool refine = !search->job && !search->regex && search->matched_query_len > 0 &&
+                  search->query_len > search->matched_query_len &&
+                  search->rope_version_at_search == editor->rope_version &&
+                  search->matched_case_sensitive == search->case_sensitive &&
+                  memcmp(search->query, search->matched_query, search->matched_query_len) == 0 &&
+                  (search->case_sensitive ||
+                   search_utf8_ends_complete(search->matched_query, search->matched_query_len));
+
+    // Whatever was running searched for an older query or text
+    search_job_free(search->job);
+    search->job = nullptr;
+    search->current_match_index = 0;
+    search->rope_version_at_search = editor->rope_version;
+
     // Note: We don't skip if rope hasn't changed because the query itself
     // may have changed. The search must update whenever the query changes.
 
-    // Convert rope to string for searching
-    char* text = rope_to_string(&editor->rope);
-    size_t text_len = rope_length(&editor->rope);
+    if (refine) {
+        SearchPattern pattern;
+        search_pattern_init(&pattern, search->query, search->query_len, search->case_sensitive);
+        search->match_count = search_refine(&pattern, &editor->rope, search->matched_query_len,
+                                            search->match_positions, search->match_count);
+        search->stored_count = search->match_count;
+        search->checkpoints.clear();  // Only used by windowed lists, which are never refined
+        editor_search_mark_complete(search);
+
+        printf("[Search] Query: \"%s\" - Refined to %zu matches (case_sensitive=%d)\n",
+               search->query, search->match_count, search->case_sensitive);
+
+        search->jump_to_first = true;
+        editor_search_jump_to_first(editor);
+        return;
+    }
 
-    // Reset match count
     search->match_count = 0;
+    search->stored_count = 0;
+    search->window_first = 0;
+    search->window_end = SIZE_MAX;
+    search->checkpoints.clear();
+    search->matched_query_len = 0;
+    search->regex_error = false;
 
-    // Simple naive search (good for MVP)
-    const char* query = search->query;
-    size_t query_len = search->query_len;
+    size_t limit = editor->config->search_match_memory;
+    size_t match_bytes = search->regex ? 2 * sizeof(size_t) : sizeof(size_t);  // Regex: offset and length
+    search->max_stored = limit == 0 ? SIZE_MAX : std::max(limit / match_bytes, 2 * SEARCH_CHECKPOINT_MATCHES);
 
-    // Check if query is longer than text (prevent underflow)
-    if (text_len < query_len) {
-        delete[] text;
+    // Check if query is empty
+    if (search->query_len == 0) {
         return;
     }
 
-    for (size_t i = 0; i <= text_len - query_len; i++) {
-        bool match = true;
+    search->jump_to_first = true;
 
-        // Case-insensitive comparison by default
-        for (size_t j = 0; j < query_len; j++) {
-            char text_ch = text[i + j];
-            char query_ch = query[j];
+    if (search->regex) {
+        editor_search_run_regex(editor);
+        return;
+    }
 
-            if (!search->case_sensitive) {
-                text_ch = tolower(text_ch);
-                query_ch = tolower(query_ch);
-            }
+    if (rope_length(&editor->rope) >= SEARCH_BACKGROUND_MIN_BYTES) {
+        search->job = search_job_start(&editor->rope, search->query, search->query_len,
+                                       search->case_sensitive);
+        printf("[Search] Query: \"%s\" - searching %zu bytes in the background\n",
+               search->query, rope_length(&editor->rope));
+        return;
+    }
 
-            if (text_ch != query_ch) {
-                match = false;
-                break;
-            }
-        }
+    // Scan the rope's leaves in place (no flattening copy)
+    SearchPattern pattern;
+    search_pattern_init(&pattern, search->query, search->query_len, search->case_sensitive);
+    std::vector<size_t> matches;
+    search_rope(&pattern, &editor->rope, &matches);
+    editor_search_append_matches(search, matches.data(), matches.size());
+    editor_search_mark_complete(search);
 
-        if (match) {
-            // Grow array if needed
-            if (search->match_count >= search->match_capacity) {
-                search->match_capacity = search->match_capacity == 0 ?
-                    16 : search->match_capacity * 2;
-                size_t* new_positions = new size_t[search->match_capacity];
-                if (search->match_positions) {
-                    memcpy(new_positions, search->match_positions,
-                           search->match_count * sizeof(size_t));
-                    delete[] search->match_positions;
-                }
-                search->match_positions = new_positions;
-            }
+    printf("[Search] Query: \"%s\" - Found %zu matches (case_sensitive=%d)\n",
+           search->query, search->match_count, search->case_sensitive);
 
-            search->match_positions[search->match_count++] = i;
-        }
+    editor_search_jump_to_first(editor);
+}
+
+// Take matches published by the background search, if one is running
+inline void editor_search_poll(Editor* editor) {
+    SearchState* search = editor->search_state;
+    if (!search->job) return;
+
+    std::vector<size_t> matches;
+    std::vector<size_t> lengths;
+    bool finished = search_job_take(search->job, &matches, &lengths);
+    editor_search_append_matches(search, matches.data(), matches.size(),
+                                 search->regex ? lengths.data() : nullptr);
+    editor_search_jump_to_first(editor);
+
+    if (finished) {
+        search_job_free(search->job);
+        search->job = nullptr;
+        editor_search_mark_complete(search);
+        printf("[Search] Query: \"%s\" - Found %zu matches (case_sensitive=%d)\n",
+               search->query, search->match_count, search->case_sensitive);
     }
+}
 
-    delete[] text;
+// Block until the background search (if any) has finished and take its matches
+inline void editor_search_wait(Editor* editor) {
+    if (!editor->search_state->job) return;
+    search_job_wait(editor->search_state->job);
+    editor_search_poll(editor);
+}
 
-    // Update version and reset index
+// Patch the match list for an edit (already applied) that replaced `removed`
+// bytes at pos with `inserted` bytes: matches overlapping the edit are dropped,
+// later ones shifted, and only starts within query_len of the edit rescanned.
+// A list that wasn't complete for the text before the edit is left to the
+// rerun in editor_update().
+inline void editor_search_after_edit(Editor* editor, size_t pos, size_t removed, size_t inserted) {
+    SearchState* search = editor->search_state;
+    if (search->job || search->matched_query_len == 0 ||
+        search->rope_version_at_search + 1 != editor->rope_version) {
+        return;
+    }
+
+    // Matches starting in [first, pos + removed) touched the old text of the edit
+    size_t m = search->matched_query_len;
+    size_t first = pos >= m - 1 ? pos - (m - 1) : 0;
+    size_t* positions = search->match_positions;
+    size_t head = std::lower_bound(positions, positions + search->stored_count, first) - positions;
+    size_t tail_from = std::lower_bound(positions + head, positions + search->stored_count,
+                                        pos + removed) - positions;
+    size_t tail = search->stored_count - tail_from;
+
+    // New text can only create matches starting in [first, pos + inserted)
+    SearchPattern pattern;
+    search_pattern_init(&pattern, search->matched_query, m, search->matched_case_sensitive);
+    std::vector<size_t> found;
+    search_rope_window(&pattern, &editor->rope, first, pos + inserted, &found);
+
+    editor_search_reserve(search, head + found.size() + tail);
+    positions = search->match_positions;
+    memmove(positions + head + found.size(), positions + tail_from, tail * sizeof(size_t));
+    for (size_t i = head + found.size(); i < head + found.size() + tail; i++) {
+        positions[i] = positions[i] - removed + inserted;
+    }
+    if (!found.empty()) {
+        memcpy(positions + head, found.data(), found.size() * sizeof(size_t));
+    }
+    search->match_count = head + found.size() + tail;
+    search->stored_count = search->match_count;
+    search->checkpoints.clear();
+
+    if (search->current_match_index >= search->match_count) {
+        search->current_match_index = search->match_count ? search->match_count - 1 : 0;
+    }
     search->rope_version_at_search = editor->rope_version;
-    search->current_match_index = 0;
+}
 
-    printf("[Search] Query: \"%s\" - Found %zu matches (case_sensitive=%d)\n",
-           search->query, search->match_count, search->case_sensitive);
+// Can a windowed match list be rebuilt from its checkpoints? Only once the
+// search has finished, and for the text it searched.
+inline bool editor_search_can_load(Editor* editor) {
+    SearchState* search = editor->search_state;
+    return editor_search_windowed(search) && !search->job &&
+           search->rope_version_at_search == editor->rope_version;
+}
+
+// Rebuild the stored window of a windowed match list from checkpoint k: up to
+// `count` matches, found by scanning forward from the checkpoint's offset
+// (a match start, so a regex scan resumes exactly as the full one went on)
+inline void editor_search_load_window(Editor* editor, size_t k, size_t count) {
+    SearchState* search = editor->search_state;
+    size_t first = k * SEARCH_CHECKPOINT_MATCHES;
+    count = std::min(std::min(count, search->max_stored), search->match_count - first);
+    if (first == search->window_first && search->stored_count >= count) return;
+
+    std::vector<size_t> starts;
+    std::vector<size_t> lengths;
+    if (search->regex) {
+        Regex* regex = new Regex();
+        regex_compile(regex, search->query, search->query_len, search->case_sensitive);
+        size_t from = search->checkpoints[k];
+        size_t start, end;
+        while (starts.size() < count && regex_find(regex, &editor->rope, from, &start, &end)) {
+            starts.push_back(start);
+            lengths.push_back(end - start);
+            from = end;
+        }
+        delete regex;
+    } else {
+        SearchPattern pattern;
+        search_pattern_init(&pattern, search->query, search->query_len, search->case_sensitive);
+        search_rope_from(&pattern, &editor->rope, search->checkpoints[k], count, &starts);
+    }
 
-    // Move cursor to first match if any
-    if (search->match_count > 0) {
-        editor->cursor_pos = search->match_positions[0];
-        editor_ensure_cursor_visible(editor);
+    // The array the search filled up to the ceiling isn't needed any more
+    search->stored_count = 0;
+    if (search->match_capacity > 2 * std::max(starts.size(), SEARCH_WINDOW_MATCHES)) {
+        delete[] search->match_positions;
+        search->match_positions = nullptr;
+        search->match_capacity = 0;
+    }
+    editor_search_reserve(search, starts.size());
+    if (!starts.empty()) {
+        memcpy(search->match_positions, starts.data(), starts.size() * sizeof(size_t));
     }
+    search->match_lengths.swap(lengths);
+    search->stored_count = starts.size();
+    search->window_first = first;
+    // The next match (not stored) starts after the last stored one
+    search->window_end = first + starts.size() < search->match_count && !starts.empty() ?
+        starts.back() + 1 : SIZE_MAX;
+}
+
+// Make sure match `index` is stored; false if it isn't and can't be loaded
+// Going forward the window is loaded to start just before the match, going
+// backward to end just after it, so stepping on reloads rarely.
+inline bool editor_search_load_match(Editor* editor, size_t index, bool backward) {
+    SearchState* search = editor->search_state;
+    if (index - search->window_first < search->stored_count) return true;
+    if (!editor_search_can_load(editor)) return false;
+
+    size_t window = std::min(search->max_stored, SEARCH_WINDOW_MATCHES);
+    size_t k = index / SEARCH_CHECKPOINT_MATCHES;
+    size_t span = window - SEARCH_CHECKPOINT_MATCHES;
+    if (backward) {
+        k = index >= span ? (index - span) / SEARCH_CHECKPOINT_MATCHES + 1 : 0;
+    }
+    editor_search_load_window(editor, k, window);
+    return index - search->window_first < search->stored_count;
+}
+
+// Make sure the matches starting in [range_start, range_end) are stored, as
+// far as max_stored allows
+inline void editor_search_load_range(Editor* editor, size_t range_start, size_t range_end) {
+    SearchState* search = editor->search_state;
+    if (!editor_search_can_load(editor)) return;
+    bool covers_start = search->window_first == 0 ||
+                        (search->stored_count > 0 && search->match_positions[0] <= range_start);
+    if (covers_start && range_end <= search->window_end) return;
+
+    // From the last checkpoint at or before the range through the first one
+    // after it, and at least a window's worth
+    const std::vector<size_t>& checkpoints = search->checkpoints;
+    size_t k = std::upper_bound(checkpoints.begin(), checkpoints.end(), range_start) - checkpoints.begin();
+    k = k > 0 ? k - 1 : 0;
+    size_t k_end = std::lower_bound(checkpoints.begin(), checkpoints.end(), range_end) - checkpoints.begin();
+    size_t count = std::max(SEARCH_WINDOW_MATCHES, (k_end - k + 1) * SEARCH_CHECKPOINT_MATCHES);
+    editor_search_load_window(editor, k, count);
 }
 
 // Navigate to next match
+// Until a background search finishes, only the stored matches can be visited.
 inline void editor_search_next_match(Editor* editor) {
     SearchState* search = editor->search_state;
-    if (search->match_count == 0) return;
+    size_t count = search->job ? search->stored_count : search->match_count;
+    if (count == 0) return;
 
-    search->current_match_index = (search->current_match_index + 1) % search->match_count;
-    editor->cursor_pos = search->match_positions[search->current_match_index];
+    size_t next = (search->current_match_index + 1) % count;
+    if (!editor_search_load_match(editor, next, false)) return;
+    search->current_match_index = next;
+    editor->cursor_pos = search->match_positions[next - search->window_first];
     editor_ensure_cursor_visible(editor);
 }
 
 // Navigate to previous match
 inline void editor_search_prev_match(Editor* editor) {
     SearchState* search = editor->search_state;
-    if (search->match_count == 0) return;
+    size_t count = search->job ? search->stored_count : search->match_count;
+    if (count == 0) return;
+
+    size_t prev = search->current_match_index == 0 ? count - 1 :
+        std::min(search->current_match_index - 1, count - 1);
+    if (!editor_search_load_match(editor, prev, true)) return;
+    search->current_match_index = prev;
+    editor->cursor_pos = search->match_positions[prev - search->window_first];
+    editor_ensure_cursor_visible(editor);
+}
 
-    if (search->current_match_index == 0) {
-        search->current_match_index = search->match_count - 1;
+// Replace-all for a windowed match list, never holding more matches than the
+// list itself may: the text from before is scanned max_stored matches at a
+// time and each batch spliced into the rope (one rebuild per batch). Undo
+// swaps that text back in as a snapshot, since the replaced texts and their
+// positions are exactly what can't be kept. Returns how many were replaced.
+inline size_t editor_replace_all_streamed(Editor* editor) {
+    SearchState* search = editor->search_state;
+    Rope before;
+    rope_snapshot(&editor->rope, &before);
+
+    Regex* regex = nullptr;
+    SearchPattern pattern;
+    if (search->regex) {
+        regex = new Regex();
+        regex_compile(regex, search->query, search->query_len, search->case_sensitive);
     } else {
-        search->current_match_index--;
+        search_pattern_init(&pattern, search->query, search->query_len, search->case_sensitive);
     }
 
-    editor->cursor_pos = search->match_positions[search->current_match_index];
-    editor_ensure_cursor_visible(editor);
+    size_t batch = search->max_stored;
+    std::vector<size_t> starts;
+    std::vector<size_t> lengths;
+    std::vector<RopeSplice> splices;
+    size_t count = 0;
+    size_t first_pos = 0;
+    size_t match_end = 0;  // In the text from before
+    size_t inserted = 0;   // Bytes replaced in earlier batches, and their
+    size_t removed = 0;    // replacements, to place splices in the current text
+    for (;;) {
+        starts.clear();
+        lengths.clear();
+        if (regex) {
+            size_t from = match_end;
+            size_t start, end;
+            while (starts.size() < batch && regex_find(regex, &before, from, &start, &end)) {
+                starts.push_back(start);
+                lengths.push_back(end - start);
+                from = end;
+            }
+        } else {
+            search_rope_from(&pattern, &before, match_end, batch, &starts);
+        }
+        if (starts.empty()) break;
+
+        splices.clear();
+        size_t batch_inserted = 0;
+        size_t batch_removed = 0;
+        for (size_t i = 0; i < starts.size(); i++) {
+            size_t pos = starts[i];
+            size_t length = regex ? lengths[i] : search->query_len;
+            if (pos < match_end) continue;  // Overlaps the previous match
+            if (count++ == 0) first_pos = pos;
+            splices.push_back({pos + inserted - removed, length, search->replacement, search->replacement_len});
+            batch_inserted += search->replacement_len;
+            batch_removed += length;
+            match_end = pos + length;
+        }
+        editor_rope_splice(editor, splices.data(), splices.size());
+        inserted += batch_inserted;
+        removed += batch_removed;
+        if (starts.size() < batch) break;
+    }
+    delete regex;
+
+    if (count == 0) {
+        rope_free(&before);
+        return 0;
+    }
+    undo_push_snapshot(&editor->undo, CMD_REPLACE_ALL, first_pos, 0, &before);
+    return count;
+}
+
+// Replace every match of the search with the replacement text, as one undo
+// step. The rope is rebuilt in a single pass (rope_splice) rather than edited
+// match by match. Overlapping matches (literal search finds "aa" twice in
+// "aaa") are replaced leftmost first. Returns how many were replaced.
+inline size_t editor_replace_all(Editor* editor) {
+    SearchState* search = editor->search_state;
+    if (search->query_len == 0) return 0;
+
+    // The match list must be complete and for the current text
+    if (search->rope_version_at_search != editor->rope_version) {
+        editor_search_update_matches(editor);
+    }
+    editor_search_wait(editor);
+    if (search->match_count == 0) return 0;
+
+    // A windowed list lacks most of the matches, and finding them all again
+    // would hold every one of them in memory
+    if (editor_search_windowed(search)) {
+        size_t count = editor_replace_all_streamed(editor);
+        printf("[Replace] Replaced %zu matches of \"%s\" with \"%s\"\n", count, search->query,
+               search->replacement);
+        return count;
+    }
+    const size_t* positions = search->match_positions;
+    const size_t* lengths = search->regex ? search->match_lengths.data() : nullptr;
+    size_t match_count = search->stored_count;
+
+    // Undoing it rebuilds the whole rope, so in a large document the rope from
+    // before is kept as a snapshot instead of the replaced texts
+    bool snapshot = editor_undo_snapshots(editor, rope_length(&editor->rope));
+
+    ReplaceAllCommand* replace = new ReplaceAllCommand();
+    replace->replacement.assign(search->replacement, search->replacement_len);
+    std::string old_text;
+    size_t match_end = 0;
+    for (size_t i = 0; i < match_count; i++) {
+        size_t pos = positions[i];
+        size_t length = lengths ? lengths[i] : search->query_len;
+        if (pos < match_end) continue;  // Overlaps the previous match
+        replace->positions.push_back(pos);
+        replace->lengths.push_back(length);
+        if (!snapshot) {
+            old_text.resize(old_text.size() + length);
+            rope_copy(&editor->rope, pos, &old_text[old_text.size() - length], length);
+        }
+        match_end = pos + length;
+    }
+
+    size_t count = replace->positions.size();
+    if (snapshot) {
+        Rope before;
+        rope_snapshot(&editor->rope, &before);
+        editor_apply_replace_all(editor, replace, nullptr, false);
+        undo_push_snapshot(&editor->undo, CMD_REPLACE_ALL, replace->positions[0], 0, &before);
+        delete replace;
+    } else {
+        Command* cmd = editor_push_command(editor, CMD_REPLACE_ALL, replace->positions[0], old_text.data(),
+                                           old_text.size(), replace);
+        editor_apply_replace_all(editor, replace, cmd->content, false);
+    }
+
+    printf("[Replace] Replaced %zu matches of \"%s\" with \"%s\"\n", count, search->query,
+           search->replacement);
+    return count;
 }
 
 #endif // ZED_EDITOR_H
@@ -1,5 +1,6 @@
 // FreeType font loading and glyph atlas management
 // Dynamic atlas with LRU eviction, subpixel AA
+// Cache misses are rasterized on a background thread and land a frame or two later
 
 #ifndef ZED_FONT_H
 #define ZED_FONT_H
@@ -7,17 +8,36 @@
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_LCD_FILTER_H
+#include FT_ADVANCES_H
 
 #include <GL/gl.h>
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 // Atlas configuration
 constexpr int ATLAS_WIDTH = 2048;
 constexpr int ATLAS_HEIGHT = 2048;
 constexpr int GLYPH_PADDING = 2;  // Padding between glyphs
 
+// Placeholder block reserved at the atlas origin (drawn while a glyph is rasterizing)
+constexpr int PLACEHOLDER_SIZE = 4;
+constexpr unsigned char PLACEHOLDER_ALPHA = 0x50;  // ~30% coverage, reads as a faint box
+
+// GPU glyph table: instances reference glyphs by 16-bit slot
+constexpr uint32_t GLYPH_TABLE_CAPACITY = 65536;
+constexpr int GLYPH_TABLE_STRIDE = 8;  // Floats per slot: uv rect + (bearing_x, bearing_y, w, h)
+
+// Background rasterizer queue size (must be a power of two)
+constexpr uint32_t GLYPH_QUEUE_CAPACITY = 1024;
+
 // Glyph info
 struct GlyphInfo {
     // Atlas texture coordinates (normalized 0-1)
@@ -30,9 +50,13 @@ struct GlyphInfo {
     float width;
     float height;
 
+    // GPU glyph table slot (stays the same when a placeholder is replaced)
+    uint16_t slot;
+
     // LRU tracking
     uint32_t last_used_frame;
     bool in_atlas;
+    bool pending;       // Placeholder: real bitmap is being rasterized in the background
 };
 
 // Glyph atlas
@@ -46,6 +70,89 @@ struct GlyphAtlas {
 
     // Glyph cache: codepoint -> GlyphInfo
     std::unordered_map<uint32_t, GlyphInfo> glyphs;
+
+    // CPU copy of the GPU glyph table, plus the slot range not yet uploaded
+    std::vector<float> glyph_table;
+    uint32_t slot_count;
+    uint32_t table_dirty_begin;
+    uint32_t table_dirty_end;
+};
+
+// Single-producer/single-consumer lock-free ring buffer
+// One thread pushes, one thread pops; head/tail are the only shared state.
+template <typename T>
+struct SpscQueue {
+    T items[GLYPH_QUEUE_CAPACITY];
+    std::atomic<uint32_t> head;  // Next slot to pop (written by consumer)
+    std::atomic<uint32_t> tail;  // Next slot to push (written by producer)
+};
+
+template <typename T>
+inline void spsc_queue_init(SpscQueue<T>* queue) {
+    queue->head.store(0, std::memory_order_relaxed);
+    queue->tail.store(0, std::memory_order_relaxed);
+}
+
+template <typename T>
+inline bool spsc_queue_push(SpscQueue<T>* queue, const T& item) {
+    uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+    uint32_t head = queue->head.load(std::memory_order_acquire);
+    if (tail - head >= GLYPH_QUEUE_CAPACITY) {
+        return false;  // Full
+    }
+    queue->items[tail & (GLYPH_QUEUE_CAPACITY - 1)] = item;
+    queue->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+inline bool spsc_queue_pop(SpscQueue<T>* queue, T* out) {
+    uint32_t head = queue->head.load(std::memory_order_relaxed);
+    uint32_t tail = queue->tail.load(std::memory_order_acquire);
+    if (head == tail) {
+        return false;  // Empty
+    }
+    *out = queue->items[head & (GLYPH_QUEUE_CAPACITY - 1)];
+    queue->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// Glyph request (render thread -> rasterizer)
+struct GlyphRequest {
+    uint32_t codepoint;
+    uint32_t generation;  // Font size generation at request time
+    int font_size;
+};
+
+// Rasterized glyph (rasterizer -> render thread)
+struct RasterizedGlyph {
+    uint32_t codepoint;
+    uint32_t generation;
+    bool ok;                 // False if FreeType failed to load the glyph
+    int width;
+    int height;
+    float advance_x;
+    float bearing_x;
+    float bearing_y;
+    unsigned char* bitmap;   // width * height bytes, freed by the render thread
+};
+
+// Background rasterizer: owns its own FT_Library/FT_Face because FreeType
+// objects must not be shared between threads
+struct GlyphRasterizer {
+    FT_Library ft_library;
+    FT_Face face;
+    int font_size;           // Size currently set on the worker face
+
+    std::thread thread;
+    std::atomic<bool> running;
+
+    SpscQueue<GlyphRequest> requests;
+    SpscQueue<RasterizedGlyph> results;
+
+    // Only used to park the worker while the request queue is empty
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
 };
 
 // Font system
@@ -57,10 +164,22 @@ struct FontSystem {
     float line_height;
     float ascent;   // Distance from top of line to baseline
     float descent;  // Distance from baseline to bottom of line
+
+    // Background rasterization (nullptr = synchronous fallback)
+    GlyphRasterizer* rasterizer;
+    uint32_t generation;  // Bumped on resize so stale bitmaps are dropped
+    uint32_t glyphs_in_flight;  // Requests queued whose results haven't been drained
 };
 
 // Initialize FreeType library
 inline bool font_system_init(FontSystem* font_sys) {
+    font_sys->face = nullptr;
+    font_sys->rasterizer = nullptr;
+    font_sys->generation = 0;
+    font_sys->glyphs_in_flight = 0;
+    font_sys->atlas.buffer = nullptr;
+    font_sys->atlas.texture = 0;
+
     if (FT_Init_FreeType(&font_sys->ft_library)) {
         fprintf(stderr, "Failed to initialize FreeType\n");
         return false;
@@ -109,6 +228,7 @@ inline bool font_system_resize(FontSystem* font_sys, int new_font_size) {
 
     // Update stored size and metrics
     font_sys->font_size = new_font_size;
+    font_sys->generation++;  // In-flight rasterizations are now the wrong size
     font_sys->line_height = font_sys->face->size->metrics.height / 64.0f;
     font_sys->ascent = font_sys->face->size->metrics.ascender / 64.0f;
     font_sys->descent = -font_sys->face->size->metrics.descender / 64.0f;
@@ -118,16 +238,70 @@ inline bool font_system_resize(FontSystem* font_sys, int new_font_size) {
     return true;
 }
 
+// Reserve the placeholder block at the atlas origin and start packing after it
+inline void glyph_atlas_reserve_placeholder(GlyphAtlas* atlas) {
+    for (int y = 0; y < PLACEHOLDER_SIZE; y++) {
+        memset(atlas->buffer + (GLYPH_PADDING + y) * ATLAS_WIDTH + GLYPH_PADDING,
+               PLACEHOLDER_ALPHA, PLACEHOLDER_SIZE);
+    }
+
+    atlas->current_x = GLYPH_PADDING + PLACEHOLDER_SIZE + GLYPH_PADDING;
+    atlas->current_y = GLYPH_PADDING;
+    atlas->current_row_height = PLACEHOLDER_SIZE;
+}
+
+// Reset glyph table bookkeeping (all slots free)
+inline void glyph_atlas_reset_slots(GlyphAtlas* atlas) {
+    atlas->glyph_table.clear();
+    atlas->slot_count = 0;
+    atlas->table_dirty_begin = 0;
+    atlas->table_dirty_end = 0;
+}
+
+// Allocate a glyph table slot (fails once 16-bit indices are exhausted)
+inline bool glyph_atlas_alloc_slot(GlyphAtlas* atlas, uint16_t* out_slot) {
+    if (atlas->slot_count >= GLYPH_TABLE_CAPACITY) {
+        fprintf(stderr, "Glyph table full (%u slots)\n", GLYPH_TABLE_CAPACITY);
+        return false;
+    }
+    *out_slot = (uint16_t)atlas->slot_count++;
+    atlas->glyph_table.resize(atlas->slot_count * GLYPH_TABLE_STRIDE);
+    return true;
+}
+
+// Write a glyph's UVs and metrics into its table slot and mark it for upload
+inline void glyph_atlas_write_slot(GlyphAtlas* atlas, const GlyphInfo* info) {
+    float* entry = &atlas->glyph_table[info->slot * GLYPH_TABLE_STRIDE];
+    entry[0] = info->u0;
+    entry[1] = info->v0;
+    entry[2] = info->u1;
+    entry[3] = info->v1;
+    entry[4] = info->bearing_x;
+    entry[5] = info->bearing_y;
+    entry[6] = info->width;
+    entry[7] = info->height;
+
+    if (atlas->table_dirty_begin == atlas->table_dirty_end) {
+        atlas->table_dirty_begin = info->slot;
+        atlas->table_dirty_end = info->slot + 1;
+    } else {
+        atlas->table_dirty_begin = std::min<uint32_t>(atlas->table_dirty_begin, info->slot);
+        atlas->table_dirty_end = std::max<uint32_t>(atlas->table_dirty_end, info->slot + 1u);
+    }
+}
+
 // Initialize glyph atlas
 inline void glyph_atlas_init(GlyphAtlas* atlas) {
-    atlas->current_x = GLYPH_PADDING;
-    atlas->current_y = GLYPH_PADDING;
-    atlas->current_row_height = 0;
     atlas->frame_counter = 0;
+    glyph_atlas_reset_slots(atlas);
 
     // Allocate single-channel buffer for grayscale (simpler for debugging)
     atlas->buffer = new unsigned char[ATLAS_WIDTH * ATLAS_HEIGHT];
     memset(atlas->buffer, 0, ATLAS_WIDTH * ATLAS_HEIGHT);
+    glyph_atlas_reserve_placeholder(atlas);
+
+    // Glyph rows are tightly packed; sub-rectangle uploads need byte alignment
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
     // Create OpenGL texture
     glGenTextures(1, &atlas->texture);
@@ -151,14 +325,11 @@ inline void glyph_atlas_init(GlyphAtlas* atlas) {
 inline void glyph_atlas_clear(GlyphAtlas* atlas) {
     // Clear glyph cache
     atlas->glyphs.clear();
+    glyph_atlas_reset_slots(atlas);
 
-    // Reset packing state
-    atlas->current_x = GLYPH_PADDING;
-    atlas->current_y = GLYPH_PADDING;
-    atlas->current_row_height = 0;
-
-    // Clear buffer
+    // Clear buffer and reset packing state
     memset(atlas->buffer, 0, ATLAS_WIDTH * ATLAS_HEIGHT);
+    glyph_atlas_reserve_placeholder(atlas);
 
     // Upload cleared texture
     glBindTexture(GL_TEXTURE_2D, atlas->texture);
@@ -169,7 +340,75 @@ inline void glyph_atlas_clear(GlyphAtlas* atlas) {
     printf("Glyph atlas cleared\n");
 }
 
-// Add glyph to atlas
+// Pack a grayscale bitmap into the atlas and upload only the touched rectangle
+// Returns false if the atlas is full
+inline bool glyph_atlas_pack(GlyphAtlas* atlas, const unsigned char* bitmap, int pitch,
+                             int glyph_width, int glyph_height, int* out_x, int* out_y) {
+    // Check if glyph fits in current row
+    if (atlas->current_x + glyph_width + GLYPH_PADDING > ATLAS_WIDTH) {
+        // Move to next row
+        atlas->current_x = GLYPH_PADDING;
+        atlas->current_y += atlas->current_row_height + GLYPH_PADDING;
+        atlas->current_row_height = 0;
+    }
+
+    if (atlas->current_y + glyph_height + GLYPH_PADDING > ATLAS_HEIGHT) {
+        fprintf(stderr, "Atlas full! Need to implement LRU eviction.\n");
+        return false;
+    }
+
+    // Copy glyph rows into the atlas buffer (grayscale)
+    for (int y = 0; y < glyph_height; y++) {
+        memcpy(atlas->buffer + (atlas->current_y + y) * ATLAS_WIDTH + atlas->current_x,
+               bitmap + y * pitch, glyph_width);
+    }
+
+    // Upload just this glyph's rectangle (the CPU buffer is the row source)
+    if (glyph_width > 0 && glyph_height > 0) {
+        glBindTexture(GL_TEXTURE_2D, atlas->texture);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, ATLAS_WIDTH);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, atlas->current_x, atlas->current_y,
+                        glyph_width, glyph_height, GL_RED, GL_UNSIGNED_BYTE,
+                        atlas->buffer + atlas->current_y * ATLAS_WIDTH + atlas->current_x);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    *out_x = atlas->current_x;
+    *out_y = atlas->current_y;
+
+    // Update atlas state
+    atlas->current_x += glyph_width + GLYPH_PADDING;
+    if (glyph_height > atlas->current_row_height) {
+        atlas->current_row_height = glyph_height;
+    }
+
+    return true;
+}
+
+// Fill in atlas coordinates and metrics for a packed glyph
+inline void glyph_info_set(GlyphInfo* info, GlyphAtlas* atlas, int atlas_x, int atlas_y,
+                           int glyph_width, int glyph_height,
+                           float advance_x, float bearing_x, float bearing_y) {
+    info->u0 = (float)atlas_x / ATLAS_WIDTH;
+    info->v0 = (float)atlas_y / ATLAS_HEIGHT;
+    info->u1 = (float)(atlas_x + glyph_width) / ATLAS_WIDTH;
+    info->v1 = (float)(atlas_y + glyph_height) / ATLAS_HEIGHT;
+
+    info->advance_x = advance_x;
+    info->bearing_x = bearing_x;
+    info->bearing_y = bearing_y;
+    info->width = glyph_width;
+    info->height = glyph_height;
+
+    info->last_used_frame = atlas->frame_counter;
+    info->in_atlas = true;
+    info->pending = false;
+
+    glyph_atlas_write_slot(atlas, info);
+}
+
+// Add glyph to atlas (synchronous, render thread)
 inline bool glyph_atlas_add_glyph(GlyphAtlas* atlas, FT_Face face, uint32_t codepoint) {
     // Load glyph (grayscale for now)
     FT_UInt glyph_index = FT_Get_Char_Index(face, codepoint);
@@ -181,92 +420,206 @@ inline bool glyph_atlas_add_glyph(GlyphAtlas* atlas, FT_Face face, uint32_t code
     FT_GlyphSlot slot = face->glyph;
     FT_Bitmap* bitmap = &slot->bitmap;
 
-    // Check if glyph fits in current row
     int glyph_width = bitmap->width;
     int glyph_height = bitmap->rows;
 
-    if (atlas->current_x + glyph_width + GLYPH_PADDING > ATLAS_WIDTH) {
-        // Move to next row
-        atlas->current_x = GLYPH_PADDING;
-        atlas->current_y += atlas->current_row_height + GLYPH_PADDING;
-        atlas->current_row_height = 0;
-    }
-
-    if (atlas->current_y + glyph_height + GLYPH_PADDING > ATLAS_HEIGHT) {
-        fprintf(stderr, "Atlas full! Need to implement LRU eviction.\n");
+    int atlas_x, atlas_y;
+    if (!glyph_atlas_pack(atlas, bitmap->buffer, bitmap->pitch,
+                          glyph_width, glyph_height, &atlas_x, &atlas_y)) {
         return false;
     }
 
-    // Copy glyph to atlas buffer (grayscale)
-    int non_zero_pixels = 0;
-    for (int y = 0; y < glyph_height; y++) {
-        for (int x = 0; x < glyph_width; x++) {
-            int atlas_x = atlas->current_x + x;
-            int atlas_y = atlas->current_y + y;
-            int atlas_idx = atlas_y * ATLAS_WIDTH + atlas_x;
-            int bitmap_idx = y * bitmap->pitch + x;
-
-            // Copy grayscale value
-            if (bitmap_idx < (int)(bitmap->rows * bitmap->pitch)) {
-                unsigned char pixel = bitmap->buffer[bitmap_idx];
-                atlas->buffer[atlas_idx] = pixel;
-                if (pixel > 0) non_zero_pixels++;
-            }
-        }
-    }
-
     static int glyph_count = 0;
     if (glyph_count < 5) {
-        printf("Glyph '%c': copied %dx%d, %d non-zero pixels, first pixel=%d\n",
-               (char)codepoint, glyph_width, glyph_height, non_zero_pixels,
+        printf("Glyph '%c': copied %dx%d, first pixel=%d\n",
+               (char)codepoint, glyph_width, glyph_height,
                glyph_height > 0 && glyph_width > 0 ? bitmap->buffer[0] : 0);
         glyph_count++;
     }
 
-    // Update entire texture
-    glBindTexture(GL_TEXTURE_2D, atlas->texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, ATLAS_WIDTH, ATLAS_HEIGHT,
-                 0, GL_RED, GL_UNSIGNED_BYTE, atlas->buffer);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     // Store glyph info
     GlyphInfo info;
-    info.u0 = (float)atlas->current_x / ATLAS_WIDTH;
-    info.v0 = (float)atlas->current_y / ATLAS_HEIGHT;
-    info.u1 = (float)(atlas->current_x + glyph_width) / ATLAS_WIDTH;
-    info.v1 = (float)(atlas->current_y + glyph_height) / ATLAS_HEIGHT;
+    if (!glyph_atlas_alloc_slot(atlas, &info.slot)) {
+        return false;
+    }
+    glyph_info_set(&info, atlas, atlas_x, atlas_y, glyph_width, glyph_height,
+                   slot->advance.x / 64.0f, slot->bitmap_left, slot->bitmap_top);
+    atlas->glyphs[codepoint] = info;
 
-    info.advance_x = slot->advance.x / 64.0f;
-    info.bearing_x = slot->bitmap_left;
-    info.bearing_y = slot->bitmap_top;
-    info.width = glyph_width;
-    info.height = glyph_height;
+    return true;
+}
 
-    info.last_used_frame = atlas->frame_counter;
-    info.in_atlas = true;
+// Rasterizer worker: render requested glyphs with the worker's own face
+inline void glyph_rasterizer_thread(GlyphRasterizer* rast) {
+    while (rast->running.load(std::memory_order_acquire)) {
+        GlyphRequest request;
+        if (!spsc_queue_pop(&rast->requests, &request)) {
+            // Nothing to do - park until the render thread queues more work
+            std::unique_lock<std::mutex> lock(rast->wake_mutex);
+            rast->wake_cv.wait_for(lock, std::chrono::milliseconds(50));
+            continue;
+        }
 
-    atlas->glyphs[codepoint] = info;
+        if (request.font_size != rast->font_size) {
+            FT_Set_Pixel_Sizes(rast->face, 0, request.font_size);
+            rast->font_size = request.font_size;
+        }
 
-    // Update atlas state
-    atlas->current_x += glyph_width + GLYPH_PADDING;
-    if (glyph_height > atlas->current_row_height) {
-        atlas->current_row_height = glyph_height;
+        RasterizedGlyph result;
+        memset(&result, 0, sizeof(result));
+        result.codepoint = request.codepoint;
+        result.generation = request.generation;
+
+        FT_UInt glyph_index = FT_Get_Char_Index(rast->face, request.codepoint);
+        if (FT_Load_Glyph(rast->face, glyph_index, FT_LOAD_RENDER) == 0) {
+            FT_GlyphSlot slot = rast->face->glyph;
+            FT_Bitmap* bitmap = &slot->bitmap;
+
+            result.ok = true;
+            result.width = bitmap->width;
+            result.height = bitmap->rows;
+            result.advance_x = slot->advance.x / 64.0f;
+            result.bearing_x = slot->bitmap_left;
+            result.bearing_y = slot->bitmap_top;
+
+            // Compact copy (the slot bitmap is overwritten by the next load)
+            result.bitmap = new unsigned char[result.width * result.height + 1];
+            for (int y = 0; y < result.height; y++) {
+                memcpy(result.bitmap + y * result.width,
+                       bitmap->buffer + y * bitmap->pitch, result.width);
+            }
+        }
+
+        // Results queue is drained every frame; back off if it is momentarily full
+        while (!spsc_queue_push(&rast->results, result)) {
+            if (!rast->running.load(std::memory_order_acquire)) {
+                delete[] result.bitmap;
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+// Start the background rasterizer (falls back to synchronous loading on failure)
+inline bool font_system_start_rasterizer(FontSystem* font_sys, const char* font_path) {
+    GlyphRasterizer* rast = new GlyphRasterizer();
+
+    if (FT_Init_FreeType(&rast->ft_library)) {
+        fprintf(stderr, "Rasterizer: failed to initialize FreeType\n");
+        delete rast;
+        return false;
+    }
+
+    if (FT_New_Face(rast->ft_library, font_path, 0, &rast->face)) {
+        fprintf(stderr, "Rasterizer: failed to load font: %s\n", font_path);
+        FT_Done_FreeType(rast->ft_library);
+        delete rast;
+        return false;
     }
 
+    FT_Set_Pixel_Sizes(rast->face, 0, font_sys->font_size);
+    rast->font_size = font_sys->font_size;
+
+    spsc_queue_init(&rast->requests);
+    spsc_queue_init(&rast->results);
+    rast->running.store(true, std::memory_order_release);
+    rast->thread = std::thread(glyph_rasterizer_thread, rast);
+
+    font_sys->rasterizer = rast;
+    printf("Glyph rasterizer thread started\n");
     return true;
 }
 
+// Stop the background rasterizer and release its FreeType objects
+inline void font_system_stop_rasterizer(FontSystem* font_sys) {
+    GlyphRasterizer* rast = font_sys->rasterizer;
+    if (!rast) return;
+
+    rast->running.store(false, std::memory_order_release);
+    rast->wake_cv.notify_one();
+    rast->thread.join();
+
+    // Free bitmaps that were never drained
+    RasterizedGlyph result;
+    while (spsc_queue_pop(&rast->results, &result)) {
+        delete[] result.bitmap;
+    }
+
+    FT_Done_Face(rast->face);
+    FT_Done_FreeType(rast->ft_library);
+    delete rast;
+    font_sys->rasterizer = nullptr;
+    font_sys->glyphs_in_flight = 0;
+}
+
+// Build an advance-correct placeholder so layout doesn't shift when the real glyph lands
+inline GlyphInfo font_system_make_placeholder(FontSystem* font_sys, uint32_t codepoint, uint16_t slot) {
+    GlyphAtlas* atlas = &font_sys->atlas;
+
+    // FT_Get_Advance reads metrics only; much cheaper than rendering the outline
+    FT_Fixed advance = 0;
+    FT_UInt glyph_index = FT_Get_Char_Index(font_sys->face, codepoint);
+    FT_Get_Advance(font_sys->face, glyph_index, FT_LOAD_DEFAULT, &advance);
+
+    GlyphInfo info;
+    info.slot = slot;
+    info.advance_x = advance / 65536.0f;  // 16.16 fixed point when scaled
+
+    // Faint box sampled from the centre of the reserved placeholder block
+    float box_width = info.advance_x * 0.7f;
+    float box_height = font_sys->ascent * 0.7f;
+    info.bearing_x = info.advance_x * 0.15f;
+    info.bearing_y = box_height;
+    info.width = box_width;
+    info.height = box_height;
+
+    float texel_u = 1.0f / ATLAS_WIDTH;
+    float texel_v = 1.0f / ATLAS_HEIGHT;
+    info.u0 = (GLYPH_PADDING + 1) * texel_u;
+    info.v0 = (GLYPH_PADDING + 1) * texel_v;
+    info.u1 = (GLYPH_PADDING + PLACEHOLDER_SIZE - 1) * texel_u;
+    info.v1 = (GLYPH_PADDING + PLACEHOLDER_SIZE - 1) * texel_v;
+
+    info.last_used_frame = atlas->frame_counter;
+    info.in_atlas = false;
+    info.pending = true;
+
+    glyph_atlas_write_slot(atlas, &info);
+    return info;
+}
+
 // Get glyph info (loads if not in atlas)
+// With the background rasterizer running, a miss returns a placeholder for a frame or two
 inline GlyphInfo* font_system_get_glyph(FontSystem* font_sys, uint32_t codepoint) {
     GlyphAtlas* atlas = &font_sys->atlas;
 
-    // Check if already in atlas
+    // Check if already in atlas (or already queued)
     auto it = atlas->glyphs.find(codepoint);
     if (it != atlas->glyphs.end()) {
         it->second.last_used_frame = atlas->frame_counter;
         return &it->second;
     }
 
+    // Queue for background rasterization
+    GlyphRasterizer* rast = font_sys->rasterizer;
+    if (rast) {
+        GlyphRequest request = {codepoint, font_sys->generation, font_sys->font_size};
+        if (spsc_queue_push(&rast->requests, request)) {
+            rast->wake_cv.notify_one();
+            font_sys->glyphs_in_flight++;
+
+            uint16_t slot;
+            if (!glyph_atlas_alloc_slot(atlas, &slot)) {
+                return nullptr;  // The worker's result will be dropped on drain
+            }
+            GlyphInfo& info = atlas->glyphs[codepoint];
+            info = font_system_make_placeholder(font_sys, codepoint, slot);
+            return &info;
+        }
+        // Queue full - fall through and rasterize synchronously
+    }
+
     // Not in atlas, add it
     if (glyph_atlas_add_glyph(atlas, font_sys->face, codepoint)) {
         return &atlas->glyphs[codepoint];
@@ -275,13 +628,61 @@ inline GlyphInfo* font_system_get_glyph(FontSystem* font_sys, uint32_t codepoint
     return nullptr;
 }
 
-// Begin frame (increment frame counter for LRU)
+// Move finished background rasterizations into the atlas
+inline int font_system_drain_rasterizer(FontSystem* font_sys) {
+    GlyphRasterizer* rast = font_sys->rasterizer;
+    if (!rast) return 0;
+
+    GlyphAtlas* atlas = &font_sys->atlas;
+    int landed = 0;
+
+    RasterizedGlyph result;
+    while (spsc_queue_pop(&rast->results, &result)) {
+        font_sys->glyphs_in_flight--;
+        auto it = atlas->glyphs.find(result.codepoint);
+        bool wanted = result.generation == font_sys->generation &&
+                      it != atlas->glyphs.end() && it->second.pending;
+
+        if (wanted && !result.ok) {
+            // Keep the placeholder box but stop waiting for it
+            it->second.pending = false;
+        } else if (wanted) {
+            int atlas_x, atlas_y;
+            if (glyph_atlas_pack(atlas, result.bitmap, result.width,
+                                 result.width, result.height, &atlas_x, &atlas_y)) {
+                glyph_info_set(&it->second, atlas, atlas_x, atlas_y, result.width, result.height,
+                               result.advance_x, result.bearing_x, result.bearing_y);
+                landed++;
+            } else {
+                it->second.pending = false;
+            }
+        }
+
+        delete[] result.bitmap;
+    }
+
+    return landed;
+}
+
+// Rasterize printable ASCII up front so the first frame has no placeholders
+inline void font_system_prewarm_ascii(FontSystem* font_sys) {
+    for (uint32_t codepoint = 0x20; codepoint < 0x7F; codepoint++) {
+        if (font_sys->atlas.glyphs.find(codepoint) == font_sys->atlas.glyphs.end()) {
+            glyph_atlas_add_glyph(&font_sys->atlas, font_sys->face, codepoint);
+        }
+    }
+}
+
+// Begin frame (increment frame counter for LRU, land background glyphs)
 inline void font_system_begin_frame(FontSystem* font_sys) {
     font_sys->atlas.frame_counter++;
+    font_system_drain_rasterizer(font_sys);
 }
 
 // Shutdown font system
 inline void font_system_shutdown(FontSystem* font_sys) {
+    font_system_stop_rasterizer(font_sys);
+
     if (font_sys->atlas.buffer) {
         delete[] font_sys->atlas.buffer;
         font_sys->atlas.buffer = nullptr;
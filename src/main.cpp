@@ -1,29 +1,128 @@
 // Zed Text Editor
 // High-performance C++ text editor with OpenGL rendering
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
-#include <sys/time.h>
+#include <cstring>
+#include <cmath>
+#include <time.h>
+#include <unistd.h>
 
 #include "platform.h"
 #include "renderer.h"
 #include "editor.h"
 #include "config.h"
 
-// Get time in seconds
+// Get time in seconds (CLOCK_MONOTONIC, the clock GLX vblank timestamps use)
 inline double get_time() {
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    return tv.tv_sec + tv.tv_usec / 1000000.0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// Frame time statistics (CPU time from begin_frame to end_frame, in ms)
+constexpr int FRAME_TIME_SAMPLES = 1024;
+
+// Events gathered (and coalesced) per frame; any excess waits for the next frame
+constexpr int MAX_FRAME_EVENTS = 256;
+
+// Poll interval while background glyph rasterizations are outstanding
+constexpr int GLYPH_POLL_MS = 4;
+
+struct FrameTimeStats {
+    float samples[FRAME_TIME_SAMPLES];
+    int count;   // Valid samples (saturates at FRAME_TIME_SAMPLES)
+    int next;    // Ring write position
+};
+
+inline void frame_stats_add(FrameTimeStats* stats, float ms) {
+    stats->samples[stats->next] = ms;
+    stats->next = (stats->next + 1) % FRAME_TIME_SAMPLES;
+    if (stats->count < FRAME_TIME_SAMPLES) stats->count++;
+}
+
+// Summarize the sample window: average, median, 99th percentile and worst frame
+inline void frame_stats_summary(const FrameTimeStats* stats, float* avg, float* p50, float* p99, float* max) {
+    *avg = *p50 = *p99 = *max = 0.0f;
+    if (stats->count == 0) return;
+
+    float sorted[FRAME_TIME_SAMPLES];
+    memcpy(sorted, stats->samples, stats->count * sizeof(float));
+    std::sort(sorted, sorted + stats->count);
+
+    float sum = 0.0f;
+    for (int i = 0; i < stats->count; i++) sum += sorted[i];
+
+    *avg = sum / stats->count;
+    *p50 = sorted[stats->count / 2];
+    *p99 = sorted[(stats->count * 99) / 100];
+    *max = sorted[stats->count - 1];
+}
+
+inline void frame_stats_print(const FrameTimeStats* stats, const char* label) {
+    float avg, p50, p99, max;
+    frame_stats_summary(stats, &avg, &p50, &p99, &max);
+    printf("%s: %d frames, avg %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+           label, stats->count, avg, p50, p99, max);
+}
+
+// Frame pacing: with VSync on, a frame that finishes early just waits for the
+// vblank. Starting it as late as possible instead means the input it shows
+// is sampled that much closer to scanout.
+struct FramePacer {
+    double period;       // Seconds per refresh
+    double last_vblank;  // A recent vblank (0 = phase unknown)
+    double margin;       // Slack between predicted frame end and vblank (seconds)
+};
+
+// First vblank strictly after t
+inline double frame_pacer_next_vblank(const FramePacer* pacer, double t) {
+    if (pacer->last_vblank <= 0.0) {
+        return t + pacer->period;
+    }
+    double periods = floor((t - pacer->last_vblank) / pacer->period) + 1.0;
+    return pacer->last_vblank + periods * pacer->period;
+}
+
+// Latest time a frame costing render_cost seconds can start and still make a vblank
+inline double frame_pacer_start_time(const FramePacer* pacer, double now, double render_cost,
+                                     double* target_vblank) {
+    double budget = render_cost + pacer->margin;
+    *target_vblank = frame_pacer_next_vblank(pacer, now + budget);
+    return *target_vblank - budget;
+}
+
+// Re-anchor the vblank phase after a swap. GLX_OML_sync_control gives the exact
+// vblank; otherwise a VSync'd swap returns at (or just after) one.
+inline void frame_pacer_observe_swap(FramePacer* pacer, Platform* platform, double swap_done) {
+    double vblank;
+    if (platform_last_vblank(platform, &vblank) && fabs(vblank - swap_done) < 1.0) {
+        pacer->last_vblank = vblank;
+    } else if (platform->vsync_enabled) {
+        pacer->last_vblank = swap_done;
+    } else {
+        pacer->last_vblank = 0.0;
+    }
 }
 
 int main(int argc, char** argv) {
     printf("Zed Text Editor - Starting...\n");
 
-    // TODO: Parse command line arguments
+    // Parse command line arguments
+    // --bench-frames N: render N frames uncapped while scrolling, print frame times, exit
+    // --refresh-rate HZ: override the detected monitor refresh rate
     const char* file_to_open = nullptr;
-    if (argc > 1) {
-        file_to_open = argv[1];
+    int bench_frames = 0;
+    double refresh_rate_arg = 0.0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench-frames") == 0 && i + 1 < argc) {
+            bench_frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--refresh-rate") == 0 && i + 1 < argc) {
+            refresh_rate_arg = atof(argv[++i]);
+        } else if (!file_to_open) {
+            file_to_open = argv[i];
+        }
     }
 
     // Load configuration
@@ -32,6 +131,9 @@ int main(int argc, char** argv) {
         fprintf(stderr, "Warning: Could not load config, using defaults\n");
         config_set_defaults(&config);
     }
+    if (refresh_rate_arg > 0.0) {
+        config.refresh_rate_override = refresh_rate_arg;
+    }
 
     // Initialize platform (X11 window + OpenGL context)
     Platform platform;
@@ -71,10 +173,14 @@ int main(int argc, char** argv) {
     double fps_update_time = last_time;
     int fps_frame_count = 0;
     float current_fps = 0.0f;
+    FrameTimeStats frame_stats = {};
+    FrameTimeStats latency_stats = {};  // Input arrival to estimated scanout, in ms
+    double stats_print_time = last_time;
+    bool continuous = false;  // Previous iteration rendered without waiting
 
     // Adaptive VSync state
     struct AdaptiveVSyncState {
-        double monitor_refresh_rate;    // Hz (detected or assumed 60)
+        double monitor_refresh_rate;    // Hz (config override, XRandR, or assumed 60)
         double target_frame_time;       // Seconds (1/refresh_rate)
         double vsync_threshold_high;    // Enable VSync above this (95% of frame time)
         double vsync_threshold_low;     // Disable VSync below this (110% of frame time)
@@ -85,8 +191,14 @@ int main(int argc, char** argv) {
     } vsync_state;
 
     // Initialize adaptive VSync state from config
-    vsync_state.monitor_refresh_rate = 60.0;  // TODO: Detect via XRandR
-    vsync_state.target_frame_time = 1.0 / vsync_state.monitor_refresh_rate;  // 16.67ms for 60Hz
+    if (config.refresh_rate_override > 0.0) {
+        vsync_state.monitor_refresh_rate = config.refresh_rate_override;
+    } else if (platform.refresh_rate > 0.0) {
+        vsync_state.monitor_refresh_rate = platform.refresh_rate;
+    } else {
+        vsync_state.monitor_refresh_rate = 60.0;
+    }
+    vsync_state.target_frame_time = 1.0 / vsync_state.monitor_refresh_rate;  // 6.94ms for 144Hz
     vsync_state.vsync_threshold_high = vsync_state.target_frame_time * 0.95;  // Enable at 95%
     vsync_state.vsync_threshold_low = vsync_state.target_frame_time * 1.1;    // Disable at 110%
     vsync_state.consecutive_fast_frames = 0;
@@ -106,7 +218,8 @@ int main(int argc, char** argv) {
     } else if (config.force_vsync_on) {
         platform_set_swap_interval(&platform, 1);
         vsync_state.adaptive_enabled = false;
-        printf("Adaptive VSync: FORCE ON - VSync permanently enabled (locked 60 FPS)\n");
+        printf("Adaptive VSync: FORCE ON - VSync permanently enabled (locked %.0f FPS)\n",
+               vsync_state.monitor_refresh_rate);
     } else if (vsync_state.adaptive_enabled) {
         printf("Adaptive VSync: ENABLED - Smart switching with %d-frame hysteresis\n",
                vsync_state.hysteresis_count);
@@ -114,16 +227,70 @@ int main(int argc, char** argv) {
         printf("Adaptive VSync: DISABLED - Using driver default\n");
     }
 
+    // Benchmark mode runs uncapped so frame times reflect render cost
+    if (bench_frames > 0) {
+        platform_set_swap_interval(&platform, 0);
+        vsync_state.adaptive_enabled = false;
+        show_fps = false;
+        printf("Benchmark: rendering %d frames\n", bench_frames);
+    }
+
+    // Frame pacing (only while VSync is on - uncapped frames have no deadline)
+    FramePacer pacer;
+    pacer.period = vsync_state.target_frame_time;
+    pacer.last_vblank = 0.0;
+    pacer.margin = config.frame_pacing_margin_ms / 1000.0;
+    bool pacing_enabled = config.frame_pacing && bench_frames == 0;
+    double render_cost = 0.0;  // Predicted frame cost in seconds (p99 of frame_stats)
+    float last_render_ms = 0.0f;
+    printf("Frame pacing: %s (%.1f ms margin)\n", pacing_enabled ? "ON" : "OFF",
+           config.frame_pacing_margin_ms);
+
     while (running) {
+        // Render on demand: sleep until input arrives or the next timed update
+        // (cursor blink, pending glyphs) is due. Nothing waits while a redraw is owed.
+        double input_time = 0.0;  // First input arrival for this frame
+        bool redraw_owed = editor.dirty || renderer.needs_redraw || bench_frames > 0;
+        if (!redraw_owed) {
+            int timeout_ms = (int)ceilf(editor_time_until_update(&editor) * 1000.0f);
+            if (renderer.font_sys.glyphs_in_flight > 0) {
+                timeout_ms = std::min(timeout_ms, GLYPH_POLL_MS);
+            }
+            if (platform_wait_event(&platform, timeout_ms)) {
+                input_time = get_time();
+            }
+            continuous = false;
+        }
+
+        // Late latching: hold input and rendering until the latest start that still
+        // makes the next reachable vblank. Input arriving meanwhile stays queued in
+        // the X connection and is sampled right before rendering.
+        double target_vblank = 0.0;
+        if (pacing_enabled && platform.vsync_enabled) {
+            double now = get_time();
+            double start = frame_pacer_start_time(&pacer, now, render_cost, &target_vblank);
+            if (start > now && input_time == 0.0 &&
+                platform_wait_event(&platform, (int)((start - now) * 1000.0))) {
+                input_time = get_time();
+            }
+            now = get_time();
+            if (start > now) {
+                usleep((useconds_t)((start - now) * 1000000.0));
+            }
+        }
+
         // Calculate delta time
         double current_time = get_time();
         float delta_time = (float)(current_time - last_time);
         last_time = current_time;
 
         // Adaptive VSync decision logic
-        if (vsync_state.adaptive_enabled && platform.adaptive_vsync_supported) {
+        // (only meaningful while frames are rendered back to back). Decided on the
+        // render cost, not delta_time - the interval includes VSync and pacing waits.
+        double frame_cost = last_render_ms / 1000.0;
+        if (continuous && vsync_state.adaptive_enabled && platform.adaptive_vsync_supported) {
             // Check if rendering faster than monitor refresh
-            if (delta_time < vsync_state.vsync_threshold_high) {
+            if (frame_cost < vsync_state.vsync_threshold_high) {
                 // Fast frame - rendering faster than refresh rate
                 vsync_state.consecutive_fast_frames++;
                 vsync_state.consecutive_slow_frames = 0;
@@ -135,7 +302,7 @@ int main(int argc, char** argv) {
                     printf("Adaptive VSync: ENABLED (smooth %.1f fps)\n", current_fps);
                 }
             }
-            else if (delta_time > vsync_state.vsync_threshold_low) {
+            else if (frame_cost > vsync_state.vsync_threshold_low) {
                 // Slow frame - rendering slower than refresh rate
                 vsync_state.consecutive_slow_frames++;
                 vsync_state.consecutive_fast_frames = 0;
@@ -154,24 +321,41 @@ int main(int argc, char** argv) {
             }
         }
 
-        // Calculate FPS (update every 0.5 seconds)
-        fps_frame_count++;
+        // Calculate FPS over rendered frames (update every 0.5 seconds)
         if (current_time - fps_update_time >= 0.5) {
             current_fps = fps_frame_count / (current_time - fps_update_time);
             fps_frame_count = 0;
             fps_update_time = current_time;
         }
 
-        // Process events
-        PlatformEvent event;
-        while (platform_poll_event(&platform, &event)) {
+        // Process events. Everything queued is gathered first and coalesced (latest
+        // mouse position, merged key repeats), so a drag or a held key costs one
+        // hit test or edit per frame rather than one per event.
+        PlatformEvent events[MAX_FRAME_EVENTS];
+        int event_count = 0;
+        while (event_count < MAX_FRAME_EVENTS && platform_poll_event(&platform, &events[event_count])) {
+            event_count++;
+        }
+        if (event_count > 0 && input_time == 0.0) {
+            input_time = get_time();
+        }
+        event_count = platform_coalesce_events(events, event_count);
+
+        for (int i = 0; i < event_count; i++) {
+            PlatformEvent& event = events[i];
+
             if (event.type == PLATFORM_EVENT_QUIT) {
                 printf("Quit event received\n");
                 running = false;
             } else if (event.type == PLATFORM_EVENT_KEY_PRESS && event.key.key == 0xffc0) {
                 // F3 key - toggle FPS display
                 show_fps = !show_fps;
+                renderer.needs_redraw = true;
+                renderer_damage_full(&renderer);
                 printf("FPS display: %s\n", show_fps ? "ON" : "OFF");
+            } else if (event.type == PLATFORM_EVENT_EXPOSE) {
+                renderer.needs_redraw = true;
+                renderer_damage_full(&renderer);
             } else {
                 editor_handle_event(&editor, &event, &renderer, &platform);
             }
@@ -184,24 +368,82 @@ int main(int argc, char** argv) {
         // Update editor state
         editor_update(&editor, delta_time);
 
+        // Benchmark scrolls one line per frame, wrapping at the end of the document
+        if (bench_frames > 0) {
+            float previous_scroll = editor.scroll_y;
+            editor_scroll(&editor, editor.line_height);
+            if (editor.scroll_y == previous_scroll) editor.scroll_y = 0.0f;
+            editor.dirty |= EDITOR_DIRTY_SCROLL;
+        }
+
+        // Glyphs finished on the rasterizer thread replace their placeholders
+        renderer_poll_glyphs(&renderer);
+
+        if (!editor.dirty && !renderer.needs_redraw) {
+            continue;  // Nothing changed - go back to sleep
+        }
+
+        // Collect damage before begin_frame() turns it into a scissor rect
+        renderer.buffer_age = platform_buffer_age(&platform);
+        editor_report_damage(&editor, &renderer);
+        if (show_fps) {
+            renderer_damage_rect(&renderer, (float)renderer.viewport_width - 220.0f, 0.0f,
+                                 220.0f, 24.0f + editor.line_height);
+        }
+
         // Render
+        double render_start = get_time();
         renderer_begin_frame(&renderer);
         editor_render(&editor, &renderer);
 
         // Render FPS overlay
         if (show_fps) {
-            char fps_text[32];
-            snprintf(fps_text, sizeof(fps_text), "FPS: %.1f", current_fps);
+            char fps_text[64];
+            float avg, p50, p99, max;
+            frame_stats_summary(&frame_stats, &avg, &p50, &p99, &max);
+            snprintf(fps_text, sizeof(fps_text), "FPS: %.1f  p99: %.2f ms", current_fps, p99);
             Color fps_color = {0.5f, 0.8f, 0.5f, 1.0f};  // Light green
             renderer_add_text(&renderer, fps_text,
-                            (float)renderer.viewport_width - 100.0f, 20.0f,
+                            (float)renderer.viewport_width - 220.0f, 20.0f,
                             fps_color);
         }
 
         renderer_end_frame(&renderer);
+        last_render_ms = (float)((get_time() - render_start) * 1000.0);
+        frame_stats_add(&frame_stats, last_render_ms);
         platform_swap_buffers(&platform);
 
+        // Estimate when the frame reaches the screen: the vblank it was paced for
+        // if the swap made it, else the next one (immediately with VSync off)
+        double swap_done = get_time();
+        double photon_time = swap_done;
+        if (platform.vsync_enabled) {
+            photon_time = (target_vblank >= swap_done) ? target_vblank
+                                                       : frame_pacer_next_vblank(&pacer, swap_done);
+        }
+        frame_pacer_observe_swap(&pacer, &platform, swap_done);
+
+        if (input_time > 0.0) {
+            frame_stats_add(&latency_stats, (float)((photon_time - input_time) * 1000.0));
+        }
+
+        // Budget frames for their p99 cost so an occasional slow one doesn't miss
+        float avg_ms, p50_ms, p99_ms, max_ms;
+        frame_stats_summary(&frame_stats, &avg_ms, &p50_ms, &p99_ms, &max_ms);
+        render_cost = p99_ms / 1000.0;
+
         frame_count++;
+        fps_frame_count++;
+        continuous = true;
+
+        if (bench_frames > 0 && frame_count >= bench_frames) {
+            frame_stats_print(&frame_stats, "Benchmark frame time");
+            running = false;
+        } else if (show_fps && current_time - stats_print_time >= 5.0) {
+            frame_stats_print(&frame_stats, "Frame time");
+            frame_stats_print(&latency_stats, "Input-to-photon latency (estimate)");
+            stats_print_time = current_time;
+        }
         // Temporarily disabled for debugging
         // if (frame_count % 60 == 0) {
         //     printf("Frame %d (%.1f FPS)\n", frame_count, current_fps);
@@ -209,6 +451,7 @@ int main(int argc, char** argv) {
     }
 
     // Cleanup
+    frame_stats_print(&latency_stats, "Input-to-photon latency (estimate)");
     printf("Shutting down...\n");
     editor_shutdown(&editor);
     renderer_shutdown(&renderer);
@@ -6,15 +6,23 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
+#include <X11/extensions/Xrandr.h>
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <GL/glx.h>
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <poll.h>
 #include <unistd.h>
 
 #include "config.h"
 
+#ifndef GLX_BACK_BUFFER_AGE_EXT
+#define GLX_BACK_BUFFER_AGE_EXT 0x20F4
+#endif
+
 // Event types
 enum PlatformEventType {
     PLATFORM_EVENT_NONE,
@@ -25,6 +33,7 @@ enum PlatformEventType {
     PLATFORM_EVENT_MOUSE_MOVE,
     PLATFORM_EVENT_MOUSE_WHEEL,
     PLATFORM_EVENT_RESIZE,
+    PLATFORM_EVENT_EXPOSE,  // Window contents must be redrawn
 };
 
 // Key modifiers
@@ -43,6 +52,7 @@ struct PlatformEvent {
             int key;
             int mods;
             char text[8];  // UTF-8 character
+            int repeat;    // Identical presses merged into this one (0 = single press)
         } key;
 
         struct {
@@ -94,6 +104,13 @@ struct Platform {
     bool adaptive_vsync_supported;
     int current_swap_interval;
 
+    // GLX_EXT_buffer_age (back buffer keeps earlier frame contents)
+    bool buffer_age_supported;
+
+    // Display timing
+    double refresh_rate;  // Hz of the monitor showing the window (0 = unknown)
+    PFNGLXGETSYNCVALUESOMLPROC glXGetSyncValuesOML;  // GLX_OML_sync_control (vblank timestamps)
+
     int width;
     int height;
     float dpi_scale;
@@ -107,6 +124,8 @@ static char g_test_clipboard[4096] = "";
 
 // Forward declarations
 inline void platform_init_swap_control(Platform* platform);
+inline void platform_init_buffer_age(Platform* platform);
+inline void platform_init_display_timing(Platform* platform);
 inline void platform_set_swap_interval(Platform* platform, int interval);
 
 // Initialize platform (create window and OpenGL context)
@@ -227,6 +246,8 @@ inline bool platform_init(Platform* platform, Config* config) {
 
     // Initialize swap control for adaptive VSync
     platform_init_swap_control(platform);
+    platform_init_buffer_age(platform);
+    platform_init_display_timing(platform);
 
     XFree(visual);
     return true;
@@ -296,15 +317,110 @@ inline void platform_init_swap_control(Platform* platform) {
     printf("VSync: No swap control extensions found, using driver default (60 FPS cap)\n");
 }
 
-// Poll for events
-inline bool platform_poll_event(Platform* platform, PlatformEvent* event) {
-    if (!XPending(platform->display)) {
-        return false;
+// Detect GLX_EXT_buffer_age for partial redraws
+inline void platform_init_buffer_age(Platform* platform) {
+    const char* extensions = glXQueryExtensionsString(platform->display,
+                                                       DefaultScreen(platform->display));
+    platform->buffer_age_supported = extensions && strstr(extensions, "GLX_EXT_buffer_age");
+    printf("Partial redraw: %s\n", platform->buffer_age_supported
+           ? "GLX_EXT_buffer_age available" : "buffer age unknown, redrawing full frames");
+}
+
+// Age of the back buffer: 1 = holds the previous frame, N = the frame N swaps ago,
+// 0 = contents undefined (always the case without GLX_EXT_buffer_age)
+inline int platform_buffer_age(Platform* platform) {
+    if (!platform->buffer_age_supported) return 0;
+
+    unsigned int age = 0;
+    glXQueryDrawable(platform->display, platform->window, GLX_BACK_BUFFER_AGE_EXT, &age);
+    return (int)age;
+}
+
+// Refresh rate of the monitor showing the window via XRandR (0 = unknown)
+// The rate comes from the CRTC's mode timings, so fractional rates like
+// 59.94 or 143.98 Hz are exact. Falls back to the fastest active monitor
+// when the window centre isn't on any CRTC (e.g. not mapped yet).
+inline double platform_detect_refresh_rate(Platform* platform) {
+    int event_base, error_base;
+    if (!XRRQueryExtension(platform->display, &event_base, &error_base)) {
+        return 0.0;
+    }
+
+    XRRScreenResources* resources = XRRGetScreenResourcesCurrent(platform->display, platform->window);
+    if (!resources) {
+        return 0.0;
     }
 
-    XEvent xevent;
-    XNextEvent(platform->display, &xevent);
+    // Window centre in root coordinates
+    int center_x = 0, center_y = 0;
+    Window child;
+    XTranslateCoordinates(platform->display, platform->window, DefaultRootWindow(platform->display),
+                          platform->width / 2, platform->height / 2, &center_x, &center_y, &child);
+
+    double window_rate = 0.0;
+    double fastest_rate = 0.0;
+    for (int i = 0; i < resources->ncrtc; i++) {
+        XRRCrtcInfo* crtc = XRRGetCrtcInfo(platform->display, resources, resources->crtcs[i]);
+        if (!crtc) continue;
+
+        for (int m = 0; crtc->mode != None && m < resources->nmode; m++) {
+            const XRRModeInfo& mode = resources->modes[m];
+            if (mode.id != crtc->mode || mode.hTotal == 0 || mode.vTotal == 0) continue;
+
+            double v_total = mode.vTotal;
+            if (mode.modeFlags & RR_DoubleScan) v_total *= 2.0;
+            if (mode.modeFlags & RR_Interlace) v_total /= 2.0;
+            double rate = (double)mode.dotClock / ((double)mode.hTotal * v_total);
+
+            fastest_rate = std::max(fastest_rate, rate);
+            if (center_x >= crtc->x && center_x < crtc->x + (int)crtc->width &&
+                center_y >= crtc->y && center_y < crtc->y + (int)crtc->height) {
+                window_rate = rate;
+            }
+        }
+        XRRFreeCrtcInfo(crtc);
+    }
+    XRRFreeScreenResources(resources);
+
+    return window_rate > 0.0 ? window_rate : fastest_rate;
+}
+
+// Detect the refresh rate and vblank timestamp support for frame pacing
+inline void platform_init_display_timing(Platform* platform) {
+    platform->refresh_rate = platform_detect_refresh_rate(platform);
+    if (platform->refresh_rate > 0.0) {
+        printf("Display: %.2f Hz (XRandR)\n", platform->refresh_rate);
+    } else {
+        printf("Display: refresh rate unknown (XRandR unavailable)\n");
+    }
+
+    platform->glXGetSyncValuesOML = nullptr;
+    const char* extensions = glXQueryExtensionsString(platform->display,
+                                                       DefaultScreen(platform->display));
+    if (extensions && strstr(extensions, "GLX_OML_sync_control")) {
+        platform->glXGetSyncValuesOML = (PFNGLXGETSYNCVALUESOMLPROC)
+            glXGetProcAddress((const GLubyte*)"glXGetSyncValuesOML");
+    }
+    printf("Display: vblank timestamps %s\n", platform->glXGetSyncValuesOML
+           ? "from GLX_OML_sync_control" : "estimated from buffer swaps");
+}
+
+// Time of the most recent vblank in seconds (GLX_OML_sync_control UST)
+// Returns false if unsupported. The UST clock is CLOCK_MONOTONIC on Mesa
+// and NVIDIA, but callers should sanity-check it against their own clock.
+inline bool platform_last_vblank(Platform* platform, double* time) {
+    if (!platform->glXGetSyncValuesOML) return false;
+
+    int64_t ust = 0, msc = 0, sbc = 0;
+    if (!platform->glXGetSyncValuesOML(platform->display, platform->window, &ust, &msc, &sbc) || ust <= 0) {
+        return false;
+    }
+    *time = (double)ust / 1000000.0;
+    return true;
+}
 
+// Translate an X event; returns false for events the editor doesn't care about
+inline bool platform_translate_event(Platform* platform, XEvent& xevent, PlatformEvent* event) {
     event->type = PLATFORM_EVENT_NONE;
 
     switch (xevent.type) {
@@ -322,6 +438,7 @@ inline bool platform_poll_event(Platform* platform, PlatformEvent* event) {
             if (xevent.xkey.state & ShiftMask) event->key.mods |= PLATFORM_MOD_SHIFT;
             if (xevent.xkey.state & ControlMask) event->key.mods |= PLATFORM_MOD_CTRL;
             if (xevent.xkey.state & Mod1Mask) event->key.mods |= PLATFORM_MOD_ALT;
+            event->key.repeat = 0;
 
             // Get character
             char buffer[8] = {0};
@@ -352,6 +469,13 @@ inline bool platform_poll_event(Platform* platform, PlatformEvent* event) {
             }
             break;
 
+        case Expose:
+            // Only the last Expose of a series matters; we always redraw everything
+            if (xevent.xexpose.count == 0) {
+                event->type = PLATFORM_EVENT_EXPOSE;
+            }
+            break;
+
         case MotionNotify:
             event->type = PLATFORM_EVENT_MOUSE_MOVE;
             event->mouse_move.x = xevent.xmotion.x;
@@ -425,6 +549,76 @@ inline bool platform_poll_event(Platform* platform, PlatformEvent* event) {
     return event->type != PLATFORM_EVENT_NONE;
 }
 
+// Get the next pending event without blocking
+// X events with no platform equivalent are consumed and skipped
+inline bool platform_poll_event(Platform* platform, PlatformEvent* event) {
+    while (XPending(platform->display)) {
+        XEvent xevent;
+        XNextEvent(platform->display, &xevent);
+        if (platform_translate_event(platform, xevent, event)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Same key press (key, modifiers and text), so the two can be merged
+inline bool platform_same_key_press(const PlatformEvent& a, const PlatformEvent& b) {
+    return a.type == PLATFORM_EVENT_KEY_PRESS && b.type == PLATFORM_EVENT_KEY_PRESS &&
+           a.key.key == b.key.key && a.key.mods == b.key.mods &&
+           strcmp(a.key.text, b.key.text) == 0;
+}
+
+// Coalesce a frame's worth of queued events in place; returns the new count
+// - Consecutive mouse moves collapse to the latest position
+// - Runs of identical key presses (auto-repeat) merge into one press with
+//   key.repeat counting the extras. Releases of the key inside a run (X11
+//   sends release/press pairs for non-detectable auto-repeat) are dropped.
+// Order is otherwise preserved, so a button release still ends a drag.
+inline int platform_coalesce_events(PlatformEvent* events, int count) {
+    int out = 0;
+    for (int i = 0; i < count; i++) {
+        const PlatformEvent& event = events[i];
+        if (out > 0) {
+            PlatformEvent& last = events[out - 1];
+
+            if (event.type == PLATFORM_EVENT_MOUSE_MOVE && last.type == PLATFORM_EVENT_MOUSE_MOVE) {
+                last.mouse_move = event.mouse_move;
+                continue;
+            }
+
+            if (event.type == PLATFORM_EVENT_KEY_RELEASE && last.type == PLATFORM_EVENT_KEY_PRESS &&
+                event.key.key == last.key.key && i + 1 < count &&
+                platform_same_key_press(events[i + 1], last)) {
+                continue;
+            }
+
+            if (platform_same_key_press(event, last)) {
+                last.key.repeat += 1 + event.key.repeat;
+                continue;
+            }
+        }
+        events[out++] = event;
+    }
+    return out;
+}
+
+// Block until X events are pending or timeout_ms elapses (-1 = no timeout)
+// Returns true if events are ready to be polled
+inline bool platform_wait_event(Platform* platform, int timeout_ms) {
+    if (XPending(platform->display)) {
+        return true;
+    }
+
+    struct pollfd fds;
+    fds.fd = ConnectionNumber(platform->display);
+    fds.events = POLLIN;
+    fds.revents = 0;
+
+    int ready = poll(&fds, 1, timeout_ms);
+    return ready > 0 && XPending(platform->display) > 0;
+}
+
 // Set cursor shape
 inline void platform_set_cursor(Platform* platform, bool ibeam) {
     Cursor cursor = ibeam ? platform->ibeam_cursor : platform->arrow_cursor;
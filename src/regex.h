@@ -0,0 +1,1046 @@
+// Regular expression search - compiled to lazily built DFAs over rope leaves
+// A pattern is parsed to a small syntax tree and compiled to two Thompson NFA
+// programs: forward (unanchored, leftmost-first) finds where the next match
+// ends, reverse (anchored, longest) walks back from that end to its start.
+// Both run as DFAs whose states are built on first use and cached, so each
+// text byte costs one table lookup and nothing can backtrack. When every match
+// starts with a literal, the forward scan skips to it with memchr on the
+// literal's rarest byte, like the literal engine.
+//
+// Syntax: literals, . (any byte except newline), [classes] with ranges and
+// negation, \d \w \s \D \W \S, \t \n \r \f \v \xHH, escaped punctuation,
+// groups (...) (?:...), alternation |, quantifiers * + ? {n} {n,} {n,m} and
+// their lazy forms (*? etc.), and ^ $ as line anchors. Matching is by byte,
+// so . and classes see UTF-8 sequences byte by byte. Backreferences and
+// lookaround are not regular and are rejected.
+// Case-insensitive mode folds like the literal engine: a literal letter with
+// other case forms (search_fold_codepoint) matches any of them, so a query
+// finds the same text with the regex toggle on or off. Classes and escapes
+// fold ASCII letters only.
+
+#ifndef ZED_REGEX_H
+#define ZED_REGEX_H
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rope.h"
+#include "search.h"
+
+// Compiled programs larger than this are rejected (bounded repeats expand)
+constexpr size_t REGEX_MAX_INSTS = 20000;
+
+// Largest count allowed in {n,m}
+constexpr int REGEX_MAX_REPEAT = 1000;
+
+// The DFA cache is flushed and rebuilt when it grows past this many states
+constexpr size_t REGEX_MAX_DFA_STATES = 2048;
+
+constexpr size_t REGEX_NO_MATCH = (size_t)-1;
+
+// Syntax tree
+enum RegexNodeType {
+    REGEX_NODE_EMPTY,
+    REGEX_NODE_BYTES,       // One byte from a set
+    REGEX_NODE_LINE_START,  // ^
+    REGEX_NODE_LINE_END,    // $
+    REGEX_NODE_CONCAT,
+    REGEX_NODE_ALTERNATE,
+    REGEX_NODE_REPEAT
+};
+
+struct RegexNode {
+    RegexNodeType type;
+    std::bitset<256> bytes;     // REGEX_NODE_BYTES
+    std::vector<int> children;  // Indices into RegexParser::nodes
+    int min, max;               // REGEX_NODE_REPEAT; max -1 = unbounded
+    bool greedy;
+};
+
+struct RegexParser {
+    const char* pattern;
+    size_t length;
+    size_t pos;
+    bool case_sensitive;
+    std::vector<RegexNode> nodes;
+    char* error;                // Message buffer (REGEX_ERROR_SIZE), set on failure
+};
+
+constexpr size_t REGEX_ERROR_SIZE = 128;
+
+// NFA program
+enum RegexOp {
+    REGEX_OP_BYTES,       // Consume one byte from the set, continue at out
+    REGEX_OP_SPLIT,       // Continue at out (preferred) and out1
+    REGEX_OP_LINE_START,  // Continue at out if the previous byte was a newline (or none)
+    REGEX_OP_LINE_END,    // Continue at out if the next byte is a newline (or none)
+    REGEX_OP_MATCH
+};
+
+struct RegexInst {
+    RegexOp op;
+    int out;
+    int out1;
+    std::bitset<256> bytes;
+};
+
+struct RegexProgram {
+    std::vector<RegexInst> insts;
+    int start;
+};
+
+// Lazily built DFA over a program
+// A state is the ordered list of NFA instructions waiting to run at a text
+// position (before following empty transitions, since ^ and $ depend on the
+// bytes around it) plus whether the previous byte was a newline. Transitions
+// also report whether a match ends just before the byte consumed.
+struct RegexDfaState {
+    std::vector<int> threads;   // Instructions in priority order
+    bool line_start;            // Previous byte was a newline (or this is where scanning began at one)
+    bool dead;                  // No threads: nothing can match from here
+    int next[256];              // (state << 1) | matched, or -1 if not built yet
+    int end[2];                 // Match at the end of input, by whether that is a line end; -1 = unknown
+};
+
+struct RegexDfa {
+    const RegexProgram* program;
+    bool longest;               // Keep going after a match for a longer one (else leftmost-first)
+    std::vector<RegexDfaState> states;
+    std::unordered_map<std::string, int> index;
+    int start[2];               // Start state by line_start, -1 until built
+
+    // Scratch space for building transitions
+    std::vector<int> stack;
+    std::vector<int> consumers;
+    std::vector<int> threads;
+    std::vector<uint32_t> marks;
+    uint32_t generation;
+};
+
+struct Regex {
+    RegexProgram forward;       // Unanchored: finds match ends, leftmost-first
+    RegexProgram reverse;       // Anchored on the reversed pattern: finds match starts
+    RegexDfa forward_dfa;
+    RegexDfa reverse_dfa;
+
+    bool has_prefix;            // Every match starts with this literal
+    SearchPattern prefix;
+
+    char error[REGEX_ERROR_SIZE];
+};
+
+// Parsing
+
+inline int regex_node(RegexParser* parser, RegexNodeType type) {
+    RegexNode node;
+    node.type = type;
+    node.min = node.max = 0;
+    node.greedy = true;
+    parser->nodes.push_back(node);
+    return (int)parser->nodes.size() - 1;
+}
+
+inline bool regex_fail(RegexParser* parser, const char* message) {
+    snprintf(parser->error, REGEX_ERROR_SIZE, "%s at offset %zu", message, parser->pos);
+    return false;
+}
+
+// ASCII letters match both cases in case-insensitive mode
+inline void regex_fold_bytes(std::bitset<256>* bytes) {
+    for (int c = 'a'; c <= 'z'; c++) {
+        if ((*bytes)[c] || (*bytes)[c - ('a' - 'A')]) {
+            bytes->set(c);
+            bytes->set(c - ('a' - 'A'));
+        }
+    }
+}
+
+inline int regex_bytes_node(RegexParser* parser, std::bitset<256> bytes, bool negate) {
+    if (!parser->case_sensitive) {
+        regex_fold_bytes(&bytes);
+    }
+    if (negate) {
+        bytes.flip();
+    }
+    int node = regex_node(parser, REGEX_NODE_BYTES);
+    parser->nodes[node].bytes = bytes;
+    return node;
+}
+
+// A literal non-ASCII character in case-insensitive mode: any of its case
+// forms, each as the concatenation of its bytes. Folds keep the UTF-8 length,
+// so every form is `length` bytes. -1 if it has no other forms.
+inline int regex_folded_char_node(RegexParser* parser, uint32_t codepoint, size_t length) {
+    if (!search_codepoint_has_case(codepoint)) return -1;
+
+    uint32_t folded = search_fold_codepoint(codepoint);
+    std::vector<uint32_t> forms = {folded};
+    for (size_t i = 0; i < CASEFOLD_PAIR_COUNT; i++) {
+        if (CASEFOLD_PAIRS[i].to == folded) forms.push_back(CASEFOLD_PAIRS[i].from);
+    }
+
+    int node = regex_node(parser, REGEX_NODE_ALTERNATE);
+    for (uint32_t form : forms) {
+        unsigned char bytes[4];
+        search_utf8_encode(form, length, bytes);
+        int concat = regex_node(parser, REGEX_NODE_CONCAT);
+        for (size_t i = 0; i < length; i++) {
+            int byte = regex_node(parser, REGEX_NODE_BYTES);
+            parser->nodes[byte].bytes.set(bytes[i]);
+            parser->nodes[concat].children.push_back(byte);
+        }
+        parser->nodes[node].children.push_back(concat);
+    }
+    return node;
+}
+
+inline int regex_hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parse the escape after a backslash into a byte set (*negate for \D \W \S)
+inline bool regex_parse_escape(RegexParser* parser, std::bitset<256>* bytes, bool* negate) {
+    *negate = false;
+    if (parser->pos >= parser->length) {
+        return regex_fail(parser, "Trailing backslash");
+    }
+    char c = parser->pattern[parser->pos++];
+    switch (c) {
+        case 'D': *negate = true; [[fallthrough]];
+        case 'd':
+            for (int b = '0'; b <= '9'; b++) bytes->set(b);
+            return true;
+        case 'W': *negate = true; [[fallthrough]];
+        case 'w':
+            for (int b = 0; b < 256; b++) {
+                if ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9') || b == '_') {
+                    bytes->set(b);
+                }
+            }
+            return true;
+        case 'S': *negate = true; [[fallthrough]];
+        case 's':
+            for (char b : {' ', '\t', '\n', '\r', '\f', '\v'}) bytes->set((unsigned char)b);
+            return true;
+        case 't': bytes->set('\t'); return true;
+        case 'n': bytes->set('\n'); return true;
+        case 'r': bytes->set('\r'); return true;
+        case 'f': bytes->set('\f'); return true;
+        case 'v': bytes->set('\v'); return true;
+        case 'x': {
+            int high = parser->pos < parser->length ? regex_hex_digit(parser->pattern[parser->pos]) : -1;
+            int low = parser->pos + 1 < parser->length ? regex_hex_digit(parser->pattern[parser->pos + 1]) : -1;
+            if (high < 0 || low < 0) {
+                return regex_fail(parser, "Expected two hex digits after \\x");
+            }
+            parser->pos += 2;
+            bytes->set(high * 16 + low);
+            return true;
+        }
+        default:
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+                // \b, \1, \A, ... are either not regular or not supported
+                parser->pos--;
+                return regex_fail(parser, "Unsupported escape");
+            }
+            bytes->set((unsigned char)c);
+            return true;
+    }
+}
+
+// Parse a [class] (the opening bracket already consumed)
+inline int regex_parse_class(RegexParser* parser) {
+    std::bitset<256> bytes;
+    bool negate = false;
+    if (parser->pos < parser->length && parser->pattern[parser->pos] == '^') {
+        negate = true;
+        parser->pos++;
+    }
+
+    bool first = true;
+    while (true) {
+        if (parser->pos >= parser->length) {
+            regex_fail(parser, "Missing ]");
+            return -1;
+        }
+        char c = parser->pattern[parser->pos];
+        if (c == ']' && !first) {
+            parser->pos++;
+            break;
+        }
+        first = false;
+
+        // One member: a byte, or a whole set from an escape like \d
+        int low;
+        parser->pos++;
+        if (c == '\\') {
+            std::bitset<256> escaped;
+            bool escaped_negate;
+            if (!regex_parse_escape(parser, &escaped, &escaped_negate)) return -1;
+            if (escaped_negate) escaped.flip();
+            if (escaped.count() != 1) {
+                bytes |= escaped;
+                continue;
+            }
+            low = (int)escaped._Find_first();
+        } else {
+            low = (unsigned char)c;
+        }
+
+        // Range a-z (a '-' before the closing bracket is literal)
+        if (parser->pos + 1 < parser->length && parser->pattern[parser->pos] == '-' &&
+            parser->pattern[parser->pos + 1] != ']') {
+            parser->pos++;
+            int high;
+            char h = parser->pattern[parser->pos++];
+            if (h == '\\') {
+                std::bitset<256> escaped;
+                bool escaped_negate;
+                if (!regex_parse_escape(parser, &escaped, &escaped_negate)) return -1;
+                if (escaped_negate || escaped.count() != 1) {
+                    regex_fail(parser, "Invalid range");
+                    return -1;
+                }
+                high = (int)escaped._Find_first();
+            } else {
+                high = (unsigned char)h;
+            }
+            if (high < low) {
+                regex_fail(parser, "Invalid range");
+                return -1;
+            }
+            for (int b = low; b <= high; b++) bytes.set(b);
+        } else {
+            bytes.set(low);
+        }
+    }
+    return regex_bytes_node(parser, bytes, negate);
+}
+
+inline int regex_parse_alternation(RegexParser* parser, int depth);
+
+// Parse a decimal count for {n,m}; -1 if there is none
+inline int regex_parse_count(RegexParser* parser) {
+    int value = -1;
+    while (parser->pos < parser->length && parser->pattern[parser->pos] >= '0' &&
+           parser->pattern[parser->pos] <= '9') {
+        value = (value < 0 ? 0 : value) * 10 + (parser->pattern[parser->pos] - '0');
+        if (value > REGEX_MAX_REPEAT) value = REGEX_MAX_REPEAT + 1;
+        parser->pos++;
+    }
+    return value;
+}
+
+// Try to parse {n}, {n,} or {n,m} at pos; anything else is a literal '{'
+inline bool regex_parse_braces(RegexParser* parser, int* min, int* max) {
+    size_t saved = parser->pos;
+    parser->pos++;  // '{'
+    *min = regex_parse_count(parser);
+    *max = *min;
+    if (*min >= 0 && parser->pos < parser->length && parser->pattern[parser->pos] == ',') {
+        parser->pos++;
+        *max = regex_parse_count(parser);  // -1 = unbounded
+    }
+    if (*min < 0 || parser->pos >= parser->length || parser->pattern[parser->pos] != '}') {
+        parser->pos = saved;
+        return false;
+    }
+    parser->pos++;
+    return true;
+}
+
+inline int regex_parse_atom(RegexParser* parser, int depth) {
+    char c = parser->pattern[parser->pos++];
+    switch (c) {
+        case '(': {
+            if (parser->pos < parser->length && parser->pattern[parser->pos] == '?') {
+                if (parser->pos + 1 < parser->length && parser->pattern[parser->pos + 1] == ':') {
+                    parser->pos += 2;
+                } else {
+                    regex_fail(parser, "Unsupported group");
+                    return -1;
+                }
+            }
+            int inner = regex_parse_alternation(parser, depth + 1);
+            if (inner < 0) return -1;
+            if (parser->pos >= parser->length || parser->pattern[parser->pos] != ')') {
+                regex_fail(parser, "Missing )");
+                return -1;
+            }
+            parser->pos++;
+            return inner;
+        }
+        case '[':
+            return regex_parse_class(parser);
+        case '.': {
+            std::bitset<256> newline;
+            newline.set('\n');
+            return regex_bytes_node(parser, newline, true);
+        }
+        case '^':
+            return regex_node(parser, REGEX_NODE_LINE_START);
+        case '$':
+            return regex_node(parser, REGEX_NODE_LINE_END);
+        case '\\': {
+            std::bitset<256> bytes;
+            bool negate;
+            if (!regex_parse_escape(parser, &bytes, &negate)) return -1;
+            return regex_bytes_node(parser, bytes, negate);
+        }
+        case '*':
+        case '+':
+        case '?':
+            parser->pos--;
+            regex_fail(parser, "Nothing to repeat");
+            return -1;
+        default: {
+            if (!parser->case_sensitive && (unsigned char)c >= 0xC0) {
+                uint32_t codepoint;
+                size_t start = parser->pos - 1;
+                size_t length = search_utf8_decode((const unsigned char*)parser->pattern + start,
+                                                   parser->length - start, &codepoint);
+                int node = length > 0 ? regex_folded_char_node(parser, codepoint, length) : -1;
+                if (node >= 0) {
+                    parser->pos = start + length;
+                    return node;
+                }
+            }
+            std::bitset<256> bytes;
+            bytes.set((unsigned char)c);
+            return regex_bytes_node(parser, bytes, false);
+        }
+    }
+}
+
+// atom followed by an optional quantifier
+inline int regex_parse_repeat(RegexParser* parser, int depth) {
+    int atom = regex_parse_atom(parser, depth);
+    if (atom < 0 || parser->pos >= parser->length) return atom;
+
+    int min, max;
+    char c = parser->pattern[parser->pos];
+    if (c == '*') {
+        min = 0; max = -1;
+        parser->pos++;
+    } else if (c == '+') {
+        min = 1; max = -1;
+        parser->pos++;
+    } else if (c == '?') {
+        min = 0; max = 1;
+        parser->pos++;
+    } else if (c == '{' && regex_parse_braces(parser, &min, &max)) {
+        if (min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT) {
+            regex_fail(parser, "Repeat count too large");
+            return -1;
+        }
+        if (max >= 0 && max < min) {
+            regex_fail(parser, "Invalid repeat range");
+            return -1;
+        }
+    } else {
+        return atom;
+    }
+
+    bool greedy = true;
+    if (parser->pos < parser->length && parser->pattern[parser->pos] == '?') {
+        greedy = false;
+        parser->pos++;
+    }
+    if (parser->pos < parser->length &&
+        (parser->pattern[parser->pos] == '*' || parser->pattern[parser->pos] == '+' ||
+         parser->pattern[parser->pos] == '?')) {
+        regex_fail(parser, "Nested quantifier");
+        return -1;
+    }
+
+    int node = regex_node(parser, REGEX_NODE_REPEAT);
+    parser->nodes[node].children.push_back(atom);
+    parser->nodes[node].min = min;
+    parser->nodes[node].max = max;
+    parser->nodes[node].greedy = greedy;
+    return node;
+}
+
+inline int regex_parse_concat(RegexParser* parser, int depth) {
+    int node = regex_node(parser, REGEX_NODE_CONCAT);
+    while (parser->pos < parser->length && parser->pattern[parser->pos] != '|' &&
+           parser->pattern[parser->pos] != ')') {
+        int child = regex_parse_repeat(parser, depth);
+        if (child < 0) return -1;
+        parser->nodes[node].children.push_back(child);
+    }
+    return node;
+}
+
+inline int regex_parse_alternation(RegexParser* parser, int depth) {
+    if (depth > 100) {
+        regex_fail(parser, "Groups nested too deeply");
+        return -1;
+    }
+
+    int first = regex_parse_concat(parser, depth);
+    if (first < 0 || parser->pos >= parser->length || parser->pattern[parser->pos] != '|') {
+        return first;
+    }
+
+    int node = regex_node(parser, REGEX_NODE_ALTERNATE);
+    parser->nodes[node].children.push_back(first);
+    while (parser->pos < parser->length && parser->pattern[parser->pos] == '|') {
+        parser->pos++;
+        int next = regex_parse_concat(parser, depth);
+        if (next < 0) return -1;
+        parser->nodes[node].children.push_back(next);
+    }
+    return node;
+}
+
+// Compilation
+
+inline int regex_emit(RegexProgram* program, RegexOp op, int out, int out1) {
+    if (program->insts.size() >= REGEX_MAX_INSTS) return -1;
+    RegexInst inst;
+    inst.op = op;
+    inst.out = out;
+    inst.out1 = out1;
+    program->insts.push_back(inst);
+    return (int)program->insts.size() - 1;
+}
+
+// Compile a node so it continues at `next`; returns its entry, or -1 if the
+// program grew too large. The reversed pattern (for finding match starts)
+// runs concatenations backwards and swaps the line anchors, since scanning
+// backwards the byte after a position is the one consumed before it.
+inline int regex_compile_node(const RegexParser* parser, int index, int next, bool reversed,
+                              RegexProgram* program) {
+    const RegexNode& node = parser->nodes[index];
+    switch (node.type) {
+        case REGEX_NODE_EMPTY:
+            return next;
+        case REGEX_NODE_BYTES: {
+            int pc = regex_emit(program, REGEX_OP_BYTES, next, -1);
+            if (pc >= 0) program->insts[pc].bytes = node.bytes;
+            return pc;
+        }
+        case REGEX_NODE_LINE_START:
+            return regex_emit(program, reversed ? REGEX_OP_LINE_END : REGEX_OP_LINE_START, next, -1);
+        case REGEX_NODE_LINE_END:
+            return regex_emit(program, reversed ? REGEX_OP_LINE_START : REGEX_OP_LINE_END, next, -1);
+        case REGEX_NODE_CONCAT: {
+            // Built back to front: each child continues at the one after it
+            size_t count = node.children.size();
+            for (size_t i = 0; i < count && next >= 0; i++) {
+                int child = node.children[reversed ? i : count - 1 - i];
+                next = regex_compile_node(parser, child, next, reversed, program);
+            }
+            return next;
+        }
+        case REGEX_NODE_ALTERNATE: {
+            int entry = regex_compile_node(parser, node.children.back(), next, reversed, program);
+            for (size_t i = node.children.size() - 1; i-- > 0 && entry >= 0; ) {
+                int branch = regex_compile_node(parser, node.children[i], next, reversed, program);
+                if (branch < 0) return -1;
+                entry = regex_emit(program, REGEX_OP_SPLIT, branch, entry);
+            }
+            return entry;
+        }
+        case REGEX_NODE_REPEAT: {
+            int child = node.children[0];
+            int entry = next;
+            if (node.max < 0) {
+                // Loop: split between another iteration and leaving
+                int loop = regex_emit(program, REGEX_OP_SPLIT, -1, -1);
+                if (loop < 0) return -1;
+                int body = regex_compile_node(parser, child, loop, reversed, program);
+                if (body < 0) return -1;
+                program->insts[loop].out = node.greedy ? body : next;
+                program->insts[loop].out1 = node.greedy ? next : body;
+                entry = loop;
+            } else {
+                // Optional iterations nest: x{0,2} is (x(x)?)?
+                for (int i = 0; i < node.max - node.min && entry >= 0; i++) {
+                    int body = regex_compile_node(parser, child, entry, reversed, program);
+                    if (body < 0) return -1;
+                    entry = node.greedy ? regex_emit(program, REGEX_OP_SPLIT, body, next)
+                                        : regex_emit(program, REGEX_OP_SPLIT, next, body);
+                }
+            }
+            for (int i = 0; i < node.min && entry >= 0; i++) {
+                entry = regex_compile_node(parser, child, entry, reversed, program);
+            }
+            return entry;
+        }
+    }
+    return -1;
+}
+
+// Literal every match starts with, appended to *prefix; returns true if the
+// node is entirely literal (so what follows it extends the prefix)
+inline bool regex_literal_prefix(const RegexParser* parser, int index, std::string* prefix) {
+    const RegexNode& node = parser->nodes[index];
+    switch (node.type) {
+        case REGEX_NODE_EMPTY:
+        case REGEX_NODE_LINE_START:
+        case REGEX_NODE_LINE_END:
+            return true;  // Zero width
+        case REGEX_NODE_BYTES: {
+            size_t count = node.bytes.count();
+            int byte = (int)node.bytes._Find_first();
+            bool letter_pair = count == 2 && byte >= 'A' && byte <= 'Z' && node.bytes[byte + ('a' - 'A')];
+            if (count == 1 || (letter_pair && !parser->case_sensitive)) {
+                prefix->push_back((char)byte);
+                return true;
+            }
+            return false;
+        }
+        case REGEX_NODE_CONCAT:
+            for (int child : node.children) {
+                if (!regex_literal_prefix(parser, child, prefix)) return false;
+            }
+            return true;
+        case REGEX_NODE_REPEAT:
+            if (node.min >= 1) {
+                bool literal = regex_literal_prefix(parser, node.children[0], prefix);
+                return literal && node.min == 1 && node.max == 1;
+            }
+            return false;
+        case REGEX_NODE_ALTERNATE:
+            return false;
+    }
+    return false;
+}
+
+inline void regex_dfa_init(RegexDfa* dfa, const RegexProgram* program, bool longest) {
+    dfa->program = program;
+    dfa->longest = longest;
+    dfa->states.clear();
+    dfa->index.clear();
+    dfa->start[0] = dfa->start[1] = -1;
+    dfa->marks.assign(program->insts.size(), 0);
+    dfa->generation = 0;
+}
+
+// Compile a pattern; on failure returns false with a message in regex->error
+inline bool regex_compile(Regex* regex, const char* pattern, size_t length, bool case_sensitive) {
+    regex->error[0] = '\0';
+
+    RegexParser parser;
+    parser.pattern = pattern;
+    parser.length = length;
+    parser.pos = 0;
+    parser.case_sensitive = case_sensitive;
+    parser.error = regex->error;
+
+    int root = regex_parse_alternation(&parser, 0);
+    if (root < 0) return false;
+    if (parser.pos < parser.length) {
+        return regex_fail(&parser, "Unmatched )");
+    }
+
+    // Forward: a lazy any-byte loop in front makes the search unanchored, at
+    // lower priority than threads that started earlier
+    RegexProgram* forward = &regex->forward;
+    forward->insts.clear();
+    int match = regex_emit(forward, REGEX_OP_MATCH, -1, -1);
+    int entry = regex_compile_node(&parser, root, match, false, forward);
+    int loop = entry >= 0 ? regex_emit(forward, REGEX_OP_SPLIT, entry, -1) : -1;
+    int any = loop >= 0 ? regex_emit(forward, REGEX_OP_BYTES, loop, -1) : -1;
+    if (any < 0) {
+        snprintf(regex->error, REGEX_ERROR_SIZE, "Pattern too large");
+        return false;
+    }
+    forward->insts[any].bytes.set();
+    forward->insts[loop].out1 = any;
+    forward->start = loop;
+
+    RegexProgram* reverse = &regex->reverse;
+    reverse->insts.clear();
+    match = regex_emit(reverse, REGEX_OP_MATCH, -1, -1);
+    reverse->start = regex_compile_node(&parser, root, match, true, reverse);
+    if (reverse->start < 0) {
+        snprintf(regex->error, REGEX_ERROR_SIZE, "Pattern too large");
+        return false;
+    }
+
+    regex_dfa_init(&regex->forward_dfa, &regex->forward, false);
+    regex_dfa_init(&regex->reverse_dfa, &regex->reverse, true);
+
+    std::string prefix;
+    regex_literal_prefix(&parser, root, &prefix);
+    regex->has_prefix = false;
+    if (!prefix.empty()) {
+        // Unicode-folded candidates are a superset of the ASCII-folded matches
+        // here, but the skip needs a byte that doesn't vary with case
+        search_pattern_init(&regex->prefix, prefix.data(), prefix.size(), case_sensitive);
+        regex->has_prefix = !regex->prefix.use_scan;
+    }
+    return true;
+}
+
+// DFA construction
+
+// Follow empty transitions from `threads` in priority order, collecting the
+// byte-consuming instructions reached into dfa->consumers. Returns true if a
+// match is reached; leftmost-first DFAs drop every lower-priority thread then.
+inline bool regex_dfa_closure(RegexDfa* dfa, const std::vector<int>& threads, bool line_start, bool line_end) {
+    const std::vector<RegexInst>& insts = dfa->program->insts;
+    if (++dfa->generation == 0) {
+        std::fill(dfa->marks.begin(), dfa->marks.end(), 0);
+        dfa->generation = 1;
+    }
+    dfa->consumers.clear();
+    bool matched = false;
+
+    for (int thread : threads) {
+        dfa->stack.push_back(thread);
+        while (!dfa->stack.empty()) {
+            int pc = dfa->stack.back();
+            dfa->stack.pop_back();
+            if (dfa->marks[pc] == dfa->generation) continue;
+            dfa->marks[pc] = dfa->generation;
+
+            const RegexInst& inst = insts[pc];
+            switch (inst.op) {
+                case REGEX_OP_BYTES:
+                    dfa->consumers.push_back(pc);
+                    break;
+                case REGEX_OP_SPLIT:
+                    dfa->stack.push_back(inst.out1);  // Popped after everything reachable from out
+                    dfa->stack.push_back(inst.out);
+                    break;
+                case REGEX_OP_LINE_START:
+                    if (line_start) dfa->stack.push_back(inst.out);
+                    break;
+                case REGEX_OP_LINE_END:
+                    if (line_end) dfa->stack.push_back(inst.out);
+                    break;
+                case REGEX_OP_MATCH:
+                    matched = true;
+                    if (!dfa->longest) {
+                        dfa->stack.clear();
+                        return true;
+                    }
+                    break;
+            }
+        }
+    }
+    return matched;
+}
+
+// State for a thread list, creating it if new (flushing a full cache first;
+// *flushed tells the caller its own state index is gone)
+inline int regex_dfa_intern(RegexDfa* dfa, const std::vector<int>& threads, bool line_start, bool* flushed) {
+    std::string key(1, line_start ? '^' : '-');
+    key.append((const char*)threads.data(), threads.size() * sizeof(int));
+    auto found = dfa->index.find(key);
+    if (found != dfa->index.end()) return found->second;
+
+    if (dfa->states.size() >= REGEX_MAX_DFA_STATES) {
+        dfa->states.clear();
+        dfa->index.clear();
+        dfa->start[0] = dfa->start[1] = -1;
+        *flushed = true;
+    }
+
+    RegexDfaState state;
+    state.threads = threads;
+    state.line_start = line_start;
+    state.dead = threads.empty();
+    memset(state.next, -1, sizeof(state.next));
+    state.end[0] = state.end[1] = -1;
+    dfa->states.push_back(std::move(state));
+
+    int id = (int)dfa->states.size() - 1;
+    dfa->index.emplace(std::move(key), id);
+    return id;
+}
+
+inline int regex_dfa_start(RegexDfa* dfa, bool line_start) {
+    int which = line_start ? 1 : 0;
+    if (dfa->start[which] < 0) {
+        bool flushed = false;
+        int state = regex_dfa_intern(dfa, std::vector<int>(1, dfa->program->start), line_start, &flushed);
+        dfa->start[which] = state;
+    }
+    return dfa->start[which];
+}
+
+inline int regex_dfa_build_step(RegexDfa* dfa, int state, unsigned char byte) {
+    const std::vector<RegexInst>& insts = dfa->program->insts;
+    bool matched = regex_dfa_closure(dfa, dfa->states[state].threads, dfa->states[state].line_start,
+                                     byte == '\n');
+
+    // Threads after the byte, deduplicated (first = highest priority wins)
+    if (++dfa->generation == 0) {
+        std::fill(dfa->marks.begin(), dfa->marks.end(), 0);
+        dfa->generation = 1;
+    }
+    dfa->threads.clear();
+    for (int pc : dfa->consumers) {
+        int out = insts[pc].out;
+        if (insts[pc].bytes[byte] && dfa->marks[out] != dfa->generation) {
+            dfa->marks[out] = dfa->generation;
+            dfa->threads.push_back(out);
+        }
+    }
+
+    bool flushed = false;
+    int target = regex_dfa_intern(dfa, dfa->threads, byte == '\n', &flushed);
+    int result = (target << 1) | (matched ? 1 : 0);
+    if (!flushed) {
+        dfa->states[state].next[byte] = result;
+    }
+    return result;
+}
+
+// (next state << 1) | (a match ends before this byte)
+inline int regex_dfa_step(RegexDfa* dfa, int state, unsigned char byte) {
+    int cached = dfa->states[state].next[byte];
+    return cached >= 0 ? cached : regex_dfa_build_step(dfa, state, byte);
+}
+
+// Does a match end here, at the end of the input?
+inline bool regex_dfa_end(RegexDfa* dfa, int state, bool line_end) {
+    int& cached = dfa->states[state].end[line_end ? 1 : 0];
+    if (cached < 0) {
+        cached = regex_dfa_closure(dfa, dfa->states[state].threads, dfa->states[state].line_start, line_end);
+    }
+    return cached != 0;
+}
+
+// Matching
+
+// Forward reader over the rope's leaves, repositionable in O(log n)
+struct RegexReader {
+    Rope* rope;
+    RopeChunkIterator it;
+    const unsigned char* chunk;
+    size_t chunk_start;
+    size_t chunk_end;
+};
+
+inline void regex_reader_seek(RegexReader* reader, size_t pos) {
+    const char* data = nullptr;
+    size_t length = 0;
+    rope_chunks_seek(reader->rope, pos, &reader->it, &reader->chunk_start);
+    rope_chunks_next(&reader->it, &data, &length);
+    reader->chunk = (const unsigned char*)data;
+    reader->chunk_end = reader->chunk_start + length;
+}
+
+inline bool regex_reader_next(RegexReader* reader) {
+    const char* data;
+    size_t length;
+    if (!rope_chunks_next(&reader->it, &data, &length)) return false;
+    reader->chunk = (const unsigned char*)data;
+    reader->chunk_start = reader->chunk_end;
+    reader->chunk_end += length;
+    return true;
+}
+
+inline bool regex_newline_before(RegexReader* reader, size_t pos) {
+    if (pos == 0) return true;
+    if (pos > reader->chunk_start && pos <= reader->chunk_end) {
+        return reader->chunk[pos - 1 - reader->chunk_start] == '\n';
+    }
+    return rope_char_at(reader->rope, pos - 1) == '\n';
+}
+
+// Next position at or after pos where the literal prefix occurs; leaves the
+// reader on the leaf containing it. Checks cancel once per leaf, since the scan
+// can cross the whole document without leaving this loop.
+inline bool regex_next_candidate(const Regex* regex, RegexReader* reader, size_t pos, size_t* candidate,
+                                 const std::atomic<bool>* cancel) {
+    const SearchPattern* prefix = &regex->prefix;
+    size_t offset = prefix->rare_offset;
+    size_t length = rope_length(reader->rope);
+    size_t from = pos + offset;  // Rare byte of the first possible candidate
+
+    while (from < length) {
+        while (from >= reader->chunk_end) {
+            if (!regex_reader_next(reader)) return false;
+            if (cancel && cancel->load(std::memory_order_relaxed)) return false;
+        }
+
+        const unsigned char* begin = reader->chunk + (from - reader->chunk_start);
+        size_t span = reader->chunk_end - from;
+        const unsigned char* hit = (const unsigned char*)memchr(begin, prefix->rare_lower, span);
+        if (prefix->rare_upper != prefix->rare_lower) {
+            const unsigned char* upper = (const unsigned char*)memchr(begin, prefix->rare_upper,
+                                                                      hit ? (size_t)(hit - begin) : span);
+            if (upper) hit = upper;
+        }
+        if (!hit) {
+            from = reader->chunk_end;
+            continue;
+        }
+
+        size_t at = reader->chunk_start + (hit - reader->chunk);
+        size_t start = at - offset;
+        size_t needle_length = prefix->needle.size();
+        if (start + needle_length > length) return false;
+
+        // Reject false hits cheaply when the whole literal is in this leaf
+        if (start >= reader->chunk_start && start + needle_length <= reader->chunk_end &&
+            !search_verify(prefix, reader->chunk + (start - reader->chunk_start))) {
+            from = at + 1;
+            continue;
+        }
+
+        if (start < reader->chunk_start) {
+            regex_reader_seek(reader, start);
+        }
+        *candidate = start;
+        return true;
+    }
+    return false;
+}
+
+// End of the leftmost-first match starting at or after `from`
+inline bool regex_find_end(Regex* regex, Rope* rope, size_t from, size_t* end,
+                           const std::atomic<bool>* cancel) {
+    RegexDfa* dfa = &regex->forward_dfa;
+    size_t length = rope_length(rope);
+
+    RegexReader reader;
+    reader.rope = rope;
+    reader.chunk = nullptr;
+    reader.chunk_start = reader.chunk_end = 0;
+    if (from < length) {
+        regex_reader_seek(&reader, from);
+    }
+
+    int state = regex_dfa_start(dfa, regex_newline_before(&reader, from));
+    size_t last_end = REGEX_NO_MATCH;
+    size_t pos = from;
+    bool dead = false;
+
+    while (pos < length) {
+        if (cancel && cancel->load(std::memory_order_relaxed)) return false;
+
+        // Nothing in progress: skip to where the literal prefix occurs
+        if (regex->has_prefix && last_end == REGEX_NO_MATCH &&
+            (state == dfa->start[0] || state == dfa->start[1])) {
+            size_t candidate;
+            if (!regex_next_candidate(regex, &reader, pos, &candidate, cancel)) return false;
+            if (candidate != pos) {
+                pos = candidate;
+                state = regex_dfa_start(dfa, regex_newline_before(&reader, pos));
+            }
+        }
+
+        // Run the DFA over the rest of this leaf
+        const unsigned char* chunk = reader.chunk;
+        size_t base = reader.chunk_start;
+        size_t i = pos - base;
+        size_t n = reader.chunk_end - base;
+        while (i < n) {
+            int step = regex_dfa_step(dfa, state, chunk[i]);
+            if (step & 1) last_end = base + i;
+            state = step >> 1;
+            i++;
+            if (dfa->states[state].dead) {
+                dead = true;
+                break;
+            }
+            if (regex->has_prefix && last_end == REGEX_NO_MATCH &&
+                (state == dfa->start[0] || state == dfa->start[1])) {
+                break;  // Back to the prefilter
+            }
+        }
+        pos = base + i;
+        if (dead) break;
+        if (pos == reader.chunk_end && pos < length) {
+            regex_reader_next(&reader);
+        }
+    }
+
+    if (!dead && regex_dfa_end(dfa, state, true)) {
+        last_end = length;
+    }
+    if (last_end == REGEX_NO_MATCH) return false;
+    *end = last_end;
+    return true;
+}
+
+// Start of the match ending at `end`: the furthest the reversed pattern
+// reaches backwards, without going before `from`
+inline size_t regex_find_start(Regex* regex, Rope* rope, size_t from, size_t end) {
+    RegexDfa* dfa = &regex->reverse_dfa;
+    size_t length = rope_length(rope);
+
+    int state = regex_dfa_start(dfa, end == length || rope_char_at(rope, end) == '\n');
+    size_t best = REGEX_NO_MATCH;
+    size_t pos = end;
+    bool dead = false;
+
+    while (pos > from && !dead) {
+        RopeChunkIterator it;
+        size_t leaf_start;
+        const char* chunk = nullptr;
+        size_t chunk_length = 0;
+        rope_chunks_seek(rope, pos - 1, &it, &leaf_start);
+        rope_chunks_next(&it, &chunk, &chunk_length);
+
+        size_t low = std::max(from, leaf_start);
+        while (pos > low) {
+            int step = regex_dfa_step(dfa, state, (unsigned char)chunk[pos - 1 - leaf_start]);
+            if (step & 1) best = pos;
+            state = step >> 1;
+            pos--;
+            if (dfa->states[state].dead) {
+                dead = true;
+                break;
+            }
+        }
+    }
+
+    if (!dead && regex_dfa_end(dfa, state, from == 0 || rope_char_at(rope, from - 1) == '\n')) {
+        best = from;
+    }
+    return best;
+}
+
+// Next non-empty match at or after `from` (leftmost-first, like Perl and
+// ECMAScript); returns false when there are no more or on cancel
+inline bool regex_find(Regex* regex, Rope* rope, size_t from, size_t* start, size_t* end,
+                       const std::atomic<bool>* cancel = nullptr) {
+    size_t length = rope_length(rope);
+    while (from <= length) {
+        size_t match_end;
+        if (!regex_find_end(regex, rope, from, &match_end, cancel)) return false;
+        size_t match_start = regex_find_start(regex, rope, from, match_end);
+        if (match_start < match_end) {
+            *start = match_start;
+            *end = match_end;
+            return true;
+        }
+        // Empty match: nothing to highlight, look again one byte on
+        from = match_end + 1;
+    }
+    return false;
+}
+
+// All non-overlapping matches in the rope, in ascending order
+inline void regex_search_rope(Regex* regex, Rope* rope, std::vector<size_t>* starts,
+                              std::vector<size_t>* lengths) {
+    starts->clear();
+    lengths->clear();
+    size_t from = 0;
+    size_t start, end;
+    while (regex_find(regex, rope, from, &start, &end)) {
+        starts->push_back(start);
+        lengths->push_back(end - start);
+        from = end;
+    }
+}
+
+#endif // ZED_REGEX_H
@@ -5,9 +5,13 @@
 
 #include <GL/glew.h>
 #include <GL/gl.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <cmath>
+#include <unordered_map>
 #include <vector>
 
 #include "config.h"
@@ -111,20 +115,57 @@ inline uint32_t utf8_decode(const char** p) {
     return codepoint;
 }
 
-// Maximum glyphs per frame
+// Maximum glyphs per stream slice (larger batches are drawn in several slices)
 constexpr int MAX_GLYPHS = 100000;
 
+// Rectangle instances per stream slice (larger batches are drawn in several slices)
+constexpr int MAX_RECTS = 65536;
+
+// Streaming buffers are split into this many slices (frames in flight)
+constexpr int STREAM_SLICE_COUNT = 3;
+
+// Packed instance limits
+constexpr int MAX_TEXT_LINES = 65536;   // Line origins addressable by a 16-bit index
+constexpr int MAX_PALETTE_COLORS = 64;  // Must match palette[] in TEXT_VERTEX_SHADER
+constexpr float GLYPH_X_SCALE = 4.0f;   // Instance x is stored in 1/4 px units
+
+// Retained glyph runs kept before runs unused last frame are evicted
+constexpr size_t GLYPH_RUN_CACHE_MAX = 8192;
+
+// Resident document layer capacity (lines are limited by the 16-bit line index)
+constexpr size_t DOCUMENT_MAX_INSTANCES = 1 << 20;
+constexpr size_t DOCUMENT_MAX_LINES = 16384;
+
+// Frames of damage remembered for buffer-age partial redraws
+constexpr int DAMAGE_HISTORY = 4;
+
 // Zoom constants
 constexpr int MIN_FONT_SIZE = 6;     // Minimum readable size
 constexpr int MAX_FONT_SIZE = 96;    // Maximum presentation size
 constexpr float ZOOM_FACTOR = 1.1f;  // 10% per step
 
 // Glyph instance data (sent to GPU)
+// Packed to 8 bytes: size/UVs come from the glyph table, color from the palette,
+// and y from the line origin table
 struct GlyphInstance {
-    float x, y;              // Screen position
-    float width, height;     // Glyph size
-    float u0, v0, u1, v1;    // Atlas texture rect
-    float r, g, b, a;        // Color
+    int16_t x;               // Pen x relative to line origin (1/GLYPH_X_SCALE px)
+    uint16_t line;           // Line origin table index
+    uint16_t glyph;          // Glyph table slot
+    uint16_t color;          // Palette index
+};
+static_assert(sizeof(GlyphInstance) == 8, "GlyphInstance must stay packed");
+
+// Retained glyph run for one line of text
+// Instances are relative to the line origin, so a run is reusable at any
+// screen position; line and color indices are stamped in when it is emitted.
+struct GlyphRun {
+    bool built;
+    size_t length;               // Text byte length
+    int font_size;
+    uint32_t generation;         // font_sys.generation the slots belong to
+    Color color;
+    uint32_t last_used_frame;
+    std::vector<GlyphInstance> instances;
 };
 
 // Shader program
@@ -136,12 +177,194 @@ struct ShaderProgram {
     // Uniform locations
     GLint projection_loc;
     GLint atlas_texture_loc;
+    GLint glyph_table_loc;
+    GLint line_table_loc;
+    GLint palette_loc;
+    GLint view_offset_loc;
 };
 
-// Rectangle vertex
-struct RectVertex {
-    float x, y;
-    float r, g, b, a;
+// Rectangle instance data (drawn from the unit quad)
+struct RectInstance {
+    float x, y;              // Top-left corner (screen space)
+    float w, h;              // Size
+    uint32_t color;          // Rect palette index
+};
+
+// Streaming vertex buffer
+// The buffer is split into STREAM_SLICE_COUNT slices. The CPU writes the current
+// slice through a mapping (persistent with ARB_buffer_storage, otherwise an
+// unsynchronized glMapBufferRange), and each slice is fenced when retired and
+// waited on before reuse, so writes never force an implicit sync with the GPU.
+struct StreamBuffer {
+    GLuint vbo;
+    size_t slice_bytes;
+    int slice;                           // Slice currently being written
+    GLsync fences[STREAM_SLICE_COUNT];   // Set when a slice is retired
+    bool persistent;
+    char* persistent_base;               // Whole-buffer mapping (persistent mode)
+    char* mapped;                        // Transient mapping, starting at mapped_from
+    size_t mapped_from;                  // Slice-relative offset of `mapped`
+    size_t used;                         // Bytes written in the current slice
+    size_t drawn;                        // Bytes already submitted for drawing
+};
+
+// Create a streaming buffer with STREAM_SLICE_COUNT slices of slice_bytes each
+inline void stream_buffer_init(StreamBuffer* sb, size_t slice_bytes) {
+    sb->slice_bytes = slice_bytes;
+    sb->slice = 0;
+    for (int i = 0; i < STREAM_SLICE_COUNT; i++) {
+        sb->fences[i] = nullptr;
+    }
+    sb->persistent = false;
+    sb->persistent_base = nullptr;
+    sb->mapped = nullptr;
+    sb->mapped_from = 0;
+    sb->used = 0;
+    sb->drawn = 0;
+
+    size_t total = slice_bytes * STREAM_SLICE_COUNT;
+    glGenBuffers(1, &sb->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, sb->vbo);
+
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, total, nullptr, flags);
+        sb->persistent_base = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags);
+        sb->persistent = (sb->persistent_base != nullptr);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Reserve bytes in the current slice; returns nullptr when the slice is full
+inline void* stream_buffer_alloc(StreamBuffer* sb, size_t bytes) {
+    if (sb->used + bytes > sb->slice_bytes) {
+        return nullptr;
+    }
+
+    size_t slice_base = sb->slice * sb->slice_bytes;
+    char* dst;
+
+    if (sb->persistent) {
+        dst = sb->persistent_base + slice_base + sb->used;
+    } else {
+        if (!sb->mapped) {
+            // Map the rest of the slice; its fence guarantees the GPU is done with it
+            glBindBuffer(GL_ARRAY_BUFFER, sb->vbo);
+            sb->mapped = (char*)glMapBufferRange(
+                GL_ARRAY_BUFFER, slice_base + sb->used, sb->slice_bytes - sb->used,
+                GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+            if (!sb->mapped) {
+                return nullptr;
+            }
+            sb->mapped_from = sb->used;
+        }
+        dst = sb->mapped + (sb->used - sb->mapped_from);
+    }
+
+    sb->used += bytes;
+    return dst;
+}
+
+// Make written bytes visible to the GPU
+// Returns the byte count not yet drawn and stores its buffer offset
+inline size_t stream_buffer_commit(StreamBuffer* sb, size_t* out_offset) {
+    if (sb->mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, sb->vbo);
+        glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, sb->used - sb->mapped_from);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        sb->mapped = nullptr;
+    }
+
+    *out_offset = sb->slice * sb->slice_bytes + sb->drawn;
+    size_t bytes = sb->used - sb->drawn;
+    sb->drawn = sb->used;
+    return bytes;
+}
+
+// Bytes written but not yet drawn
+inline size_t stream_buffer_pending(const StreamBuffer* sb) {
+    return sb->used - sb->drawn;
+}
+
+// Retire the current slice and move to the next one
+// Only blocks if the GPU is still reading the slice we are about to reuse.
+// Anything written but not drawn is discarded - flush before calling.
+inline void stream_buffer_next_slice(StreamBuffer* sb) {
+    size_t offset;
+    stream_buffer_commit(sb, &offset);
+
+    sb->fences[sb->slice] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    sb->slice = (sb->slice + 1) % STREAM_SLICE_COUNT;
+
+    GLsync fence = sb->fences[sb->slice];
+    if (fence) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+            // Keep waiting in 1ms steps
+        }
+        glDeleteSync(fence);
+        sb->fences[sb->slice] = nullptr;
+    }
+
+    sb->used = 0;
+    sb->drawn = 0;
+}
+
+// Release a streaming buffer
+inline void stream_buffer_shutdown(StreamBuffer* sb) {
+    if (!sb->vbo) return;
+
+    if (sb->persistent || sb->mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, sb->vbo);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    for (int i = 0; i < STREAM_SLICE_COUNT; i++) {
+        if (sb->fences[i]) {
+            glDeleteSync(sb->fences[i]);
+            sb->fences[i] = nullptr;
+        }
+    }
+
+    glDeleteBuffers(1, &sb->vbo);
+    sb->vbo = 0;
+}
+
+// Screen-space damage rectangle (pixels, top-left origin, exclusive max)
+struct DamageRect {
+    int x0, y0;
+    int x1, y1;
+};
+
+// Resident document text
+// Glyph instances for a contiguous window of document lines stay on the GPU.
+// Line origins are stored relative to base_line, so scrolling only changes
+// the view_offset uniform; newly exposed lines are appended at either end.
+struct DocumentLayer {
+    GLuint instance_vbo;
+    GLuint line_buffer;
+    GLuint line_texture;
+
+    uint64_t key;                 // Content version, font generation and color
+    size_t base_line;             // Document line whose origin is y = 0
+    size_t first_line;            // Resident lines are [first_line, last_line)
+    size_t last_line;
+    float line_height;
+
+    std::vector<GlyphInstance> pending_instances;  // Appended since last upload
+    std::vector<float> line_origins;               // (x, baseline y) per resident line
+    std::vector<Color> palette;
+    size_t instance_count;        // Instances uploaded to instance_vbo
+    size_t uploaded_lines;        // Line origins uploaded to line_buffer
+
+    // Set by renderer_queue_document(), drawn with the next text flush
+    bool queued;
+    float view_x;
+    float view_y;
 };
 
 // Renderer state
@@ -164,16 +387,43 @@ struct Renderer {
     // Geometry
     GLuint quad_vao;
     GLuint quad_vbo;
-    GLuint instance_vao;
-    GLuint instance_vbo;
 
-    // Rectangle rendering
+    // Rectangle rendering (instances are written straight into mapped memory)
     GLuint rect_vao;
-    GLuint rect_vbo;
-    std::vector<RectVertex> rect_vertices;
+    StreamBuffer rect_stream;
+    std::vector<Color> rect_palette;
+
+    // Glyph instances (written straight into mapped memory)
+    StreamBuffer glyph_stream;
+
+    // Resident document text (scrolls via uniform)
+    DocumentLayer document;
+
+    // Glyph table (texture buffer mirrored from font_sys.atlas.glyph_table)
+    GLuint glyph_table_buffer;
+    GLuint glyph_table_texture;
+
+    // Line origins for the pending batch, and the frame's color palette
+    GLuint line_table_buffer;
+    GLuint line_table_texture;
+    std::vector<float> line_origins;  // (x, baseline y) pairs
+    std::vector<Color> palette;
+
+    // Retained glyph runs keyed by content hash, font size and color
+    std::unordered_map<uint64_t, GlyphRun> run_cache;
+    uint32_t frame_index;
 
-    // Instance data
-    std::vector<GlyphInstance> glyph_instances;
+    // Set when the window contents are stale for renderer-side reasons
+    // (resize, zoom, expose, glyphs landing from the rasterizer)
+    bool needs_redraw;
+
+    // Damage for the next frame; only this region is cleared and redrawn
+    DamageRect damage;
+    bool damage_full;
+    int buffer_age;                          // From the platform before each frame
+    DamageRect damage_history[DAMAGE_HISTORY];  // Previous frames' damage, newest first
+    int damage_history_count;
+    bool scissor_active;
 
     // Projection matrix (orthographic)
     float projection[16];
@@ -230,6 +480,10 @@ inline bool init_shader_program(ShaderProgram* shader, const char* vs_source, co
     // Get uniform locations
     shader->projection_loc = glGetUniformLocation(shader->program, "projection");
     shader->atlas_texture_loc = glGetUniformLocation(shader->program, "atlas_texture");
+    shader->glyph_table_loc = glGetUniformLocation(shader->program, "glyph_table");
+    shader->line_table_loc = glGetUniformLocation(shader->program, "line_table");
+    shader->palette_loc = glGetUniformLocation(shader->program, "palette");
+    shader->view_offset_loc = glGetUniformLocation(shader->program, "view_offset");
 
     return true;
 }
@@ -251,6 +505,13 @@ inline bool renderer_init(Renderer* renderer, Config* config) {
     renderer->config = config;
     renderer->viewport_width = 1280;
     renderer->viewport_height = 720;
+    renderer->frame_index = 0;
+    renderer->needs_redraw = true;
+    renderer->damage = {0, 0, 0, 0};
+    renderer->damage_full = true;
+    renderer->buffer_age = 0;
+    renderer->damage_history_count = 0;
+    renderer->scissor_active = false;
 
     // Set up OpenGL state
     glClearColor(
@@ -275,6 +536,12 @@ inline bool renderer_init(Renderer* renderer, Config* config) {
 
     glyph_atlas_init(&renderer->font_sys.atlas);
 
+    // Common glyphs are rasterized synchronously; everything else goes to the worker
+    font_system_prewarm_ascii(&renderer->font_sys);
+    if (!font_system_start_rasterizer(&renderer->font_sys, config->font_path)) {
+        fprintf(stderr, "Warning: background glyph rasterizer unavailable, loading glyphs synchronously\n");
+    }
+
     // Initialize zoom state (config->font_size already has DPI scaling applied)
     renderer->base_font_size = config->font_size;
     renderer->current_zoom_level = 0;
@@ -314,53 +581,82 @@ inline bool renderer_init(Renderer* renderer, Config* config) {
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
-    // Create instance buffer
-    glGenBuffers(1, &renderer->instance_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->instance_vbo);
-    glBufferData(GL_ARRAY_BUFFER, MAX_GLYPHS * sizeof(GlyphInstance), nullptr, GL_DYNAMIC_DRAW);
-
-    // Instance attributes (vec2 pos, vec2 size, vec4 atlas_rect, vec4 color)
-    size_t offset = 0;
+    // Create instance stream (attribute offsets are re-pointed for each draw)
+    stream_buffer_init(&renderer->glyph_stream, MAX_GLYPHS * sizeof(GlyphInstance));
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->glyph_stream.vbo);
 
-    // glyph_pos (location 2)
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void*)offset);
+    // Instance attributes (int x, uvec3 line/glyph/color) - integer, not normalized
+    glVertexAttribIPointer(2, 1, GL_SHORT, sizeof(GlyphInstance),
+                           (void*)offsetof(GlyphInstance, x));
     glEnableVertexAttribArray(2);
     glVertexAttribDivisor(2, 1);
-    offset += 2 * sizeof(float);
 
-    // glyph_size (location 3)
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void*)offset);
+    glVertexAttribIPointer(3, 3, GL_UNSIGNED_SHORT, sizeof(GlyphInstance),
+                           (void*)offsetof(GlyphInstance, line));
     glEnableVertexAttribArray(3);
     glVertexAttribDivisor(3, 1);
-    offset += 2 * sizeof(float);
-
-    // atlas_rect (location 4)
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void*)offset);
-    glEnableVertexAttribArray(4);
-    glVertexAttribDivisor(4, 1);
-    offset += 4 * sizeof(float);
-
-    // glyph_color (location 5)
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(GlyphInstance), (void*)offset);
-    glEnableVertexAttribArray(5);
-    glVertexAttribDivisor(5, 1);
 
     glBindVertexArray(0);
 
-    // Create rectangle VAO/VBO
-    glGenVertexArrays(1, &renderer->rect_vao);
-    glGenBuffers(1, &renderer->rect_vbo);
+    // Glyph table and line origin table (texture buffers read by the text shader)
+    glGenBuffers(1, &renderer->glyph_table_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, renderer->glyph_table_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, GLYPH_TABLE_CAPACITY * GLYPH_TABLE_STRIDE * sizeof(float),
+                 nullptr, GL_DYNAMIC_DRAW);
+    glGenTextures(1, &renderer->glyph_table_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, renderer->glyph_table_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, renderer->glyph_table_buffer);
+
+    glGenBuffers(1, &renderer->line_table_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, renderer->line_table_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, MAX_TEXT_LINES * 2 * sizeof(float), nullptr, GL_STREAM_DRAW);
+    glGenTextures(1, &renderer->line_table_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, renderer->line_table_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, renderer->line_table_buffer);
+
+    // Resident document layer: its own instance buffer and line origin table
+    DocumentLayer* doc = &renderer->document;
+    glGenBuffers(1, &doc->instance_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, doc->instance_vbo);
+    glBufferData(GL_ARRAY_BUFFER, DOCUMENT_MAX_INSTANCES * sizeof(GlyphInstance), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &doc->line_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, doc->line_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, DOCUMENT_MAX_LINES * 2 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+    glGenTextures(1, &doc->line_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, doc->line_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, doc->line_buffer);
+
+    doc->key = 0;
+    doc->base_line = doc->first_line = doc->last_line = 0;
+    doc->line_height = 0.0f;
+    doc->instance_count = 0;
+    doc->uploaded_lines = 0;
+    doc->queued = false;
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    // Create rectangle VAO (unit quad + per-instance rects) and instance stream
+    stream_buffer_init(&renderer->rect_stream, MAX_RECTS * sizeof(RectInstance));
 
+    glGenVertexArrays(1, &renderer->rect_vao);
     glBindVertexArray(renderer->rect_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->rect_vbo);
-    glBufferData(GL_ARRAY_BUFFER, 10000 * sizeof(RectVertex), nullptr, GL_DYNAMIC_DRAW);
 
-    // position
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(RectVertex), (void*)0);
+    // Quad corner (shared with the glyph quad)
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->quad_vbo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
-    // color
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(RectVertex), (void*)(2 * sizeof(float)));
+
+    // Instance attributes (offsets are re-pointed for each draw)
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->rect_stream.vbo);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(RectInstance), (void*)offsetof(RectInstance, x));
     glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(RectInstance), (void*)offsetof(RectInstance, color));
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
 
     glBindVertexArray(0);
 
@@ -377,6 +673,9 @@ inline void renderer_resize(Renderer* renderer, int width, int height) {
     renderer->viewport_height = height;
     glViewport(0, 0, width, height);
     create_ortho_matrix(renderer->projection, 0, width, height, 0);
+    renderer->needs_redraw = true;
+    renderer->damage_full = true;
+    renderer->damage_history_count = 0;  // Resized buffers hold nothing useful
 }
 
 // Set zoom level (updates font size and clears atlas)
@@ -407,8 +706,13 @@ inline bool renderer_set_zoom(Renderer* renderer, int zoom_level) {
 
     // Clear glyph atlas (forces re-rasterization)
     glyph_atlas_clear(&renderer->font_sys.atlas);
+    font_system_prewarm_ascii(&renderer->font_sys);
+    renderer->run_cache.clear();  // Runs reference the old glyph slots
+    renderer->document.key = 0;   // So does the resident document
 
     renderer->current_zoom_level = zoom_level;
+    renderer->needs_redraw = true;
+    renderer->damage_full = true;
     printf("Zoom: %+d levels (%.0f%%, %dpx)\n", zoom_level, scale * 100.0f, new_font_size);
     return true;
 }
@@ -428,47 +732,226 @@ inline void renderer_zoom_reset(Renderer* renderer) {
     renderer_set_zoom(renderer, 0);
 }
 
+// Land background-rasterized glyphs between frames
+// Returns true if any placeholder was replaced (a redraw is needed)
+inline bool renderer_poll_glyphs(Renderer* renderer) {
+    if (renderer->font_sys.glyphs_in_flight == 0) return false;
+
+    if (font_system_drain_rasterizer(&renderer->font_sys) > 0) {
+        renderer->needs_redraw = true;
+        renderer->damage_full = true;  // Placeholders may be anywhere on screen
+        return true;
+    }
+    return false;
+}
+
+// Mark the whole window as needing a redraw
+inline void renderer_damage_full(Renderer* renderer) {
+    renderer->damage_full = true;
+}
+
+// Mark a screen region as needing a redraw
+inline void renderer_damage_rect(Renderer* renderer, float x, float y, float w, float h) {
+    int x0 = std::max(0, (int)floorf(x));
+    int y0 = std::max(0, (int)floorf(y));
+    int x1 = std::min(renderer->viewport_width, (int)ceilf(x + w));
+    int y1 = std::min(renderer->viewport_height, (int)ceilf(y + h));
+    if (x0 >= x1 || y0 >= y1) return;
+
+    DamageRect& d = renderer->damage;
+    if (d.x0 >= d.x1 || d.y0 >= d.y1) {
+        d = {x0, y0, x1, y1};
+    } else {
+        d.x0 = std::min(d.x0, x0);
+        d.y0 = std::min(d.y0, y0);
+        d.x1 = std::max(d.x1, x1);
+        d.y1 = std::max(d.y1, y1);
+    }
+}
+
+// Work out what must be repainted this frame and scissor to it
+// A back buffer of age N is missing the damage of the last N-1 frames too;
+// without a usable age the whole window is repainted.
+inline void renderer_apply_damage(Renderer* renderer) {
+    DamageRect frame = renderer->damage;
+    int age = renderer->buffer_age;
+    bool full = renderer->damage_full || age <= 0 || age - 1 > renderer->damage_history_count;
+
+    DamageRect repaint = frame;
+    for (int i = 0; !full && i < age - 1; i++) {
+        const DamageRect& h = renderer->damage_history[i];
+        if (h.x0 >= h.x1 || h.y0 >= h.y1) continue;
+        if (repaint.x0 >= repaint.x1 || repaint.y0 >= repaint.y1) {
+            repaint = h;
+        } else {
+            repaint.x0 = std::min(repaint.x0, h.x0);
+            repaint.y0 = std::min(repaint.y0, h.y0);
+            repaint.x1 = std::max(repaint.x1, h.x1);
+            repaint.y1 = std::max(repaint.y1, h.y1);
+        }
+    }
+
+    // Remember this frame's damage for future buffer ages
+    if (renderer->damage_full) {
+        frame = {0, 0, renderer->viewport_width, renderer->viewport_height};
+    }
+    for (int i = DAMAGE_HISTORY - 1; i > 0; i--) {
+        renderer->damage_history[i] = renderer->damage_history[i - 1];
+    }
+    renderer->damage_history[0] = frame;
+    renderer->damage_history_count = std::min(renderer->damage_history_count + 1, DAMAGE_HISTORY);
+
+    renderer->scissor_active = !full;
+    if (!full) {
+        // GL scissor origin is bottom-left
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(repaint.x0, renderer->viewport_height - repaint.y1,
+                  std::max(0, repaint.x1 - repaint.x0), std::max(0, repaint.y1 - repaint.y0));
+    }
+
+    renderer->damage = {0, 0, 0, 0};
+    renderer->damage_full = false;
+}
+
 // Begin frame
+// Damage must be reported (renderer_damage_rect/full) before this is called.
 inline void renderer_begin_frame(Renderer* renderer) {
+    renderer_apply_damage(renderer);
     glClear(GL_COLOR_BUFFER_BIT);
-    renderer->glyph_instances.clear();
-    renderer->rect_vertices.clear();
+    renderer->line_origins.clear();
+    renderer->palette.clear();
+    renderer->rect_palette.clear();
     font_system_begin_frame(&renderer->font_sys);
+
+    // Evict runs that were not drawn last frame once the cache grows too large
+    if (renderer->run_cache.size() > GLYPH_RUN_CACHE_MAX) {
+        for (auto it = renderer->run_cache.begin(); it != renderer->run_cache.end();) {
+            if (it->second.last_used_frame != renderer->frame_index) {
+                it = renderer->run_cache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    renderer->frame_index++;
 }
 
-// Add rectangle to render queue
-inline void renderer_add_rect(Renderer* renderer, float x, float y, float w, float h, Color color) {
-    // Two triangles for rectangle
-    RectVertex v1 = {x, y, color.r, color.g, color.b, color.a};
-    RectVertex v2 = {x + w, y, color.r, color.g, color.b, color.a};
-    RectVertex v3 = {x + w, y + h, color.r, color.g, color.b, color.a};
-    RectVertex v4 = {x, y + h, color.r, color.g, color.b, color.a};
+// Forward declaration (palette/line table overflow flushes pending text)
+inline void renderer_flush_text(Renderer* renderer);
+
+// Find or add a color in the frame palette
+inline uint16_t renderer_palette_index(Renderer* renderer, Color color) {
+    for (size_t i = 0; i < renderer->palette.size(); i++) {
+        const Color& c = renderer->palette[i];
+        if (c.r == color.r && c.g == color.g && c.b == color.b && c.a == color.a) {
+            return (uint16_t)i;
+        }
+    }
 
-    renderer->rect_vertices.push_back(v1);
-    renderer->rect_vertices.push_back(v2);
-    renderer->rect_vertices.push_back(v3);
-    renderer->rect_vertices.push_back(v1);
-    renderer->rect_vertices.push_back(v3);
-    renderer->rect_vertices.push_back(v4);
+    if (renderer->palette.size() >= (size_t)MAX_PALETTE_COLORS) {
+        // Pending instances still reference the old palette - draw them first
+        renderer_flush_text(renderer);
+        renderer->palette.clear();
+    }
+
+    renderer->palette.push_back(color);
+    return (uint16_t)(renderer->palette.size() - 1);
+}
+
+// Start a line of glyphs at (x, baseline_y); returns its line table index
+inline uint16_t renderer_begin_line(Renderer* renderer, float x, float baseline_y) {
+    if (renderer->line_origins.size() / 2 >= (size_t)MAX_TEXT_LINES) {
+        renderer_flush_text(renderer);
+    }
+
+    renderer->line_origins.push_back(x);
+    renderer->line_origins.push_back(baseline_y);
+    return (uint16_t)(renderer->line_origins.size() / 2 - 1);
 }
 
 // Flush rectangles
+// Each flush draws one instanced call; a slice that fills up mid-frame is
+// drawn and retired, so very large batches go out in MAX_RECTS chunks.
 inline void renderer_flush_rects(Renderer* renderer) {
-    if (renderer->rect_vertices.empty()) return;
+    if (stream_buffer_pending(&renderer->rect_stream) == 0) return;
 
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->rect_vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0,
-                    renderer->rect_vertices.size() * sizeof(RectVertex),
-                    renderer->rect_vertices.data());
+    size_t offset;
+    size_t count = stream_buffer_commit(&renderer->rect_stream, &offset) / sizeof(RectInstance);
 
     glUseProgram(renderer->rect_shader.program);
     glUniformMatrix4fv(renderer->rect_shader.projection_loc, 1, GL_FALSE, renderer->projection);
+    glUniform4fv(renderer->rect_shader.palette_loc, (GLsizei)renderer->rect_palette.size(),
+                 (const float*)renderer->rect_palette.data());
 
+    // Point instance attributes at this batch (GL 3.3 has no base-instance draws)
     glBindVertexArray(renderer->rect_vao);
-    glDrawArrays(GL_TRIANGLES, 0, renderer->rect_vertices.size());
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->rect_stream.vbo);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(RectInstance),
+                          (void*)(offset + offsetof(RectInstance, x)));
+    glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(RectInstance),
+                           (void*)(offset + offsetof(RectInstance, color)));
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)count);
     glBindVertexArray(0);
+}
+
+// Find or add a color in the rect palette
+inline uint32_t renderer_rect_palette_index(Renderer* renderer, Color color) {
+    for (size_t i = 0; i < renderer->rect_palette.size(); i++) {
+        if (memcmp(&renderer->rect_palette[i], &color, sizeof(Color)) == 0) {
+            return (uint32_t)i;
+        }
+    }
+
+    if (renderer->rect_palette.size() >= (size_t)MAX_PALETTE_COLORS) {
+        // Pending rects still reference the old palette - draw them first
+        renderer_flush_rects(renderer);
+        renderer->rect_palette.clear();
+    }
+
+    renderer->rect_palette.push_back(color);
+    return (uint32_t)(renderer->rect_palette.size() - 1);
+}
 
-    renderer->rect_vertices.clear();
+// Add rectangle to render queue (rects entirely off screen are dropped)
+inline void renderer_add_rect(Renderer* renderer, float x, float y, float w, float h, Color color) {
+    if (w < 0.0f) { x += w; w = -w; }
+    if (h < 0.0f) { y += h; h = -h; }
+    if (x >= (float)renderer->viewport_width || y >= (float)renderer->viewport_height ||
+        x + w <= 0.0f || y + h <= 0.0f) {
+        return;
+    }
+
+    uint32_t color_index = renderer_rect_palette_index(renderer, color);
+
+    RectInstance* inst = (RectInstance*)stream_buffer_alloc(&renderer->rect_stream, sizeof(RectInstance));
+    if (!inst) {
+        // Slice is full - draw what we have and continue in the next one
+        renderer_flush_rects(renderer);
+        stream_buffer_next_slice(&renderer->rect_stream);
+        inst = (RectInstance*)stream_buffer_alloc(&renderer->rect_stream, sizeof(RectInstance));
+        if (!inst) return;
+    }
+
+    inst->x = x;
+    inst->y = y;
+    inst->w = w;
+    inst->h = h;
+    inst->color = color_index;
+}
+
+// Reserve one glyph instance in the mapped stream
+// When the slice is full, pending text is drawn and the line origin re-issued
+inline GlyphInstance* renderer_alloc_glyph(Renderer* renderer, uint16_t* line_index,
+                                           float line_x, float baseline_y) {
+    GlyphInstance* inst = (GlyphInstance*)stream_buffer_alloc(&renderer->glyph_stream,
+                                                              sizeof(GlyphInstance));
+    if (inst) return inst;
+
+    renderer_flush_text(renderer);
+    stream_buffer_next_slice(&renderer->glyph_stream);
+    *line_index = renderer_begin_line(renderer, line_x, baseline_y);
+
+    return (GlyphInstance*)stream_buffer_alloc(&renderer->glyph_stream, sizeof(GlyphInstance));
 }
 
 // Add text to render queue
@@ -482,16 +965,20 @@ inline void renderer_add_text(Renderer* renderer, const char* text, float x, flo
     static bool first_call = true;
     int char_count = 0;
 
+    uint16_t color_index = renderer_palette_index(renderer, color);
+    uint16_t line_index = renderer_begin_line(renderer, x, cursor_y);
+
     const char* p = text;
     while (*p) {
         uint32_t codepoint = utf8_decode(&p);  // Decode UTF-8
         if (codepoint == 0) break;  // End of string
         char_count++;
 
-        // Skip newlines (handle separately)
+        // Newlines start a new line origin
         if (codepoint == '\n') {
             cursor_x = x;
             cursor_y += renderer->font_sys.line_height;
+            line_index = renderer_begin_line(renderer, x, cursor_y);
             continue;
         }
 
@@ -510,60 +997,357 @@ inline void renderer_add_text(Renderer* renderer, const char* text, float x, flo
                    glyph->u0, glyph->v0, glyph->u1, glyph->v1);
         }
 
-        // Create instance
-        GlyphInstance inst;
-        inst.x = cursor_x + glyph->bearing_x;
-        inst.y = cursor_y - glyph->bearing_y;
-        inst.width = glyph->width;
-        inst.height = glyph->height;
-        inst.u0 = glyph->u0;
-        inst.v0 = glyph->v0;
-        inst.u1 = glyph->u1;
-        inst.v1 = glyph->v1;
-        inst.r = color.r;
-        inst.g = color.g;
-        inst.b = color.b;
-        inst.a = color.a;
-
-        renderer->glyph_instances.push_back(inst);
-
+        float pen_x = (cursor_x - x) * GLYPH_X_SCALE;
         cursor_x += glyph->advance_x;
+
+        // Beyond the 16-bit range is far off any screen - drop it
+        if (pen_x > (float)INT16_MAX) continue;
+
+        // Write instance straight into the mapped stream
+        GlyphInstance* inst = renderer_alloc_glyph(renderer, &line_index, x, cursor_y);
+        if (!inst) continue;
+        inst->x = (int16_t)lroundf(pen_x);
+        inst->line = line_index;
+        inst->glyph = glyph->slot;
+        inst->color = color_index;
     }
 
     if (first_call) {
-        printf("Added %d glyph instances\n", (int)renderer->glyph_instances.size());
+        printf("Added %zu glyph instances\n",
+               stream_buffer_pending(&renderer->glyph_stream) / sizeof(GlyphInstance));
         first_call = false;
     }
 }
 
-// Render all queued text
-inline void renderer_flush_text(Renderer* renderer) {
-    if (renderer->glyph_instances.empty()) return;
+// FNV-1a hash (continue a previous hash by passing it as seed)
+inline uint64_t renderer_hash_bytes(const void* data, size_t length,
+                                    uint64_t seed = 14695981039346656037ull) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
 
-    static bool first_flush = true;
-    if (first_flush) {
-        printf("Flushing %zu glyph instances\n", renderer->glyph_instances.size());
+// Decode a line and build its glyph instances relative to the line origin
+inline void renderer_build_glyph_run(Renderer* renderer, GlyphRun* run, const char* text, size_t length) {
+    run->instances.clear();
+
+    float pen = 0.0f;
+    const char* p = text;
+    const char* end = text + length;
+    while (p < end) {
+        uint32_t codepoint = utf8_decode(&p);
+        if (codepoint == 0) break;
+
+        GlyphInfo* glyph = font_system_get_glyph(&renderer->font_sys, codepoint);
+        if (!glyph) continue;
+
+        float pen_x = pen * GLYPH_X_SCALE;
+        pen += glyph->advance_x;
+
+        // The rest of the line is beyond the 16-bit range, far off any screen
+        if (pen_x > (float)INT16_MAX) break;
+
+        GlyphInstance inst;
+        inst.x = (int16_t)lroundf(pen_x);
+        inst.line = 0;
+        inst.glyph = glyph->slot;
+        inst.color = 0;
+        run->instances.push_back(inst);
+    }
+}
+
+// Look up (or build) the cached glyph run for one line of text
+inline GlyphRun* renderer_get_glyph_run(Renderer* renderer, const char* text, size_t length, Color color) {
+    FontSystem* font_sys = &renderer->font_sys;
+
+    uint64_t key = renderer_hash_bytes(text, length);
+    key = renderer_hash_bytes(&color, sizeof(color), key);
+    key = renderer_hash_bytes(&font_sys->font_size, sizeof(font_sys->font_size), key);
+
+    GlyphRun& run = renderer->run_cache[key];
+    bool stale = !run.built || run.length != length ||
+                 run.font_size != font_sys->font_size || run.generation != font_sys->generation ||
+                 memcmp(&run.color, &color, sizeof(Color)) != 0;
+    if (stale) {
+        renderer_build_glyph_run(renderer, &run, text, length);
+        run.built = true;
+        run.length = length;
+        run.font_size = font_sys->font_size;
+        run.generation = font_sys->generation;
+        run.color = color;
+    }
+    run.last_used_frame = renderer->frame_index;
+    return &run;
+}
+
+// Add one line of text (no newlines) to the render queue
+// Y coordinate is the TOP of the line, like renderer_add_text(). The line's
+// glyph run is cached, so unchanged lines cost a hash and a copy.
+inline void renderer_add_text_run(Renderer* renderer, const char* text, size_t length,
+                                  float x, float y, Color color) {
+    const GlyphRun& run = *renderer_get_glyph_run(renderer, text, length, color);
+    if (run.instances.empty()) return;
+
+    float baseline_y = y + renderer->font_sys.ascent;
+    uint16_t color_index = renderer_palette_index(renderer, color);
+    uint16_t line_index = renderer_begin_line(renderer, x, baseline_y);
+
+    const GlyphInstance* src = run.instances.data();
+    size_t remaining = run.instances.size();
+    bool rotated = false;
+
+    while (remaining > 0) {
+        size_t space = (renderer->glyph_stream.slice_bytes - renderer->glyph_stream.used) /
+                       sizeof(GlyphInstance);
+        GlyphInstance* dst = nullptr;
+        size_t count = std::min(remaining, space);
+        if (count > 0) {
+            dst = (GlyphInstance*)stream_buffer_alloc(&renderer->glyph_stream,
+                                                      count * sizeof(GlyphInstance));
+        }
+
+        if (!dst) {
+            // Slice full (or mapping failed) - draw pending text and continue in the next one
+            if (rotated && count > 0) return;
+            renderer_flush_text(renderer);
+            stream_buffer_next_slice(&renderer->glyph_stream);
+            line_index = renderer_begin_line(renderer, x, baseline_y);
+            rotated = true;
+            continue;
+        }
+        rotated = false;
+
+        // Write-only copy: mapped memory may be write-combined, so stamp the
+        // indices on the way in rather than patching afterwards
+        for (size_t i = 0; i < count; i++) {
+            GlyphInstance inst = src[i];
+            inst.line = line_index;
+            inst.color = color_index;
+            dst[i] = inst;
+        }
+
+        src += count;
+        remaining -= count;
+    }
+}
+
+// Drop all resident document lines; the next lines added are relative to base_line
+inline void renderer_document_reset(Renderer* renderer, uint64_t key, size_t base_line) {
+    DocumentLayer* doc = &renderer->document;
+    doc->key = key;
+    doc->base_line = base_line;
+    doc->first_line = base_line;
+    doc->last_line = base_line;
+    doc->line_height = renderer->font_sys.line_height;
+    doc->pending_instances.clear();
+    doc->line_origins.clear();
+    doc->palette.clear();
+    doc->instance_count = 0;
+    doc->uploaded_lines = 0;
+}
+
+// Key identifying what the resident lines were built from
+inline uint64_t renderer_document_key(Renderer* renderer, uint64_t content_version, Color color) {
+    uint64_t key = renderer_hash_bytes(&content_version, sizeof(content_version));
+    key = renderer_hash_bytes(&color, sizeof(color), key);
+    key = renderer_hash_bytes(&renderer->font_sys.generation, sizeof(uint32_t), key);
+    return renderer_hash_bytes(&renderer->font_sys.font_size, sizeof(int), key);
+}
+
+// Add a document line adjacent to the resident window (line == first_line - 1
+// or line == last_line). Returns false if the layer is full.
+inline bool renderer_document_add_line(Renderer* renderer, size_t line, const char* text,
+                                       size_t length, Color color) {
+    DocumentLayer* doc = &renderer->document;
+
+    const GlyphRun* run = renderer_get_glyph_run(renderer, text, length, color);
+    size_t total = doc->instance_count + doc->pending_instances.size() + run->instances.size();
+    if (total > DOCUMENT_MAX_INSTANCES || doc->line_origins.size() / 2 >= DOCUMENT_MAX_LINES) {
+        return false;
     }
 
-    // Upload instance data
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->instance_vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0,
-                    renderer->glyph_instances.size() * sizeof(GlyphInstance),
-                    renderer->glyph_instances.data());
+    // Palette is per layer; a layer with too many colors is rebuilt by the caller
+    uint16_t color_index = 0;
+    while (color_index < doc->palette.size() &&
+           memcmp(&doc->palette[color_index], &color, sizeof(Color)) != 0) {
+        color_index++;
+    }
+    if (color_index == doc->palette.size()) {
+        if (doc->palette.size() >= (size_t)MAX_PALETTE_COLORS) return false;
+        doc->palette.push_back(color);
+    }
 
-    // Bind shader and uniforms
+    // Origins relative to base_line keep float precision in huge documents
+    uint16_t line_index = (uint16_t)(doc->line_origins.size() / 2);
+    float line_offset = ((double)line - (double)doc->base_line) * doc->line_height;
+    doc->line_origins.push_back(0.0f);
+    doc->line_origins.push_back(line_offset + renderer->font_sys.ascent);
+
+    for (const GlyphInstance& src : run->instances) {
+        GlyphInstance inst = src;
+        inst.line = line_index;
+        inst.color = color_index;
+        doc->pending_instances.push_back(inst);
+    }
+
+    if (doc->first_line == doc->last_line) {
+        doc->first_line = line;
+        doc->last_line = line + 1;
+    } else if (line < doc->first_line) {
+        doc->first_line = line;
+    } else {
+        doc->last_line = line + 1;
+    }
+    return true;
+}
+
+// Draw the resident document at the next text flush, with line base_line's
+// top-left corner at (x, base_y) in screen space
+inline void renderer_queue_document(Renderer* renderer, float x, float base_y) {
+    renderer->document.queued = true;
+    renderer->document.view_x = x;
+    renderer->document.view_y = base_y;
+}
+
+// Upload glyph table slots written since the last flush
+inline void renderer_upload_glyph_table(Renderer* renderer) {
+    GlyphAtlas* atlas = &renderer->font_sys.atlas;
+    if (atlas->table_dirty_begin == atlas->table_dirty_end) return;
+
+    size_t first = (size_t)atlas->table_dirty_begin * GLYPH_TABLE_STRIDE;
+    size_t count = (size_t)(atlas->table_dirty_end - atlas->table_dirty_begin) * GLYPH_TABLE_STRIDE;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, renderer->glyph_table_buffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, first * sizeof(float), count * sizeof(float),
+                    atlas->glyph_table.data() + first);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    atlas->table_dirty_begin = 0;
+    atlas->table_dirty_end = 0;
+}
+
+// Bind the text shader with a line origin table, palette and view offset
+inline void renderer_bind_text_shader(Renderer* renderer, GLuint line_texture,
+                                      const std::vector<Color>& palette, float view_x, float view_y) {
     glUseProgram(renderer->text_shader.program);
     glUniformMatrix4fv(renderer->text_shader.projection_loc, 1, GL_FALSE, renderer->projection);
+    glUniform4fv(renderer->text_shader.palette_loc, (GLsizei)palette.size(),
+                 (const float*)palette.data());
+    glUniform2f(renderer->text_shader.view_offset_loc, view_x, view_y);
 
-    // Bind atlas texture
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, renderer->font_sys.atlas.texture);
     glUniform1i(renderer->text_shader.atlas_texture_loc, 0);
 
-    // Draw instanced
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, renderer->glyph_table_texture);
+    glUniform1i(renderer->text_shader.glyph_table_loc, 1);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, line_texture);
+    glUniform1i(renderer->text_shader.line_table_loc, 2);
+}
+
+// Draw count glyph instances starting at byte offset in vbo
+// (attributes are re-pointed because GL 3.3 has no base-instance draws)
+inline void renderer_draw_glyph_instances(Renderer* renderer, GLuint vbo, size_t offset, size_t count) {
     glBindVertexArray(renderer->quad_vao);
-    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, renderer->glyph_instances.size());
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribIPointer(2, 1, GL_SHORT, sizeof(GlyphInstance),
+                           (void*)(offset + offsetof(GlyphInstance, x)));
+    glVertexAttribIPointer(3, 3, GL_UNSIGNED_SHORT, sizeof(GlyphInstance),
+                           (void*)(offset + offsetof(GlyphInstance, line)));
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)count);
     glBindVertexArray(0);
+}
+
+inline void renderer_unbind_text_textures() {
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// Upload newly added document lines and draw the resident layer
+inline void renderer_draw_document(Renderer* renderer) {
+    DocumentLayer* doc = &renderer->document;
+    doc->queued = false;
+
+    // Append new instances and line origins after the ones already resident
+    if (!doc->pending_instances.empty()) {
+        glBindBuffer(GL_ARRAY_BUFFER, doc->instance_vbo);
+        if (doc->instance_count == 0) {
+            // Fresh layer: orphan so in-flight draws keep the old contents
+            glBufferData(GL_ARRAY_BUFFER, DOCUMENT_MAX_INSTANCES * sizeof(GlyphInstance),
+                         nullptr, GL_DYNAMIC_DRAW);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, doc->instance_count * sizeof(GlyphInstance),
+                        doc->pending_instances.size() * sizeof(GlyphInstance),
+                        doc->pending_instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        doc->instance_count += doc->pending_instances.size();
+        doc->pending_instances.clear();
+    }
+
+    size_t line_count = doc->line_origins.size() / 2;
+    if (line_count > doc->uploaded_lines) {
+        glBindBuffer(GL_TEXTURE_BUFFER, doc->line_buffer);
+        if (doc->uploaded_lines == 0) {
+            glBufferData(GL_TEXTURE_BUFFER, DOCUMENT_MAX_LINES * 2 * sizeof(float),
+                         nullptr, GL_DYNAMIC_DRAW);
+        }
+        glBufferSubData(GL_TEXTURE_BUFFER, doc->uploaded_lines * 2 * sizeof(float),
+                        (line_count - doc->uploaded_lines) * 2 * sizeof(float),
+                        doc->line_origins.data() + doc->uploaded_lines * 2);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        doc->uploaded_lines = line_count;
+    }
+
+    if (doc->instance_count == 0) return;
+
+    renderer_upload_glyph_table(renderer);
+    renderer_bind_text_shader(renderer, doc->line_texture, doc->palette, doc->view_x, doc->view_y);
+    renderer_draw_glyph_instances(renderer, doc->instance_vbo, 0, doc->instance_count);
+    renderer_unbind_text_textures();
+}
+
+// Render all queued text
+inline void renderer_flush_text(Renderer* renderer) {
+    if (renderer->document.queued) {
+        renderer_draw_document(renderer);
+    }
+
+    if (stream_buffer_pending(&renderer->glyph_stream) == 0) {
+        renderer->line_origins.clear();
+        return;
+    }
+
+    size_t offset;
+    size_t count = stream_buffer_commit(&renderer->glyph_stream, &offset) / sizeof(GlyphInstance);
+
+    static bool first_flush = true;
+    if (first_flush) {
+        printf("Flushing %zu glyph instances (%zu bytes)\n", count, count * sizeof(GlyphInstance));
+    }
+
+    // Upload glyph table changes and this batch's line origins (orphaned each flush)
+    renderer_upload_glyph_table(renderer);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, renderer->line_table_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, MAX_TEXT_LINES * 2 * sizeof(float), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, renderer->line_origins.size() * sizeof(float),
+                    renderer->line_origins.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    // Streamed text is already in screen space
+    renderer_bind_text_shader(renderer, renderer->line_table_texture, renderer->palette, 0.0f, 0.0f);
+    renderer_draw_glyph_instances(renderer, renderer->glyph_stream.vbo, offset, count);
+    renderer_unbind_text_textures();
 
     // Check for OpenGL errors
     GLenum err = glGetError();
@@ -572,11 +1356,11 @@ inline void renderer_flush_text(Renderer* renderer) {
     }
 
     if (first_flush) {
-        printf("Drew %zu instances\n", renderer->glyph_instances.size());
+        printf("Drew %zu instances\n", count);
         first_flush = false;
     }
 
-    renderer->glyph_instances.clear();
+    renderer->line_origins.clear();
 }
 
 // Flush both rectangles and text (for layering control)
@@ -588,6 +1372,16 @@ inline void renderer_flush(Renderer* renderer) {
 // End frame
 inline void renderer_end_frame(Renderer* renderer) {
     renderer_flush(renderer);  // Flush any remaining geometry
+
+    // Fence this frame's slices and move on to the next ones
+    stream_buffer_next_slice(&renderer->glyph_stream);
+    stream_buffer_next_slice(&renderer->rect_stream);
+
+    if (renderer->scissor_active) {
+        glDisable(GL_SCISSOR_TEST);
+        renderer->scissor_active = false;
+    }
+    renderer->needs_redraw = false;
 }
 
 // Shutdown renderer
@@ -604,9 +1398,47 @@ inline void renderer_shutdown(Renderer* renderer) {
         renderer->quad_vao = 0;
     }
 
-    if (renderer->instance_vbo) {
-        glDeleteBuffers(1, &renderer->instance_vbo);
-        renderer->instance_vbo = 0;
+    stream_buffer_shutdown(&renderer->glyph_stream);
+    stream_buffer_shutdown(&renderer->rect_stream);
+    renderer->run_cache.clear();
+
+    DocumentLayer* doc = &renderer->document;
+    if (doc->instance_vbo) {
+        glDeleteBuffers(1, &doc->instance_vbo);
+        doc->instance_vbo = 0;
+    }
+    if (doc->line_texture) {
+        glDeleteTextures(1, &doc->line_texture);
+        doc->line_texture = 0;
+    }
+    if (doc->line_buffer) {
+        glDeleteBuffers(1, &doc->line_buffer);
+        doc->line_buffer = 0;
+    }
+
+    if (renderer->rect_vao) {
+        glDeleteVertexArrays(1, &renderer->rect_vao);
+        renderer->rect_vao = 0;
+    }
+
+    if (renderer->glyph_table_texture) {
+        glDeleteTextures(1, &renderer->glyph_table_texture);
+        renderer->glyph_table_texture = 0;
+    }
+
+    if (renderer->glyph_table_buffer) {
+        glDeleteBuffers(1, &renderer->glyph_table_buffer);
+        renderer->glyph_table_buffer = 0;
+    }
+
+    if (renderer->line_table_texture) {
+        glDeleteTextures(1, &renderer->line_table_texture);
+        renderer->line_table_texture = 0;
+    }
+
+    if (renderer->line_table_buffer) {
+        glDeleteBuffers(1, &renderer->line_table_buffer);
+        renderer->line_table_buffer = 0;
     }
 
     if (renderer->text_shader.program) {
@@ -1,5 +1,7 @@
 // Rope data structure - AVL balanced tree of strings
 // Provides O(log n) insert, delete, and lookup operations
+// Nodes are reference counted and copied on write, so O(1) snapshots can be
+// read on other threads while the rope keeps being edited
 
 #ifndef ZED_ROPE_H
 #define ZED_ROPE_H
@@ -8,6 +10,8 @@
 #include <cstring>
 #include <cstdio>
 #include <algorithm>
+#include <atomic>
+#include <vector>
 
 // Rope node size: 256-512 bytes for small nodes (cache efficient)
 constexpr size_t ROPE_NODE_CAPACITY = 512;
@@ -19,13 +23,15 @@ struct RopeNode {
     RopeNode* right;
     int height;          // For AVL balancing
     size_t weight;       // Number of characters in left subtree + this node if leaf
+    size_t size;         // Number of characters in this whole subtree
+    std::atomic<int> refs;  // Trees sharing this node; modified only while 1
 
     // Leaf data
     bool is_leaf;
     char data[ROPE_NODE_CAPACITY];
     size_t length;       // Actual length of data (only for leaves)
 
-    RopeNode() : left(nullptr), right(nullptr), height(1), weight(0),
+    RopeNode() : left(nullptr), right(nullptr), height(1), weight(0), size(0), refs(1),
                  is_leaf(true), length(0) {
         data[0] = '\0';
     }
@@ -41,6 +47,8 @@ struct Rope {
 inline RopeNode* rope_node_create_leaf(const char* str, size_t len);
 inline RopeNode* rope_node_create_internal(RopeNode* left, RopeNode* right);
 inline void rope_node_free(RopeNode* node);
+inline RopeNode* rope_node_retain(RopeNode* node);
+inline RopeNode* rope_node_make_unique(RopeNode* node);
 inline int rope_node_get_height(RopeNode* node);
 inline size_t rope_node_get_weight(RopeNode* node);
 inline void rope_node_update(RopeNode* node);
@@ -60,6 +68,7 @@ inline RopeNode* rope_node_create_leaf(const char* str, size_t len) {
     memcpy(node->data, str, node->length);
     node->data[node->length] = '\0';
     node->weight = node->length;
+    node->size = node->length;
     return node;
 }
 
@@ -74,8 +83,10 @@ inline RopeNode* rope_node_create_internal(RopeNode* left, RopeNode* right) {
 }
 
 // Free a rope node and its children
+// Drops one reference; nodes still shared with a snapshot survive
 inline void rope_node_free(RopeNode* node) {
     if (!node) return;
+    if (node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
 
     if (!node->is_leaf) {
         rope_node_free(node->left);
@@ -85,20 +96,47 @@ inline void rope_node_free(RopeNode* node) {
     delete node;
 }
 
+// Share a node with another tree
+inline RopeNode* rope_node_retain(RopeNode* node) {
+    if (node) {
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    return node;
+}
+
+// Copy-on-write: return a node this tree owns exclusively, cloning it if shared
+// Every edit path calls this before modifying a node, so shared nodes are never
+// changed and a snapshot keeps seeing the text it was taken from.
+inline RopeNode* rope_node_make_unique(RopeNode* node) {
+    if (!node || node->refs.load(std::memory_order_acquire) == 1) {
+        return node;
+    }
+
+    RopeNode* copy = new RopeNode();
+    copy->left = rope_node_retain(node->left);
+    copy->right = rope_node_retain(node->right);
+    copy->height = node->height;
+    copy->weight = node->weight;
+    copy->size = node->size;
+    copy->is_leaf = node->is_leaf;
+    copy->length = node->length;
+    if (node->is_leaf) {
+        memcpy(copy->data, node->data, node->length);
+        copy->data[copy->length] = '\0';
+    }
+
+    rope_node_free(node);  // Drop this tree's reference to the shared original
+    return copy;
+}
+
 // Get height of node (0 for null)
 inline int rope_node_get_height(RopeNode* node) {
     return node ? node->height : 0;
 }
 
-// Get weight of node
+// Get weight of node (total characters in its subtree, kept by rope_node_update)
 inline size_t rope_node_get_weight(RopeNode* node) {
-    if (!node) return 0;
-
-    if (node->is_leaf) {
-        return node->length;
-    } else {
-        return rope_node_get_weight(node->left) + rope_node_get_weight(node->right);
-    }
+    return node ? node->size : 0;
 }
 
 // Update node metadata (height and weight)
@@ -110,8 +148,10 @@ inline void rope_node_update(RopeNode* node) {
 
     if (node->is_leaf) {
         node->weight = node->length;
+        node->size = node->length;
     } else {
         node->weight = rope_node_get_weight(node->left);
+        node->size = node->weight + rope_node_get_weight(node->right);
     }
 }
 
@@ -122,6 +162,8 @@ inline int rope_node_balance_factor(RopeNode* node) {
 
 // AVL rotation: right
 inline RopeNode* rope_node_rotate_right(RopeNode* y) {
+    y = rope_node_make_unique(y);
+    y->left = rope_node_make_unique(y->left);
     RopeNode* x = y->left;
     RopeNode* T2 = x->right;
 
@@ -136,6 +178,8 @@ inline RopeNode* rope_node_rotate_right(RopeNode* y) {
 
 // AVL rotation: left
 inline RopeNode* rope_node_rotate_left(RopeNode* x) {
+    x = rope_node_make_unique(x);
+    x->right = rope_node_make_unique(x->right);
     RopeNode* y = x->right;
     RopeNode* T2 = y->left;
 
@@ -194,6 +238,8 @@ inline RopeNode* rope_node_insert(RopeNode* node, size_t pos, const char* str, s
         }
     }
 
+    node = rope_node_make_unique(node);
+
     if (node->is_leaf) {
         // Leaf node: split if necessary
         if (node->length + len <= ROPE_NODE_CAPACITY) {
@@ -209,7 +255,9 @@ inline RopeNode* rope_node_insert(RopeNode* node, size_t pos, const char* str, s
             RopeNode* left_node = rope_node_create_leaf(node->data, pos);
             RopeNode* right_node = rope_node_create_leaf(node->data + pos, node->length - pos);
 
-            RopeNode* new_text_node = rope_node_create_leaf(str, len);
+            // Built like an insert into an empty rope, not as a single leaf:
+            // text longer than ROPE_NODE_CAPACITY used to be truncated here.
+            RopeNode* new_text_node = rope_node_insert(nullptr, 0, str, len);
 
             // Build tree: (left, new_text) + right
             RopeNode* left_tree = rope_node_create_internal(left_node, new_text_node);
@@ -234,6 +282,8 @@ inline RopeNode* rope_node_insert(RopeNode* node, size_t pos, const char* str, s
 inline RopeNode* rope_node_delete(RopeNode* node, size_t pos, size_t len) {
     if (!node || len == 0) return node;
 
+    node = rope_node_make_unique(node);
+
     if (node->is_leaf) {
         // Leaf node: delete from data
         if (pos >= node->length) return node;
@@ -362,6 +412,14 @@ inline void rope_delete(Rope* rope, size_t pos, size_t len) {
     rope->total_length -= std::min(len, rope->total_length - std::min(pos, rope->total_length));
 }
 
+// Read-only snapshot sharing the rope's nodes (O(1)); later edits to the rope
+// copy the nodes they touch instead of changing the snapshot. The snapshot may
+// be read on another thread; release it with rope_free().
+inline void rope_snapshot(Rope* rope, Rope* snapshot) {
+    snapshot->root = rope_node_retain(rope->root);
+    snapshot->total_length = rope->total_length;
+}
+
 // Copy substring to buffer
 inline size_t rope_copy(Rope* rope, size_t pos, char* buffer, size_t len) {
     if (!rope->root) return 0;
@@ -410,4 +468,194 @@ inline void rope_substr(Rope* rope, size_t pos, size_t length, char* buffer) {
     buffer[length] = '\0';
 }
 
+// In-order iteration over the rope's leaves, for scanning text without
+// flattening it into one buffer
+struct RopeChunkIterator {
+    std::vector<RopeNode*> stack;  // Subtrees still to visit (next on top)
+};
+
+// Iterate the leaves of one subtree only
+inline void rope_node_chunks_begin(RopeNode* node, RopeChunkIterator* it) {
+    it->stack.clear();
+    if (node) {
+        it->stack.push_back(node);
+    }
+}
+
+inline void rope_chunks_begin(Rope* rope, RopeChunkIterator* it) {
+    rope_node_chunks_begin(rope->root, it);
+}
+
+// Start iterating at the leaf containing pos (< rope length) in O(log n);
+// *leaf_start receives the document offset of that leaf
+inline void rope_chunks_seek(Rope* rope, size_t pos, RopeChunkIterator* it, size_t* leaf_start) {
+    it->stack.clear();
+    size_t offset = 0;
+    RopeNode* node = rope->root;
+    while (node && !node->is_leaf) {
+        size_t left_weight = rope_node_get_weight(node->left);
+        if (pos - offset < left_weight) {
+            if (node->right) it->stack.push_back(node->right);
+            node = node->left;
+        } else {
+            offset += left_weight;
+            node = node->right;
+        }
+    }
+    if (node) {
+        it->stack.push_back(node);
+    }
+    *leaf_start = offset;
+}
+
+// Next non-empty leaf node, or nullptr when the rope is exhausted
+inline RopeNode* rope_chunks_next_leaf(RopeChunkIterator* it) {
+    while (!it->stack.empty()) {
+        RopeNode* node = it->stack.back();
+        it->stack.pop_back();
+
+        if (node->is_leaf) {
+            if (node->length == 0) continue;
+            return node;
+        }
+
+        if (node->right) it->stack.push_back(node->right);
+        if (node->left) it->stack.push_back(node->left);
+    }
+    return nullptr;
+}
+
+// Next non-empty leaf; returns false when the rope is exhausted
+inline bool rope_chunks_next(RopeChunkIterator* it, const char** data, size_t* length) {
+    RopeNode* leaf = rope_chunks_next_leaf(it);
+    if (!leaf) return false;
+    *data = leaf->data;
+    *length = leaf->length;
+    return true;
+}
+
+// Builds a rope from text appended in document order: leaves are filled to
+// capacity (or shared whole with another rope) and joined into a balanced
+// tree bottom-up at the end, O(n) overall
+struct RopeBuilder {
+    std::vector<RopeNode*> leaves;
+    RopeNode* current;   // Leaf being filled, nullptr if none
+    size_t length;
+};
+
+inline void rope_builder_init(RopeBuilder* builder) {
+    builder->leaves.clear();
+    builder->current = nullptr;
+    builder->length = 0;
+}
+
+inline void rope_builder_flush(RopeBuilder* builder) {
+    if (!builder->current) return;
+    rope_node_update(builder->current);
+    builder->leaves.push_back(builder->current);
+    builder->current = nullptr;
+}
+
+inline void rope_builder_append(RopeBuilder* builder, const char* text, size_t len) {
+    builder->length += len;
+    while (len > 0) {
+        if (!builder->current) {
+            builder->current = new RopeNode();
+        }
+        RopeNode* leaf = builder->current;
+        size_t n = std::min(len, ROPE_NODE_CAPACITY - leaf->length);
+        memcpy(leaf->data + leaf->length, text, n);
+        leaf->length += n;
+        text += n;
+        len -= n;
+        if (leaf->length == ROPE_NODE_CAPACITY) {
+            rope_builder_flush(builder);
+        }
+    }
+}
+
+// Append a whole leaf of another rope: shared, unless it fits in the leaf
+// being filled (so runs of short pieces don't leave tiny leaves behind)
+inline void rope_builder_append_leaf(RopeBuilder* builder, RopeNode* leaf) {
+    if (builder->current && builder->current->length + leaf->length <= ROPE_NODE_CAPACITY) {
+        rope_builder_append(builder, leaf->data, leaf->length);
+        return;
+    }
+    rope_builder_flush(builder);
+    builder->leaves.push_back(rope_node_retain(leaf));
+    builder->length += leaf->length;
+}
+
+// Halves differ by at most one leaf, so heights differ by at most one (AVL)
+inline RopeNode* rope_builder_join(RopeNode** leaves, size_t count) {
+    if (count == 1) return leaves[0];
+    size_t half = count / 2;
+    RopeNode* left = rope_builder_join(leaves, half);
+    RopeNode* right = rope_builder_join(leaves + half, count - half);
+    return rope_node_create_internal(left, right);
+}
+
+// Move the built tree into rope (whose previous contents must be released)
+inline void rope_builder_finish(RopeBuilder* builder, Rope* rope) {
+    rope_builder_flush(builder);
+    rope->root = builder->leaves.empty() ? nullptr
+                                         : rope_builder_join(builder->leaves.data(), builder->leaves.size());
+    rope->total_length = builder->length;
+    builder->leaves.clear();
+    builder->length = 0;
+}
+
+// One edit for rope_splice(): replace [pos, pos + removed) with text
+struct RopeSplice {
+    size_t pos;
+    size_t removed;
+    const char* text;
+    size_t length;
+};
+
+// Apply many edits in one pass. Splices must be ascending and non-overlapping,
+// with positions in the current text. The result is streamed into a new tree
+// built bottom-up that shares untouched leaves with the old one: O(n + k)
+// instead of k inserts and deletes at O(log n) each, plus their rebalancing.
+inline void rope_splice(Rope* rope, const RopeSplice* splices, size_t count) {
+    RopeBuilder builder;
+    rope_builder_init(&builder);
+
+    RopeChunkIterator it;
+    rope_chunks_begin(rope, &it);
+    RopeNode* leaf = nullptr;
+    size_t leaf_offset = 0;  // Bytes of leaf already consumed
+    size_t pos = 0;          // Document position reached
+
+    for (size_t i = 0; i <= count; i++) {
+        size_t keep_end = i < count ? splices[i].pos : rope->total_length;
+        size_t skip_end = i < count ? keep_end + splices[i].removed : keep_end;
+
+        // Copy (or share) the text up to the splice, then step over what it removes
+        while (pos < skip_end) {
+            if (!leaf || leaf_offset == leaf->length) {
+                leaf = rope_chunks_next_leaf(&it);
+                leaf_offset = 0;
+                if (!leaf) break;
+            }
+            bool keep = pos < keep_end;
+            size_t n = std::min(leaf->length - leaf_offset, (keep ? keep_end : skip_end) - pos);
+            if (keep && leaf_offset == 0 && n == leaf->length) {
+                rope_builder_append_leaf(&builder, leaf);
+            } else if (keep) {
+                rope_builder_append(&builder, leaf->data + leaf_offset, n);
+            }
+            leaf_offset += n;
+            pos += n;
+        }
+
+        if (i < count) {
+            rope_builder_append(&builder, splices[i].text, splices[i].length);
+        }
+    }
+
+    rope_node_free(rope->root);
+    rope_builder_finish(&builder, rope);
+}
+
 #endif // ZED_ROPE_H
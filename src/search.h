@@ -0,0 +1,651 @@
+// Literal search engine - finds every occurrence of a byte string in a rope
+// Scans rope leaves in place: memchr prefiltering on the needle's rarest byte,
+// Horspool skips for longer needles, and a fold table for case-insensitive mode
+// Case-insensitive needles with non-ASCII characters are compared a code point
+// at a time through the Unicode simple folding tables (casefold_table.h); ASCII
+// needles never leave the byte path
+// Large documents are split across worker threads (see search_job.h), each
+// thread scanning its own leaf-aligned range of the tree
+
+#ifndef ZED_SEARCH_H
+#define ZED_SEARCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "casefold_table.h"
+#include "rope.h"
+
+// Needles at least this long may use Horspool skips instead of the prefilter
+constexpr size_t SEARCH_HORSPOOL_MIN = 8;
+
+// Bytes at least this common (see search_byte_rank) make a poor memchr prefilter
+constexpr int SEARCH_COMMON_BYTE_RANK = 20;
+
+// Documents at least this large are searched on a background thread
+constexpr size_t SEARCH_BACKGROUND_MIN_BYTES = 1 << 20;
+
+// Parallel scans split the rope into ranges of at most this many bytes (whole
+// subtrees, so usually somewhat less); finished ranges are published in order
+constexpr size_t SEARCH_RANGE_BYTES = 4 << 20;
+
+// Ranges per thread, so threads that finish early pick up more work
+constexpr size_t SEARCH_RANGES_PER_THREAD = 4;
+
+// Byte maps applied to text before comparing: identity, or ASCII lower case
+// (the same folding tolower() does in the C locale)
+struct SearchFoldTable {
+    unsigned char identity[256];
+    unsigned char lower[256];
+};
+
+constexpr SearchFoldTable search_make_fold_table() {
+    SearchFoldTable table = {};
+    for (int i = 0; i < 256; i++) {
+        table.identity[i] = (unsigned char)i;
+        table.lower[i] = (unsigned char)((i >= 'A' && i <= 'Z') ? i + ('a' - 'A') : i);
+    }
+    return table;
+}
+
+inline constexpr SearchFoldTable SEARCH_FOLD = search_make_fold_table();
+
+// Simple case folding of a code point (only mappings that keep the UTF-8
+// length, so folded text lines up byte for byte with the original)
+inline uint32_t search_fold_codepoint(uint32_t codepoint) {
+    const CaseFoldPair* end = CASEFOLD_PAIRS + CASEFOLD_PAIR_COUNT;
+    const CaseFoldPair* hit = std::lower_bound(CASEFOLD_PAIRS, end, codepoint,
+        [](const CaseFoldPair& pair, uint32_t value) { return pair.from < value; });
+    return (hit != end && hit->from == codepoint) ? hit->to : codepoint;
+}
+
+// Does the code point have other case forms (so its bytes vary between matches)?
+inline bool search_codepoint_has_case(uint32_t codepoint) {
+    return search_fold_codepoint(codepoint) != codepoint ||
+           std::binary_search(CASEFOLD_TARGETS, CASEFOLD_TARGETS + CASEFOLD_TARGET_COUNT, codepoint);
+}
+
+// Decode one UTF-8 character from text (at most `available` bytes); returns its
+// length, or 0 if the bytes there aren't a complete, well-formed character
+inline size_t search_utf8_decode(const unsigned char* text, size_t available, uint32_t* codepoint) {
+    unsigned char lead = text[0];
+    size_t length;
+    uint32_t value;
+    if (lead < 0x80) {
+        *codepoint = lead;
+        return 1;
+    } else if (lead >= 0xC2 && lead < 0xE0) {
+        length = 2;
+        value = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead < 0xF0) {
+        length = 3;
+        value = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead < 0xF5) {
+        length = 4;
+        value = lead & 0x07;
+    } else {
+        return 0;
+    }
+    if (length > available) return 0;
+    for (size_t i = 1; i < length; i++) {
+        if ((text[i] & 0xC0) != 0x80) return 0;
+        value = (value << 6) | (text[i] & 0x3F);
+    }
+    if ((length == 3 && value < 0x800) || (length == 4 && (value < 0x10000 || value > 0x10FFFF))) {
+        return 0;  // Overlong or out of range
+    }
+    *codepoint = value;
+    return length;
+}
+
+// Does text end with a whole character? Folding compares a character cut off
+// at the end of a query byte for byte, so such a query's matches are not a
+// superset of the matches of the query that completes it.
+inline bool search_utf8_ends_complete(const char* text, size_t length) {
+    size_t lead = length;
+    while (lead > 0 && length - lead < 4) {
+        lead--;
+        if (((unsigned char)text[lead] & 0xC0) != 0x80) break;
+    }
+    if (lead == length || ((unsigned char)text[lead] & 0xC0) == 0x80) return true;  // Empty, or no lead byte
+    if ((unsigned char)text[lead] < 0x80) return lead == length - 1;
+    uint32_t codepoint;
+    return search_utf8_decode((const unsigned char*)text + lead, length - lead, &codepoint) == length - lead;
+}
+
+// Encode a code point as `length` UTF-8 bytes (its own encoded length)
+inline void search_utf8_encode(uint32_t codepoint, size_t length, unsigned char* out) {
+    if (length == 1) {
+        out[0] = (unsigned char)codepoint;
+        return;
+    }
+    for (size_t i = length - 1; i > 0; i--) {
+        out[i] = (unsigned char)(0x80 | (codepoint & 0x3F));
+        codepoint >>= 6;
+    }
+    static const unsigned char lead_marks[5] = {0, 0, 0xC0, 0xE0, 0xF0};
+    out[0] = (unsigned char)(lead_marks[length] | codepoint);
+}
+
+// How common a byte is in typical source and prose: 0 = rare, higher = more common
+// Used to pick the needle byte least likely to produce false prefilter hits.
+inline int search_byte_rank(unsigned char byte) {
+    static const char common[] =
+        "zqjxkvbywgpfmucdlhrsnioate ZQJXKVBYWGPFMUCDLHRSNIOATE0123456789_.,;()\n\t";
+    const char* hit = byte ? (const char*)memchr(common, byte, sizeof(common) - 1) : nullptr;
+    if (!hit) return 0;
+    // Letters rank by English frequency; lower case dominates
+    int index = (int)(hit - common);
+    if (index < 27) return 10 + index;           // Lower case and space: 10..36
+    if (index < 53) return index - 27;           // Upper case: 0..25
+    return 12;                                   // Digits and punctuation
+}
+
+// Compiled needle
+struct SearchPattern {
+    std::vector<unsigned char> needle;  // Folded (ASCII lower case, Unicode simple folding) unless case_sensitive
+    bool case_sensitive;
+    bool unicode;                       // Case-insensitive with non-ASCII bytes: verified by code point
+    const unsigned char* fold;          // SEARCH_FOLD.identity or SEARCH_FOLD.lower
+
+    // Prefilter: candidates are occurrences of the rarest needle byte
+    size_t rare_offset;
+    unsigned char rare_lower;           // The byte (folded)
+    unsigned char rare_upper;           // Its other case (== rare_lower if none)
+    bool use_horspool;
+    bool use_scan;                      // Every byte varies with case: verify at each position
+
+    size_t shift[256];                  // Horspool bad-character shifts, by folded byte
+};
+
+inline void search_pattern_init(SearchPattern* pattern, const char* query, size_t length,
+                                bool case_sensitive) {
+    pattern->case_sensitive = case_sensitive;
+    pattern->unicode = false;
+    pattern->fold = case_sensitive ? SEARCH_FOLD.identity : SEARCH_FOLD.lower;
+    pattern->needle.resize(length);
+
+    // Bytes of cased non-ASCII characters differ between matches, so they
+    // can't be the prefilter byte
+    std::vector<bool> usable(length, true);
+    for (size_t i = 0; i < length; ) {
+        unsigned char byte = (unsigned char)query[i];
+        uint32_t codepoint;
+        size_t char_length;
+        if (byte < 0x80 || case_sensitive ||
+            (char_length = search_utf8_decode((const unsigned char*)query + i, length - i, &codepoint)) == 0) {
+            pattern->needle[i] = pattern->fold[byte];
+            pattern->unicode |= !case_sensitive && byte >= 0x80;
+            i++;
+            continue;
+        }
+        pattern->unicode = true;
+        search_utf8_encode(search_fold_codepoint(codepoint), char_length, &pattern->needle[i]);
+        if (search_codepoint_has_case(codepoint)) {
+            std::fill(usable.begin() + i, usable.begin() + i + char_length, false);
+        }
+        i += char_length;
+    }
+
+    // Rarest byte; ties go to the later one (fewer verification bytes before it)
+    pattern->rare_offset = 0;
+    int best_rank = 1 << 30;
+    for (size_t i = 0; i < length; i++) {
+        int rank = search_byte_rank(pattern->needle[i]);
+        if (usable[i] && rank <= best_rank) {
+            best_rank = rank;
+            pattern->rare_offset = i;
+        }
+    }
+    pattern->use_scan = length > 0 && best_rank == 1 << 30;
+    pattern->rare_lower = length ? pattern->needle[pattern->rare_offset] : 0;
+    pattern->rare_upper = pattern->rare_lower;
+    if (!case_sensitive && pattern->rare_lower >= 'a' && pattern->rare_lower <= 'z') {
+        pattern->rare_upper = (unsigned char)(pattern->rare_lower - ('a' - 'A'));
+    }
+
+    // Long needles made only of common bytes skip ahead instead (the shift
+    // table is per byte, so not with code point folding)
+    pattern->use_horspool = length >= SEARCH_HORSPOOL_MIN && best_rank >= SEARCH_COMMON_BYTE_RANK &&
+                            !pattern->unicode;
+
+    for (int i = 0; i < 256; i++) {
+        pattern->shift[i] = length;
+    }
+    for (size_t i = 0; i + 1 < length; i++) {
+        pattern->shift[pattern->needle[i]] = length - 1 - i;
+    }
+}
+
+// Case-insensitive compare for needles with non-ASCII bytes: ASCII through
+// the fold table, anything else a whole character at a time
+inline bool search_verify_unicode(const SearchPattern* pattern, const unsigned char* text) {
+    const unsigned char* needle = pattern->needle.data();
+    size_t length = pattern->needle.size();
+    size_t i = 0;
+    while (i < length) {
+        if (needle[i] < 0x80) {
+            if (SEARCH_FOLD.lower[text[i]] != needle[i]) return false;
+            i++;
+            continue;
+        }
+        uint32_t codepoint;
+        size_t char_length = search_utf8_decode(text + i, length - i, &codepoint);
+        if (char_length == 0) {
+            // Not a whole character: only the same byte matches
+            if (text[i] != needle[i]) return false;
+            i++;
+            continue;
+        }
+        unsigned char folded[4];
+        search_utf8_encode(search_fold_codepoint(codepoint), char_length, folded);
+        if (memcmp(folded, needle + i, char_length) != 0) return false;
+        i += char_length;
+    }
+    return true;
+}
+
+// Does the needle match at text (which has at least needle.size() bytes)?
+inline bool search_verify(const SearchPattern* pattern, const unsigned char* text) {
+    const unsigned char* needle = pattern->needle.data();
+    size_t length = pattern->needle.size();
+    if (pattern->case_sensitive) {
+        return memcmp(text, needle, length) == 0;
+    }
+    if (pattern->unicode) {
+        return search_verify_unicode(pattern, text);
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (SEARCH_FOLD.lower[text[i]] != needle[i]) return false;
+    }
+    return true;
+}
+
+// Matches in data[0, length) starting before start_limit, appended as base + start
+inline void search_buffer(const SearchPattern* pattern, const unsigned char* data, size_t length,
+                          size_t base, size_t start_limit, std::vector<size_t>* matches) {
+    size_t m = pattern->needle.size();
+    if (m == 0 || length < m || start_limit == 0) return;
+    size_t last_start = std::min(length - m, start_limit - 1);
+
+    if (pattern->use_horspool) {
+        const unsigned char* fold = pattern->fold;
+        unsigned char last_byte = pattern->needle[m - 1];
+        size_t pos = 0;
+        while (pos <= last_start) {
+            unsigned char c = fold[data[pos + m - 1]];
+            if (c == last_byte && search_verify(pattern, data + pos)) {
+                matches->push_back(base + pos);
+            }
+            pos += pattern->shift[c];
+        }
+        return;
+    }
+
+    if (pattern->use_scan) {
+        for (size_t pos = 0; pos <= last_start; pos++) {
+            if (search_verify(pattern, data + pos)) {
+                matches->push_back(base + pos);
+            }
+        }
+        return;
+    }
+
+    // Prefilter: memchr for the rare byte, verify the whole needle around it
+    size_t offset = pattern->rare_offset;
+    const unsigned char* from = data + offset;
+    const unsigned char* stop = data + last_start + offset + 1;  // Exclusive bound for rare byte
+
+    if (pattern->rare_lower == pattern->rare_upper) {
+        while (from < stop) {
+            const unsigned char* hit = (const unsigned char*)memchr(from, pattern->rare_lower, stop - from);
+            if (!hit) break;
+            if (search_verify(pattern, hit - offset)) {
+                matches->push_back(base + (hit - offset - data));
+            }
+            from = hit + 1;
+        }
+        return;
+    }
+
+    // Case-insensitive letter: merge the memchr streams of both cases
+    const unsigned char* next_lower = (const unsigned char*)memchr(from, pattern->rare_lower, stop - from);
+    const unsigned char* next_upper = (const unsigned char*)memchr(from, pattern->rare_upper, stop - from);
+    while (next_lower || next_upper) {
+        const unsigned char* hit;
+        if (next_lower && (!next_upper || next_lower < next_upper)) {
+            hit = next_lower;
+            next_lower = (hit + 1 < stop) ? (const unsigned char*)memchr(hit + 1, pattern->rare_lower, stop - hit - 1) : nullptr;
+        } else {
+            hit = next_upper;
+            next_upper = (hit + 1 < stop) ? (const unsigned char*)memchr(hit + 1, pattern->rare_upper, stop - hit - 1) : nullptr;
+        }
+        if (search_verify(pattern, hit - offset)) {
+            matches->push_back(base + (hit - offset - data));
+        }
+    }
+}
+
+// Incremental scan over consecutive chunks of a document
+// Matches straddling a chunk boundary are found in a small window joining the
+// previous needle-length-1 bytes to the start of the next chunk.
+struct SearchScanner {
+    const SearchPattern* pattern;
+    std::vector<unsigned char> carry;   // Last m-1 bytes before the current chunk
+    std::vector<unsigned char> window;  // carry + first m-1 bytes of the chunk
+    size_t offset;                      // Document offset of the next chunk
+};
+
+inline void search_scanner_init(SearchScanner* scanner, const SearchPattern* pattern) {
+    scanner->pattern = pattern;
+    scanner->carry.clear();
+    scanner->offset = 0;
+}
+
+// Append the matches that end inside this chunk, in ascending order
+inline void search_scanner_feed(SearchScanner* scanner, const char* chunk, size_t chunk_length,
+                                std::vector<size_t>* matches) {
+    const SearchPattern* pattern = scanner->pattern;
+    size_t m = pattern->needle.size();
+    if (m == 0) return;
+
+    const unsigned char* data = (const unsigned char*)chunk;
+    size_t head = std::min(m - 1, chunk_length);
+    std::vector<unsigned char>& carry = scanner->carry;
+
+    // Matches starting in the carry and ending in this chunk
+    if (!carry.empty()) {
+        scanner->window.assign(carry.begin(), carry.end());
+        scanner->window.insert(scanner->window.end(), data, data + head);
+        search_buffer(pattern, scanner->window.data(), scanner->window.size(),
+                      scanner->offset - carry.size(), carry.size(), matches);
+    }
+
+    search_buffer(pattern, data, chunk_length, scanner->offset, chunk_length, matches);
+
+    // The next carry is the last m-1 bytes seen so far
+    if (chunk_length >= m - 1) {
+        carry.assign(data + chunk_length - (m - 1), data + chunk_length);
+    } else {
+        carry.insert(carry.end(), data, data + chunk_length);
+        if (carry.size() > m - 1) {
+            carry.erase(carry.begin(), carry.end() - (m - 1));
+        }
+    }
+    scanner->offset += chunk_length;
+}
+
+// All matches in the rope, in ascending order (overlapping matches included)
+// Leaves are scanned in place.
+inline void search_rope(const SearchPattern* pattern, Rope* rope, std::vector<size_t>* matches) {
+    matches->clear();
+    size_t m = pattern->needle.size();
+    if (m == 0 || rope_length(rope) < m) return;
+
+    SearchScanner scanner;
+    search_scanner_init(&scanner, pattern);
+
+    RopeChunkIterator it;
+    rope_chunks_begin(rope, &it);
+    const char* chunk;
+    size_t chunk_length;
+    while (rope_chunks_next(&it, &chunk, &chunk_length)) {
+        search_scanner_feed(&scanner, chunk, chunk_length, matches);
+    }
+}
+
+// Matches starting in [first, end) of the rope, ascending; reads only the bytes
+// those matches can cover
+inline void search_rope_window(const SearchPattern* pattern, Rope* rope, size_t first, size_t end,
+                               std::vector<size_t>* matches) {
+    size_t m = pattern->needle.size();
+    size_t length = rope_length(rope);
+    if (m == 0 || first >= end || first + m > length) return;
+
+    size_t window_end = std::min(length, end + m - 1);
+    std::vector<unsigned char> window(window_end - first);
+    rope_copy(rope, first, (char*)window.data(), window.size());
+    search_buffer(pattern, window.data(), window.size(), first, end - first, matches);
+}
+
+// The first max_count matches starting at or after first, ascending; the scan
+// stops at the leaf where the last of them is found
+inline void search_rope_from(const SearchPattern* pattern, Rope* rope, size_t first, size_t max_count,
+                             std::vector<size_t>* matches) {
+    matches->clear();
+    size_t m = pattern->needle.size();
+    if (m == 0 || max_count == 0 || first + m > rope_length(rope)) return;
+
+    SearchScanner scanner;
+    search_scanner_init(&scanner, pattern);
+
+    RopeChunkIterator it;
+    rope_chunks_seek(rope, first, &it, &scanner.offset);
+    const char* chunk;
+    size_t chunk_length;
+    while (matches->size() < max_count && rope_chunks_next(&it, &chunk, &chunk_length)) {
+        search_scanner_feed(&scanner, chunk, chunk_length, matches);
+        // The first leaf (and a match straddling its end) may start before first
+        if (!matches->empty() && matches->front() < first) {
+            matches->erase(matches->begin(), std::lower_bound(matches->begin(), matches->end(), first));
+        }
+    }
+    // Matches straddling a leaf boundary start after every match inside the
+    // leaf, so the first max_count found are the first max_count overall
+    if (matches->size() > max_count) matches->resize(max_count);
+}
+
+// Keep only the matches of a prefix of the pattern (its first prefix_length
+// bytes) that the whole pattern also matches, checking just the added bytes
+// (or the whole needle when it is compared by code point)
+// Candidates must be ascending; the rope is walked leaf by leaf between nearby
+// candidates and seeked past long gaps, so the cost follows the candidates
+// rather than the document size. Returns the new count.
+inline size_t search_refine(const SearchPattern* pattern, Rope* rope, size_t prefix_length,
+                            size_t* matches, size_t count) {
+    size_t m = pattern->needle.size();
+    if (pattern->unicode) prefix_length = 0;
+    size_t suffix = m - prefix_length;
+    const unsigned char* added = pattern->needle.data() + prefix_length;
+    std::vector<unsigned char> straddle(suffix);  // Added bytes that cross a leaf boundary
+
+    RopeChunkIterator it;
+    const char* chunk = nullptr;
+    size_t chunk_length = 0;
+    size_t chunk_start = 0;
+    size_t chunk_end = 0;
+    bool started = false;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (matches[i] + m > rope_length(rope)) break;  // Ascending: the rest don't fit either
+        size_t start = matches[i] + prefix_length;
+
+        if (!started || start >= chunk_end) {
+            // Usually the next leaf; seek when the candidate is further away
+            if (started && rope_chunks_next(&it, &chunk, &chunk_length)) {
+                chunk_start = chunk_end;
+                chunk_end += chunk_length;
+            }
+            if (!started || start >= chunk_end) {
+                rope_chunks_seek(rope, start, &it, &chunk_start);
+                if (!rope_chunks_next(&it, &chunk, &chunk_length)) break;
+                chunk_end = chunk_start + chunk_length;
+                started = true;
+            }
+        }
+
+        const unsigned char* text;
+        if (start + suffix <= chunk_end) {
+            text = (const unsigned char*)chunk + (start - chunk_start);
+        } else {
+            rope_copy(rope, start, (char*)straddle.data(), suffix);
+            text = straddle.data();
+        }
+
+        bool match = !pattern->unicode || search_verify(pattern, text);
+        for (size_t j = 0; j < suffix && !pattern->unicode; j++) {
+            if (pattern->fold[text[j]] != added[j]) {
+                match = false;
+                break;
+            }
+        }
+        if (match) {
+            matches[kept++] = matches[i];
+        }
+    }
+    return kept;
+}
+
+// Leaf-aligned piece of the document: one subtree and where it starts
+struct SearchRange {
+    RopeNode* node;
+    size_t offset;
+};
+
+// Split the rope into at least min_ranges subtrees (when it has that many leaves)
+// of at most max_bytes each, in document order
+inline void search_split_rope(Rope* rope, size_t min_ranges, size_t max_bytes,
+                              std::vector<SearchRange>* ranges) {
+    ranges->clear();
+    if (!rope->root) return;
+    ranges->push_back({rope->root, 0});
+
+    while (true) {
+        // Split the largest internal subtree into its children
+        size_t largest = ranges->size();
+        for (size_t i = 0; i < ranges->size(); i++) {
+            RopeNode* node = (*ranges)[i].node;
+            if (!node->is_leaf && (largest == ranges->size() || node->size > (*ranges)[largest].node->size)) {
+                largest = i;
+            }
+        }
+        if (largest == ranges->size()) break;  // Only leaves left
+        if (ranges->size() >= min_ranges && (*ranges)[largest].node->size <= max_bytes) break;
+
+        SearchRange range = (*ranges)[largest];
+        std::vector<SearchRange> children;
+        if (range.node->left) {
+            children.push_back({range.node->left, range.offset});
+        }
+        if (range.node->right) {
+            children.push_back({range.node->right, range.offset + rope_node_get_weight(range.node->left)});
+        }
+        ranges->erase(ranges->begin() + largest);
+        ranges->insert(ranges->begin() + largest, children.begin(), children.end());
+    }
+}
+
+// One scan of a rope split across threads
+// Each range is seeded with the needle-length-1 bytes before it, so matches
+// straddling two ranges are found exactly once (by the later range). Finished
+// ranges are merged into output in document order as soon as every earlier
+// range is done, so output stays sorted while the scan is still running.
+struct SearchParallelScan {
+    const SearchPattern* pattern;
+    Rope* rope;
+    const std::atomic<bool>* cancel;    // Checked between leaves; may be nullptr
+
+    std::vector<SearchRange> ranges;
+    std::vector<std::vector<size_t>> range_matches;
+    std::vector<char> range_done;
+    std::atomic<size_t> next_range;     // Next range a thread should claim
+
+    std::mutex* output_mutex;           // Guards output, range_done, merged_ranges
+    std::vector<size_t>* output;
+    size_t merged_ranges;               // Ranges already appended to output
+};
+
+inline bool search_scan_cancelled(SearchParallelScan* scan) {
+    return scan->cancel && scan->cancel->load(std::memory_order_relaxed);
+}
+
+inline void search_scan_range(SearchParallelScan* scan, size_t index) {
+    const SearchRange& range = scan->ranges[index];
+    std::vector<size_t>* matches = &scan->range_matches[index];
+    size_t m = scan->pattern->needle.size();
+
+    SearchScanner scanner;
+    search_scanner_init(&scanner, scan->pattern);
+    scanner.offset = range.offset;
+    size_t before = std::min(m - 1, range.offset);
+    scanner.carry.resize(before);
+    rope_copy(scan->rope, range.offset - before, (char*)scanner.carry.data(), before);
+
+    RopeChunkIterator it;
+    rope_node_chunks_begin(range.node, &it);
+    const char* chunk;
+    size_t chunk_length;
+    while (rope_chunks_next(&it, &chunk, &chunk_length)) {
+        if (search_scan_cancelled(scan)) return;
+        search_scanner_feed(&scanner, chunk, chunk_length, matches);
+    }
+
+    std::lock_guard<std::mutex> lock(*scan->output_mutex);
+    scan->range_done[index] = 1;
+    while (scan->merged_ranges < scan->ranges.size() && scan->range_done[scan->merged_ranges]) {
+        std::vector<size_t>& done = scan->range_matches[scan->merged_ranges];
+        scan->output->insert(scan->output->end(), done.begin(), done.end());
+        std::vector<size_t>().swap(done);
+        scan->merged_ranges++;
+    }
+}
+
+inline void search_scan_worker(SearchParallelScan* scan) {
+    size_t index;
+    while ((index = scan->next_range.fetch_add(1, std::memory_order_relaxed)) < scan->ranges.size()) {
+        if (search_scan_cancelled(scan)) return;
+        search_scan_range(scan, index);
+    }
+}
+
+// Scan with `threads` threads (the calling thread is one of them), appending
+// matches to output in ascending order under output_mutex
+inline void search_scan_parallel(const SearchPattern* pattern, Rope* rope, size_t threads,
+                                 size_t range_bytes, const std::atomic<bool>* cancel,
+                                 std::mutex* output_mutex, std::vector<size_t>* output) {
+    if (pattern->needle.empty() || rope_length(rope) < pattern->needle.size()) return;
+    threads = std::max<size_t>(threads, 1);
+
+    SearchParallelScan scan;
+    scan.pattern = pattern;
+    scan.rope = rope;
+    scan.cancel = cancel;
+    search_split_rope(rope, threads * SEARCH_RANGES_PER_THREAD, range_bytes, &scan.ranges);
+    scan.range_matches.resize(scan.ranges.size());
+    scan.range_done.assign(scan.ranges.size(), 0);
+    scan.next_range.store(0, std::memory_order_relaxed);
+    scan.output_mutex = output_mutex;
+    scan.output = output;
+    scan.merged_ranges = 0;
+
+    threads = std::min(threads, scan.ranges.size());
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++) {
+        pool.emplace_back(search_scan_worker, &scan);
+    }
+    search_scan_worker(&scan);
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
+
+// Threads to use for background searches
+inline size_t search_thread_count() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// All matches in the rope, like search_rope(), scanned on `threads` threads
+inline void search_rope_parallel(const SearchPattern* pattern, Rope* rope, size_t threads,
+                                 std::vector<size_t>* matches, size_t range_bytes = SEARCH_RANGE_BYTES) {
+    matches->clear();
+    std::mutex mutex;
+    search_scan_parallel(pattern, rope, threads, range_bytes, nullptr, &mutex, matches);
+}
+
+#endif // ZED_SEARCH_H
@@ -0,0 +1,145 @@
+// Background search over a snapshot of the rope
+// The job thread publishes matches as soon as everything before them has been
+// scanned, so the UI can show them (and the running count) while the rest of
+// the document is searched. Literal queries are split across worker threads;
+// regex queries run on the job thread alone, since a match may span any range
+// boundary and the DFA's state can't be known at a boundary without scanning
+// up to it.
+
+#ifndef ZED_SEARCH_JOB_H
+#define ZED_SEARCH_JOB_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "regex.h"
+#include "rope.h"
+#include "search.h"
+
+struct SearchJob {
+    std::thread thread;
+    std::atomic<bool> cancel;           // Set by the UI thread; workers stop at the next leaf
+
+    Rope snapshot;                      // Read-only view taken when the job started
+    SearchPattern pattern;
+    Regex* regex;                       // Regex queries: compiled for this thread, else nullptr
+
+    std::mutex results_mutex;           // Guards results, result_lengths and finished
+    std::condition_variable finished_cv;
+    std::vector<size_t> results;        // Published matches the UI hasn't taken yet
+    std::vector<size_t> result_lengths; // Regex queries: length of each published match
+    bool finished;
+};
+
+inline void search_job_scan_regex(SearchJob* job) {
+    std::vector<size_t> starts;
+    std::vector<size_t> lengths;
+    size_t published = 0;
+    size_t from = 0;
+    size_t start, end;
+
+    while (regex_find(job->regex, &job->snapshot, from, &start, &end, &job->cancel)) {
+        starts.push_back(start);
+        lengths.push_back(end - start);
+        from = end;
+
+        // Publish in batches of about a range's worth of text
+        if (from - published >= SEARCH_RANGE_BYTES) {
+            std::lock_guard<std::mutex> lock(job->results_mutex);
+            job->results.insert(job->results.end(), starts.begin(), starts.end());
+            job->result_lengths.insert(job->result_lengths.end(), lengths.begin(), lengths.end());
+            starts.clear();
+            lengths.clear();
+            published = from;
+        }
+    }
+
+    if (!job->cancel.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(job->results_mutex);
+        job->results.insert(job->results.end(), starts.begin(), starts.end());
+        job->result_lengths.insert(job->result_lengths.end(), lengths.begin(), lengths.end());
+    }
+}
+
+inline void search_job_thread(SearchJob* job) {
+    if (job->regex) {
+        search_job_scan_regex(job);
+    } else {
+        search_scan_parallel(&job->pattern, &job->snapshot, search_thread_count(), SEARCH_RANGE_BYTES,
+                             &job->cancel, &job->results_mutex, &job->results);
+    }
+
+    // Released here rather than on the UI thread: if the document was edited
+    // meanwhile, this may be the last reference to a large part of the tree
+    rope_free(&job->snapshot);
+
+    {
+        std::lock_guard<std::mutex> lock(job->results_mutex);
+        job->finished = true;
+    }
+    job->finished_cv.notify_all();
+}
+
+inline SearchJob* search_job_create(Rope* rope) {
+    SearchJob* job = new SearchJob();
+    job->cancel.store(false, std::memory_order_relaxed);
+    job->finished = false;
+    job->regex = nullptr;
+    rope_snapshot(rope, &job->snapshot);
+    return job;
+}
+
+// Snapshot the rope and start scanning it in the background
+inline SearchJob* search_job_start(Rope* rope, const char* query, size_t length, bool case_sensitive) {
+    SearchJob* job = search_job_create(rope);
+    search_pattern_init(&job->pattern, query, length, case_sensitive);
+    job->thread = std::thread(search_job_thread, job);
+    return job;
+}
+
+// Same for a regex query; nullptr if the pattern doesn't compile
+inline SearchJob* search_job_start_regex(Rope* rope, const char* query, size_t length, bool case_sensitive) {
+    Regex* regex = new Regex();
+    if (!regex_compile(regex, query, length, case_sensitive)) {
+        delete regex;
+        return nullptr;
+    }
+    SearchJob* job = search_job_create(rope);
+    job->regex = regex;
+    job->thread = std::thread(search_job_thread, job);
+    return job;
+}
+
+// Move published matches to out (appended, ascending) and, for regex jobs,
+// their lengths to out_lengths; returns true once the job has finished and
+// everything it found has been taken
+inline bool search_job_take(SearchJob* job, std::vector<size_t>* out, std::vector<size_t>* out_lengths = nullptr) {
+    std::lock_guard<std::mutex> lock(job->results_mutex);
+    out->insert(out->end(), job->results.begin(), job->results.end());
+    job->results.clear();
+    if (out_lengths) {
+        out_lengths->insert(out_lengths->end(), job->result_lengths.begin(), job->result_lengths.end());
+    }
+    job->result_lengths.clear();
+    return job->finished;
+}
+
+// Block until the job has scanned the whole snapshot
+inline void search_job_wait(SearchJob* job) {
+    std::unique_lock<std::mutex> lock(job->results_mutex);
+    job->finished_cv.wait(lock, [job] { return job->finished; });
+}
+
+// Cancel (if still running) and join; the worker has released its snapshot
+inline void search_job_free(SearchJob* job) {
+    if (!job) return;
+    job->cancel.store(true, std::memory_order_relaxed);
+    job->thread.join();
+    delete job->regex;
+    delete job;
+}
+
+#endif // ZED_SEARCH_JOB_H
@@ -5,7 +5,9 @@
 #define ZED_SHADERS_H
 
 // Vertex shader for instanced glyph rendering
-// Per-instance attributes: position (x, y), atlas texcoords (u, v, s, t), color (rgba)
+// Per-instance attributes are packed into 8 bytes: pen x (1/4 px, relative to the
+// line origin), line index, glyph slot and palette index. Glyph UVs/metrics and
+// line origins are fetched from texture buffers.
 const char* TEXT_VERTEX_SHADER = R"(
 #version 330 core
 
@@ -14,10 +16,8 @@ layout(location = 0) in vec2 vertex_pos;    // Quad vertex position (0-1)
 layout(location = 1) in vec2 vertex_uv;     // Quad texture coords (0-1)
 
 // Instance attributes
-layout(location = 2) in vec2 glyph_pos;     // Screen position
-layout(location = 3) in vec2 glyph_size;    // Glyph size in pixels
-layout(location = 4) in vec4 atlas_rect;    // Atlas UV rect (u, v, w, h)
-layout(location = 5) in vec4 glyph_color;   // Glyph color
+layout(location = 2) in int glyph_x;        // Pen x relative to line origin (1/4 px)
+layout(location = 3) in uvec3 glyph_refs;   // (line index, glyph slot, palette index)
 
 // Outputs to fragment shader
 out vec2 frag_uv;
@@ -25,20 +25,28 @@ out vec4 frag_color;
 
 // Uniforms
 uniform mat4 projection;
+uniform samplerBuffer glyph_table;  // 2 texels per slot: uv rect, (bearing_x, bearing_y, w, h)
+uniform samplerBuffer line_table;   // 1 texel per line: (origin x, baseline y)
+uniform vec4 palette[64];
+uniform vec2 view_offset;           // Added to every line origin (scroll for resident text)
 
 void main() {
-    // Calculate final position
-    vec2 pos = glyph_pos + vertex_pos * glyph_size;
+    int slot = int(glyph_refs.y) * 2;
+    vec4 atlas_rect = texelFetch(glyph_table, slot);
+    vec4 metrics = texelFetch(glyph_table, slot + 1);
+    vec2 line_origin = texelFetch(line_table, int(glyph_refs.x)).xy + view_offset;
+
+    // Calculate final position (bearing_y is measured up from the baseline)
+    vec2 glyph_pos = line_origin + vec2(float(glyph_x) * 0.25 + metrics.x, -metrics.y);
+    vec2 pos = glyph_pos + vertex_pos * metrics.zw;
     gl_Position = projection * vec4(pos, 0.0, 1.0);
 
     // Calculate texture coordinates
     // atlas_rect is (u0, v0, u1, v1), interpolate between them
-    vec2 uv_min = atlas_rect.xy;
-    vec2 uv_max = atlas_rect.zw;
-    frag_uv = mix(uv_min, uv_max, vertex_uv);
+    frag_uv = mix(atlas_rect.xy, atlas_rect.zw, vertex_uv);
 
     // Pass color
-    frag_color = glyph_color;
+    frag_color = palette[glyph_refs.z];
 }
 )";
 
@@ -63,20 +71,22 @@ void main() {
 }
 )";
 
-// Simple vertex shader for selection rectangles
+// Instanced vertex shader for rectangles (selection, cursor, highlights)
 const char* RECT_VERTEX_SHADER = R"(
 #version 330 core
 
-layout(location = 0) in vec2 position;
-layout(location = 1) in vec4 color;
+layout(location = 0) in vec2 vertex_pos;   // Unit quad corner (0-1)
+layout(location = 1) in vec4 rect;         // Instance: (x, y, width, height)
+layout(location = 2) in uint rect_color;   // Instance: palette index
 
 out vec4 frag_color;
 
 uniform mat4 projection;
+uniform vec4 palette[64];
 
 void main() {
-    gl_Position = projection * vec4(position, 0.0, 1.0);
-    frag_color = color;
+    gl_Position = projection * vec4(rect.xy + vertex_pos * rect.zw, 0.0, 1.0);
+    frag_color = palette[rect_color];
 }
 )";
 
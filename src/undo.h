@@ -0,0 +1,389 @@
+// Undo history - a ring buffer of edit commands
+// Entries [0, current) are undone by undo, newest last; entries [current,
+// count) were undone and can be redone. A new edit drops the redo entries, and
+// the oldest entries are evicted once there are more than max_entries or they
+// take more than the memory budget (the newest entry is always kept, so even
+// an edit larger than the budget can be undone until the next one).
+// The text each command removed or inserted is kept in an append-only arena
+// shared by the whole history: since entries are evicted oldest first and
+// dropped newest first, their texts are freed from the two ends of the arena.
+// Typing is coalesced: an insert or delete right next to the previous one,
+// within UNDO_MERGE_SECONDS of it, extends that entry instead of adding one.
+// Texts only ever grow at their end, so a run costs O(length) in all: a
+// Backspace run, which grows at the front, is kept back to front.
+// Operations made of several edits are bracketed by undo_begin_group() and
+// undo_commit_group(), and undo and redo take the whole group at once.
+// Large edits are recorded as snapshots instead (undo_push_snapshot): the
+// entry keeps the rope version from the other side of the edit, which shares
+// its unchanged nodes with the document, and undo and redo swap it with the
+// document's in O(1) rather than copying and replaying the text.
+
+#ifndef ZED_UNDO_H
+#define ZED_UNDO_H
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <utility>
+#include <string>
+#include <vector>
+
+#include "rope.h"
+
+// Arena texts are packed into blocks of this size (larger texts get their own)
+constexpr size_t UNDO_BLOCK_BYTES = 64 << 10;
+
+// Typing this soon after the previous edit continues its undo entry
+constexpr double UNDO_MERGE_SECONDS = 1.0;
+
+// Command types for undo/redo
+enum CommandType {
+    CMD_INSERT,
+    CMD_DELETE,
+    CMD_REPLACE_ALL
+};
+
+// Replace-all details (see editor_replace_all); Command::content holds the
+// replaced texts back to back
+struct ReplaceAllCommand {
+    std::vector<size_t> positions;  // Match starts in the text before the replace
+    std::vector<size_t> lengths;    // Match lengths
+    std::string replacement;
+};
+
+// Command for undo/redo
+struct Command {
+    CommandType type;
+    size_t pos;
+    const char* content;             // In the history's arena
+    size_t length;
+    ReplaceAllCommand* replace_all;  // CMD_REPLACE_ALL only, else nullptr
+    size_t block;                    // Arena block holding content (see UndoArena)
+    size_t offset;                   // Where content starts in that block
+    bool typing;                     // Recorded by undo_record(): later typing may extend it
+    bool joined;                     // Undone and redone together with the entry before it
+    bool reversed;                   // Backspace run: content holds the text back to front
+    double time;                     // When it was last extended (undo_record() clock)
+    bool snapshot;                   // Undone by swapping in version (content is empty)
+    Rope version;                    // Snapshot entries: the text before the edit, or after it once undone
+    size_t version_bytes;            // Charged for version (see undo_push_snapshot)
+};
+
+struct UndoBlock {
+    char* data;
+    size_t capacity;
+    size_t used;
+};
+
+// Blocks are numbered from 0 as they are created; blocks[0] is block first_block
+struct UndoArena {
+    std::deque<UndoBlock> blocks;
+    size_t first_block;
+    size_t bytes;                    // Capacity of all blocks
+};
+
+struct UndoHistory {
+    Command* entries;                // Ring buffer of max_entries commands
+    size_t max_entries;
+    size_t head;                     // Ring index of the oldest entry
+    size_t count;                    // Entries held
+    size_t current;                  // Entries that can be undone
+    size_t budget;                   // Bytes the entries may take (texts and replace-all details)
+    size_t bytes;                    // Bytes they take now
+    int group_depth;                 // Open undo_begin_group() calls
+    size_t group_entries;            // Entries pushed since the outermost one
+    UndoArena arena;
+};
+
+inline void undo_init(UndoHistory* history, size_t max_entries, size_t budget) {
+    history->max_entries = max_entries > 0 ? max_entries : 1;
+    history->entries = new Command[history->max_entries];
+    history->head = 0;
+    history->count = 0;
+    history->current = 0;
+    history->budget = budget;
+    history->bytes = 0;
+    history->group_depth = 0;
+    history->group_entries = 0;
+    history->arena.first_block = 0;
+    history->arena.bytes = 0;
+}
+
+// Entry i, oldest first
+inline Command* undo_entry(UndoHistory* history, size_t i) {
+    return &history->entries[(history->head + i) % history->max_entries];
+}
+
+// Entries undo and redo can step through
+inline size_t undo_depth(const UndoHistory* history) {
+    return history->current;
+}
+
+inline size_t undo_redo_depth(const UndoHistory* history) {
+    return history->count - history->current;
+}
+
+// Memory an entry is charged against the budget
+inline size_t undo_entry_bytes(const Command* cmd) {
+    if (cmd->snapshot) return cmd->version_bytes;
+    size_t bytes = cmd->length;
+    if (cmd->replace_all) {
+        bytes += cmd->replace_all->positions.size() * 2 * sizeof(size_t) + cmd->replace_all->replacement.size();
+    }
+    return bytes;
+}
+
+// Copy text to the end of the arena; sets the command's content and position.
+// A new block gets room for `reserve` more bytes after the text.
+inline void undo_arena_append(UndoArena* arena, Command* cmd, const char* text, size_t length,
+                              size_t reserve = 0) {
+    if (arena->blocks.empty() || arena->blocks.back().used + length > arena->blocks.back().capacity) {
+        UndoBlock block;
+        block.capacity = length + reserve > UNDO_BLOCK_BYTES ? length + reserve : UNDO_BLOCK_BYTES;
+        block.data = new char[block.capacity];
+        block.used = 0;
+        arena->blocks.push_back(block);
+        arena->bytes += block.capacity;
+    }
+    UndoBlock* block = &arena->blocks.back();
+    cmd->block = arena->first_block + arena->blocks.size() - 1;
+    cmd->offset = block->used;
+    cmd->content = block->data + block->used;
+    if (length > 0) memcpy(block->data + block->used, text, length);
+    block->used += length;
+}
+
+// Free the blocks before `block` (nothing older than it is referenced)
+inline void undo_arena_release_before(UndoArena* arena, size_t block) {
+    while (!arena->blocks.empty() && arena->first_block < block) {
+        arena->bytes -= arena->blocks.front().capacity;
+        delete[] arena->blocks.front().data;
+        arena->blocks.pop_front();
+        arena->first_block++;
+    }
+}
+
+// Drop everything from (block, offset) on
+inline void undo_arena_truncate(UndoArena* arena, size_t block, size_t offset) {
+    while (!arena->blocks.empty() && arena->first_block + arena->blocks.size() - 1 > block) {
+        arena->bytes -= arena->blocks.back().capacity;
+        delete[] arena->blocks.back().data;
+        arena->blocks.pop_back();
+    }
+    if (arena->blocks.empty()) return;
+    if (offset == 0) {
+        // Nothing left in the block; it may be a large one of its own
+        arena->bytes -= arena->blocks.back().capacity;
+        delete[] arena->blocks.back().data;
+        arena->blocks.pop_back();
+    } else {
+        arena->blocks.back().used = offset;
+    }
+}
+
+// Free what an entry holds besides its arena text
+inline void undo_release_entry(UndoHistory* history, Command* cmd) {
+    history->bytes -= undo_entry_bytes(cmd);
+    delete cmd->replace_all;
+    if (cmd->snapshot) rope_free(&cmd->version);
+}
+
+// Forget the entries that could be redone
+inline void undo_clear_redo(UndoHistory* history) {
+    if (history->current == history->count) return;
+
+    Command* first = undo_entry(history, history->current);
+    undo_arena_truncate(&history->arena, first->block, first->offset);
+    for (size_t i = history->current; i < history->count; i++) {
+        undo_release_entry(history, undo_entry(history, i));
+    }
+    history->count = history->current;
+}
+
+// Forget the oldest entry
+inline void undo_evict_oldest(UndoHistory* history) {
+    undo_release_entry(history, undo_entry(history, 0));
+    history->head = (history->head + 1) % history->max_entries;
+    history->count--;
+    if (history->current > 0) history->current--;
+
+    if (history->count > 0) {
+        undo_entry(history, 0)->joined = false;  // Its group lost its first entry
+        undo_arena_release_before(&history->arena, undo_entry(history, 0)->block);
+    } else {
+        undo_arena_release_before(&history->arena, history->arena.first_block + history->arena.blocks.size());
+    }
+}
+
+// Drop the oldest entries while over the budget (but never the newest)
+inline void undo_enforce_budget(UndoHistory* history) {
+    while (history->count > 1 && history->bytes > history->budget) {
+        undo_evict_oldest(history);
+    }
+}
+
+// Record an edit (dropping the redo entries); the history takes ownership of
+// replace_all. Returns the new entry.
+inline Command* undo_push(UndoHistory* history, CommandType type, size_t pos, const char* content, size_t length,
+                          ReplaceAllCommand* replace_all = nullptr) {
+    undo_clear_redo(history);
+    if (history->count == history->max_entries) {
+        undo_evict_oldest(history);
+    }
+
+    Command* cmd = undo_entry(history, history->count);
+    cmd->type = type;
+    cmd->pos = pos;
+    cmd->length = length;
+    cmd->replace_all = replace_all;
+    cmd->typing = false;
+    cmd->reversed = false;
+    cmd->joined = history->group_depth > 0 && history->group_entries > 0;
+    cmd->time = 0.0;
+    cmd->snapshot = false;
+    cmd->version.root = nullptr;
+    cmd->version.total_length = 0;
+    cmd->version_bytes = 0;
+    undo_arena_append(&history->arena, cmd, content, length);
+    history->count++;
+    history->current = history->count;
+    history->bytes += undo_entry_bytes(cmd);
+    if (history->group_depth > 0) history->group_entries++;
+
+    undo_enforce_budget(history);
+    return cmd;
+}
+
+// Record a large edit, just made, as a snapshot: `before` (taken with
+// rope_snapshot() before the edit) is owned by the history from here on.
+// pos and length are the edit's, for placing the cursor. How many nodes the
+// version ends up holding alone depends on what else still shares them (the
+// document, other entries, a background search) and changes as they go, so
+// it is charged a bound that doesn't: the text an insert or delete changed,
+// or for a replace-all, which rebuilds the whole tree, the whole document.
+inline Command* undo_push_snapshot(UndoHistory* history, CommandType type, size_t pos, size_t length,
+                                   Rope* before) {
+    Command* cmd = undo_push(history, type, pos, nullptr, 0);
+    cmd->length = length;
+    cmd->snapshot = true;
+    cmd->version = *before;
+    cmd->version_bytes = type == CMD_REPLACE_ALL ? rope_length(before) : length;
+    history->bytes += cmd->version_bytes;
+    undo_enforce_budget(history);
+    return cmd;
+}
+
+// Append text to the newest entry's; its content must be the last thing in
+// the arena. Amortized O(length): when the block is full the text moves to
+// one of its own with as much room again.
+inline void undo_extend(UndoHistory* history, Command* cmd, const char* text, size_t length) {
+    UndoArena* arena = &history->arena;
+    UndoBlock* last = &arena->blocks.back();
+    if (cmd->block == arena->first_block + arena->blocks.size() - 1 && last->used + length <= last->capacity) {
+        memcpy(last->data + last->used, text, length);
+        last->used += length;
+    } else {
+        std::string joined = std::string(cmd->content, cmd->length) + std::string(text, length);
+        undo_arena_truncate(arena, cmd->block, cmd->offset);
+        undo_arena_append(arena, cmd, joined.data(), joined.size(), joined.size());
+    }
+    cmd->length += length;
+    history->bytes += length;
+    undo_enforce_budget(history);
+}
+
+// Record typing (an insert or delete at the cursor) at time `now` in seconds:
+// it extends the newest entry if that was typing of the same kind right next
+// to this edit and less than UNDO_MERGE_SECONDS ago, else it is pushed
+inline Command* undo_record(UndoHistory* history, CommandType type, size_t pos, const char* content, size_t length,
+                            double now) {
+    Command* top = history->count > 0 ? undo_entry(history, history->count - 1) : nullptr;
+    bool mergeable = top && history->current == history->count && history->group_depth == 0 &&
+                     top->typing && top->type == type && length > 0 && now - top->time < UNDO_MERGE_SECONDS;
+    if (mergeable && type == CMD_INSERT && pos == top->pos + top->length) {
+        undo_extend(history, top, content, length);
+    } else if (mergeable && type == CMD_DELETE && pos == top->pos && !top->reversed) {
+        undo_extend(history, top, content, length);  // Delete key: text after the run's
+    } else if (mergeable && type == CMD_DELETE && pos + length == top->pos) {
+        // Backspace: text before the run's, so the run is turned back to front
+        // (once) and the text appended reversed
+        if (!top->reversed) {
+            UndoBlock* block = &history->arena.blocks[top->block - history->arena.first_block];
+            std::reverse(block->data + top->offset, block->data + top->offset + top->length);
+            top->reversed = true;
+        }
+        std::string reversed(content, length);
+        std::reverse(reversed.begin(), reversed.end());
+        undo_extend(history, top, reversed.data(), length);
+        top->pos = pos;
+    } else {
+        top = undo_push(history, type, pos, content, length);
+        top->typing = true;
+    }
+    top->time = now;
+    return top;
+}
+
+// A command's text in document order (reversed Backspace runs are turned
+// around into scratch)
+inline const char* undo_command_text(const Command* cmd, std::string* scratch) {
+    if (!cmd->reversed) return cmd->content;
+    scratch->assign(cmd->content, cmd->length);
+    std::reverse(scratch->begin(), scratch->end());
+    return scratch->data();
+}
+
+// Bracket edits that undo and redo as one (groups may nest; the outermost
+// one counts)
+inline void undo_begin_group(UndoHistory* history) {
+    if (history->group_depth++ == 0) history->group_entries = 0;
+}
+
+inline void undo_commit_group(UndoHistory* history) {
+    if (history->group_depth > 0) history->group_depth--;
+}
+
+// The entry to undo (which then becomes the first to redo), or nullptr;
+// while it is joined, the one before it is to be undone as well
+inline Command* undo_step_back(UndoHistory* history) {
+    if (history->current == 0) return nullptr;
+    history->current--;
+    return undo_entry(history, history->current);
+}
+
+// The entry to redo, or nullptr; while the next one is joined (see
+// undo_next_joined), it is to be redone as well
+inline Command* undo_step_forward(UndoHistory* history) {
+    if (history->current == history->count) return nullptr;
+    history->current++;
+    return undo_entry(history, history->current - 1);
+}
+
+// Is the entry redo would take next part of the group just redone?
+inline bool undo_next_joined(UndoHistory* history) {
+    return history->current < history->count && undo_entry(history, history->current)->joined;
+}
+
+// Exchange a snapshot entry's version with the document's: O(1), whatever
+// the edit's size. The charge stays the one made when it was recorded.
+inline void undo_swap_version(Command* cmd, Rope* rope) {
+    std::swap(cmd->version, *rope);
+}
+
+inline void undo_free(UndoHistory* history) {
+    for (size_t i = 0; i < history->count; i++) {
+        undo_release_entry(history, undo_entry(history, i));
+    }
+    for (UndoBlock& block : history->arena.blocks) {
+        delete[] block.data;
+    }
+    history->arena.blocks.clear();
+    history->arena.bytes = 0;
+    delete[] history->entries;
+    history->entries = nullptr;
+    history->count = 0;
+    history->current = 0;
+    history->bytes = 0;
+}
+
+#endif // ZED_UNDO_H
@@ -97,8 +97,11 @@ TEST_CASE(test_undo_redo) {
 TEST_CASE(test_multiple_undos) {
     TestEditor te;
 
+    // More than UNDO_MERGE_SECONDS apart, so not merged into one entry
     te.type_text("A");
+    te.update(2.0f);
     te.type_text("B");
+    te.update(2.0f);
     te.type_text("C");
 
     te.press_ctrl('z');  // Undo C
@@ -111,6 +114,228 @@ TEST_CASE(test_multiple_undos) {
     TEST_ASSERT_STR_EQ("", te.get_text().c_str(), "After 3 undos");
 }
 
+// Undo history: oldest entries evicted by count and by memory budget, redo
+// entries dropped by a new edit, texts freed from the arena as they go
+TEST_CASE(test_undo_history_limits) {
+    UndoHistory history;
+    undo_init(&history, 4, 100);
+    char text[50];
+    for (int i = 0; i < 6; i++) {
+        memset(text, 'a' + i, sizeof(text));
+        undo_push(&history, CMD_INSERT, (size_t)i, text, 20);
+    }
+    TEST_ASSERT_EQ(4, undo_depth(&history), "Capped at four entries");
+    TEST_ASSERT_EQ('c', undo_entry(&history, 0)->content[0], "Oldest two evicted");
+
+    undo_push(&history, CMD_INSERT, 0, text, 50);
+    TEST_ASSERT_EQ(3, undo_depth(&history), "Budget evicts once the bytes pass it");
+    TEST_ASSERT_EQ(90, history.bytes, "Charged for what is kept");
+
+    TEST_ASSERT(undo_step_back(&history)->length == 50, "Undo takes the newest");
+    TEST_ASSERT_EQ(1, undo_redo_depth(&history), "Then it can be redone");
+    const char* dropped = undo_entry(&history, 2)->content;
+    undo_push(&history, CMD_DELETE, 0, "x", 1);
+    TEST_ASSERT_EQ(0, undo_redo_depth(&history), "A new edit drops the redo entry");
+    TEST_ASSERT_EQ(3, undo_depth(&history), "Undo entries kept");
+    TEST_ASSERT(dropped == undo_entry(&history, 2)->content, "Its text reuses the dropped one's space");
+
+    // An edit larger than the budget is kept until the next one
+    std::string big(UNDO_BLOCK_BYTES * 4, 'z');
+    undo_push(&history, CMD_DELETE, 0, big.data(), big.size());
+    TEST_ASSERT_EQ(1, undo_depth(&history), "Only the big edit left");
+    undo_push(&history, CMD_INSERT, 0, "y", 1);
+    TEST_ASSERT_EQ(1, undo_depth(&history), "Big edit evicted by the next");
+    TEST_ASSERT_EQ(UNDO_BLOCK_BYTES, history.arena.bytes, "Its arena block freed");
+    undo_free(&history);
+
+    // Through the editor: undo still walks back edit by edit
+    TestEditor te;
+    undo_free(&te.editor.undo);
+    undo_init(&te.editor.undo, 3, 1 << 20);
+    for (const char* key : {"a", "b", "c", "d", "e"}) {
+        te.type_text(key);
+        te.update(2.0f);
+    }
+    for (int i = 0; i < 4; i++) te.press_ctrl('z');
+    TEST_ASSERT_STR_EQ("ab", te.get_text().c_str(), "Only the last three edits undone");
+    te.press_ctrl('y');
+    TEST_ASSERT_STR_EQ("abc", te.get_text().c_str(), "Redo after eviction");
+}
+
+// Edits past Config::undo_snapshot_bytes keep the rope from the other side of
+// the edit: undo and redo swap it back in instead of copying the text
+TEST_CASE(test_undo_snapshots) {
+    TestEditor te;
+    te.config.undo_snapshot_bytes = 1000;
+    std::string text;
+    for (int i = 0; i < 300; i++) text += "line " + std::to_string(i) + "\n";
+    rope_from_string(&te.editor.rope, text.c_str());
+    te.editor.rope_version++;
+    RopeNode* root = te.editor.rope.root;
+
+    // Typing over the whole text: a snapshot delete, then the typing
+    te.press_ctrl('a');
+    te.type_text("X");
+    TEST_ASSERT_STR_EQ("X", te.get_text().c_str(), "Selection replaced");
+    TEST_ASSERT(undo_entry(&te.editor.undo, 0)->snapshot, "Large delete kept as a snapshot");
+    TEST_ASSERT(!undo_entry(&te.editor.undo, 1)->snapshot, "Typing still recorded as text");
+    TEST_ASSERT_EQ(text.size() + 1, te.editor.undo.bytes, "Charged for the text it removed");
+    te.press_ctrl('z');
+    TEST_ASSERT(te.get_text() == text, "Undone in one step");
+    TEST_ASSERT(te.editor.rope.root == root, "By swapping the old rope back in");
+    TEST_ASSERT_EQ(text.size(), te.get_cursor(), "Cursor after the restored text");
+    te.press_ctrl('y');
+    TEST_ASSERT_STR_EQ("X", te.get_text().c_str(), "Redone");
+    TEST_ASSERT_EQ(1, te.get_cursor(), "Cursor after the typing");
+    te.press_ctrl('z');
+    TEST_ASSERT(te.editor.rope.root == root, "Undone again");
+
+    // A large paste
+    te.press_ctrl('a');
+    te.press_ctrl('c');
+    te.editor.has_selection = false;
+    te.editor.cursor_pos = text.size();
+    te.press_ctrl('v');
+    TEST_ASSERT(te.get_text() == text + text, "Pasted");
+    TEST_ASSERT(undo_entry(&te.editor.undo, undo_depth(&te.editor.undo) - 1)->snapshot, "Paste kept as a snapshot");
+    te.press_ctrl('z');
+    TEST_ASSERT(te.get_text() == text, "Paste undone");
+    TEST_ASSERT(te.editor.rope.root == root, "Without touching the text");
+}
+
+// Snapshot entries count against Config::undo_memory whatever else shares
+// their ropes (here a background search), and are evicted like any other
+TEST_CASE(test_undo_snapshot_budget) {
+    TestEditor te;
+    std::string text;
+    for (int i = 0; text.size() < SEARCH_BACKGROUND_MIN_BYTES + (200 << 10); i++) {
+        text += "line " + std::to_string(i) + ": ab cd\n";
+    }
+    rope_from_string(&te.editor.rope, text.c_str());
+    te.editor.rope_version++;
+    te.config.undo_snapshot_bytes = 1000;
+    undo_free(&te.editor.undo);
+    undo_init(&te.editor.undo, 100, 600000);
+
+    // The search holds a snapshot of the text, so every node is shared
+    te.open_search();
+    te.type_text("ab");
+    TEST_ASSERT(te.editor.search_state->job != nullptr, "Background search running");
+    editor_delete_recorded(&te.editor, 0, 400000);
+    TEST_ASSERT(undo_entry(&te.editor.undo, 0)->snapshot, "Recorded as a snapshot");
+    TEST_ASSERT_EQ(400000, te.editor.undo.bytes, "Charged for the deleted text all the same");
+
+    editor_delete_recorded(&te.editor, 0, 400000);
+    TEST_ASSERT_EQ(1, undo_depth(&te.editor.undo), "The first snapshot evicted by the budget");
+    TEST_ASSERT_EQ(400000, te.editor.undo.bytes, "And its charge with it");
+    editor_search_wait(&te.editor);
+    TEST_ASSERT(te.get_text() == text.substr(800000), "Document unaffected");
+    editor_undo(&te.editor);
+    TEST_ASSERT(te.get_text() == text.substr(400000), "The kept snapshot undoes");
+    editor_redo(&te.editor);
+
+    // Replace-all rebuilds every node: charged for the whole document
+    size_t length = te.get_text_length();
+    SearchState* search = te.editor.search_state;
+    search->replacement[0] = 'X';
+    search->replacement_len = 1;
+    TEST_ASSERT(editor_replace_all(&te.editor) > 0, "Replaced");
+    TEST_ASSERT_EQ(length, te.editor.undo.bytes, "Charged for the text it rebuilt");
+    TEST_ASSERT_EQ(1, undo_depth(&te.editor.undo), "Over the budget: only the newest kept");
+}
+
+// Typing bursts merge into one undo entry; replacing a selection (typing or
+// paste) is one group, undone and redone at once
+TEST_CASE(test_undo_coalescing_and_groups) {
+    TestEditor te;
+    te.type_text("hello world");
+    TEST_ASSERT_EQ(1, undo_depth(&te.editor.undo), "A typing burst is one entry");
+    TEST_ASSERT_EQ(11, te.editor.undo.bytes, "Holding just the typed text");
+
+    for (int i = 0; i < 5; i++) te.press_backspace();
+    TEST_ASSERT_EQ(2, undo_depth(&te.editor.undo), "Backspaces after typing start a new entry");
+    te.press_ctrl('z');
+    TEST_ASSERT_STR_EQ("hello world", te.get_text().c_str(), "Backspace run undone at once");
+    TEST_ASSERT_EQ(11, te.get_cursor(), "Cursor back at the end of the run");
+
+    te.press_key(0xff50, 0);  // Home
+    for (int i = 0; i < 6; i++) te.press_key(0xff7f, 0);  // Delete
+    TEST_ASSERT_STR_EQ("world", te.get_text().c_str(), "Forward deletes applied");
+    te.update(2.0f);
+    te.type_text("big ");
+    TEST_ASSERT_EQ(3, undo_depth(&te.editor.undo), "Delete run and later typing are separate entries");
+    te.press_ctrl('z');
+    te.press_ctrl('z');
+    TEST_ASSERT_STR_EQ("hello world", te.get_text().c_str(), "Delete run undone at once");
+    te.press_ctrl('y');
+    TEST_ASSERT_STR_EQ("world", te.get_text().c_str(), "And redone at once");
+
+    // Typing elsewhere is not merged, even right away
+    te.press_ctrl('z');
+    te.press_key(0xff57, 0);  // End
+    te.type_text("!");
+    te.press_key(0xff50, 0);  // Home
+    te.type_text("> ");
+    te.press_ctrl('z');
+    TEST_ASSERT_STR_EQ("hello world!", te.get_text().c_str(), "Only the typing at the start undone");
+
+    // Typing over a selection, then more typing: one undo restores the selection text
+    te.press_ctrl('a');
+    te.type_text("X");
+    te.type_text("YZ");
+    TEST_ASSERT_STR_EQ("XYZ", te.get_text().c_str(), "Selection replaced");
+    te.press_ctrl('z');
+    TEST_ASSERT_STR_EQ("hello world!", te.get_text().c_str(), "Replacement and its deletion undone together");
+    te.press_ctrl('y');
+    TEST_ASSERT_STR_EQ("XYZ", te.get_text().c_str(), "And redone together");
+
+    // Paste over a selection is a group too
+    te.press_ctrl('a');
+    te.press_ctrl('c');
+    te.press_key(0xff57, 0);  // End
+    te.type_text("!");
+    te.press_ctrl('a');
+    te.press_ctrl('v');
+    TEST_ASSERT_STR_EQ("XYZ", te.get_text().c_str(), "Selection pasted over");
+    te.press_ctrl('z');
+    TEST_ASSERT_STR_EQ("XYZ!", te.get_text().c_str(), "Paste over selection undone in one step");
+
+    // A long burst costs one entry and its bytes, and one undo
+    TestEditor burst;
+    std::string text(20000, 'q');
+    burst.type_text(text.c_str());
+    TEST_ASSERT_EQ(1, undo_depth(&burst.editor.undo), "Twenty thousand keystrokes, one entry");
+    TEST_ASSERT(burst.editor.undo.arena.bytes <= 2 * UNDO_BLOCK_BYTES, "Arena holds little more than the text");
+    burst.press_ctrl('z');
+    TEST_ASSERT_EQ(0, burst.get_text_length(), "Undone in one step");
+
+    // A long Backspace run (after two forward deletes) only ever appends
+    UndoHistory history;
+    undo_init(&history, 10, 1 << 20);
+    std::string deleted;
+    for (int i = 0; i < 20000; i++) deleted += (char)('a' + i % 26);
+    undo_record(&history, CMD_DELETE, 19998, &deleted[19998], 1, 0.0);
+    undo_record(&history, CMD_DELETE, 19998, &deleted[19999], 1, 0.0);
+    for (size_t i = 19998; i-- > 0;) {
+        undo_record(&history, CMD_DELETE, i, &deleted[i], 1, 0.0);
+    }
+    TEST_ASSERT_EQ(1, undo_depth(&history), "One entry for the whole run");
+    Command* run = undo_entry(&history, 0);
+    TEST_ASSERT(run->reversed && run->content[0] == deleted.back(), "Kept back to front");
+    std::string scratch;
+    TEST_ASSERT(std::string(undo_command_text(run, &scratch), run->length) == deleted, "Read in document order");
+    TEST_ASSERT(history.arena.bytes <= 2 * UNDO_BLOCK_BYTES, "Arena holds little more than the text");
+    undo_record(&history, CMD_DELETE, 0, "z", 1, 0.0);
+    TEST_ASSERT_EQ(2, undo_depth(&history), "Forward delete after a Backspace run starts a new entry");
+    undo_free(&history);
+
+    burst.type_text("hello world");
+    burst.update(2.0f);
+    for (int i = 0; i < 5; i++) burst.press_backspace();
+    burst.press_ctrl('z');
+    TEST_ASSERT_STR_EQ("hello world", burst.get_text().c_str(), "Reversed run undone in order");
+}
+
 // Cursor left/right
 TEST_CASE(test_cursor_movement_arrows) {
     TestEditor te;
@@ -298,6 +523,150 @@ TEST_CASE(test_mouse_click_beyond_line_end) {
     printf("[TEST] Mouse click beyond line end test passed\n");
 }
 
+// Line index built alongside the cached text
+TEST_CASE(test_line_index) {
+    TestEditor te;
+
+    te.type_text("ab");
+    te.press_enter();
+    te.press_enter();
+    te.type_text("cde");
+
+    TEST_ASSERT(editor_refresh_text_cache(&te.editor), "Stale cache should be rebuilt");
+    TEST_ASSERT(!editor_refresh_text_cache(&te.editor), "Fresh cache should be kept");
+    TEST_ASSERT_EQ(3, te.editor.line_starts.size(), "Three lines");
+
+    size_t start, end;
+    editor_line_range(&te.editor, 0, &start, &end);
+    TEST_ASSERT_EQ(0, start, "Line 0 start");
+    TEST_ASSERT_EQ(2, end, "Line 0 end excludes newline");
+    editor_line_range(&te.editor, 1, &start, &end);
+    TEST_ASSERT_EQ(start, end, "Line 1 is empty");
+    editor_line_range(&te.editor, 2, &start, &end);
+    TEST_ASSERT_EQ(4, start, "Line 2 start");
+    TEST_ASSERT_EQ(7, end, "Line 2 runs to end of text");
+
+    TEST_ASSERT_EQ(0, editor_line_of_offset(&te.editor, 0), "Offset 0 on line 0");
+    TEST_ASSERT_EQ(0, editor_line_of_offset(&te.editor, 2), "Newline belongs to its line");
+    TEST_ASSERT_EQ(1, editor_line_of_offset(&te.editor, 3), "Empty line");
+    TEST_ASSERT_EQ(2, editor_line_of_offset(&te.editor, 7), "End of text on last line");
+
+    te.press_backspace();
+    editor_refresh_text_cache(&te.editor);
+    TEST_ASSERT_EQ(6, te.editor.cached_text_length, "Length tracks edits");
+}
+
+// Damage tracking: edits, cursor moves and blinks mark the editor dirty
+TEST_CASE(test_dirty_tracking) {
+    TestEditor te;
+
+    te.editor.dirty = 0;
+    te.type_text("abc");
+    TEST_ASSERT(te.editor.dirty & EDITOR_DIRTY_TEXT, "Typing marks text dirty");
+    TEST_ASSERT(te.editor.dirty & EDITOR_DIRTY_CURSOR, "Typing moves the cursor");
+
+    te.editor.dirty = 0;
+    te.press_key(0xff51);  // Left
+    TEST_ASSERT_EQ(EDITOR_DIRTY_CURSOR, te.editor.dirty, "Cursor move only marks cursor dirty");
+
+    // Nothing changes before the blink deadline
+    te.editor.dirty = 0;
+    te.update(editor_time_until_update(&te.editor) * 0.5f);
+    TEST_ASSERT_EQ(0, te.editor.dirty, "No redraw before blink deadline");
+
+    // Crossing it toggles the cursor, even after a long idle period
+    te.update(editor_time_until_update(&te.editor) + 0.01f);
+    TEST_ASSERT(te.editor.dirty & EDITOR_DIRTY_CURSOR, "Blink marks cursor dirty");
+    TEST_ASSERT(!te.editor.cursor_visible, "Cursor hidden after blink");
+
+    te.editor.dirty = 0;
+    te.update(10.25f);
+    TEST_ASSERT(te.editor.cursor_blink_time < 1.0f, "Blink phase wraps after idling");
+}
+
+// Input coalescing: motion collapses to the latest position, repeats merge
+TEST_CASE(test_event_coalescing) {
+    PlatformEvent events[8];
+    memset(events, 0, sizeof(events));
+    events[0].type = PLATFORM_EVENT_MOUSE_MOVE;
+    events[0].mouse_move.x = 10;
+    events[1].type = PLATFORM_EVENT_MOUSE_MOVE;
+    events[1].mouse_move.x = 20;
+    events[2] = make_key_event(0xff08, 0, "");
+    events[3] = make_key_event(0xff08, 0, "");
+    events[3].type = PLATFORM_EVENT_KEY_RELEASE;  // Non-detectable auto-repeat pair
+    events[4] = make_key_event(0xff08, 0, "");
+    events[5] = make_key_event(0xff08, 0, "");
+    events[6] = make_mouse_event(30, 0, 1);
+    events[7].type = PLATFORM_EVENT_MOUSE_MOVE;
+    events[7].mouse_move.x = 40;
+
+    int count = platform_coalesce_events(events, 8);
+    TEST_ASSERT_EQ(4, count, "Moves and repeats coalesced");
+    TEST_ASSERT_EQ(20, events[0].mouse_move.x, "Latest mouse position kept");
+    TEST_ASSERT_EQ(PLATFORM_EVENT_KEY_PRESS, events[1].type, "Key press kept");
+    TEST_ASSERT_EQ(2, events[1].key.repeat, "Three presses merged");
+    TEST_ASSERT_EQ(PLATFORM_EVENT_MOUSE_BUTTON, events[2].type, "Button keeps its place");
+    TEST_ASSERT_EQ(40, events[3].mouse_move.x, "Move after a button is not merged across it");
+}
+
+// A merged key repeat applies as one batched edit
+TEST_CASE(test_key_repeat_batch) {
+    TestEditor te;
+
+    PlatformEvent event = make_text_event("a");
+    event.key.repeat = 3;
+    editor_handle_event(&te.editor, &event, nullptr, nullptr);
+    TEST_ASSERT_STR_EQ("aaaa", te.get_text().c_str(), "Repeated character inserted");
+    TEST_ASSERT_EQ(1, undo_depth(&te.editor.undo), "One edit for the run");
+
+    te.type_text("\xC3\xA9");  // e-acute as two bytes
+    event = make_key_event(0xff51, 0, "");  // Left
+    event.key.repeat = 1;
+    editor_handle_event(&te.editor, &event, nullptr, nullptr);
+    TEST_ASSERT_EQ(3, te.get_cursor(), "Left moves by whole characters");
+
+    event = make_key_event(0xff08, 0, "");  // Backspace
+    event.key.repeat = 9;
+    editor_handle_event(&te.editor, &event, nullptr, nullptr);
+    TEST_ASSERT_STR_EQ("a\xC3\xA9", te.get_text().c_str(), "Backspace stops at start of text");
+    TEST_ASSERT_EQ(0, te.get_cursor(), "Cursor at start");
+
+    te.press_ctrl('z');
+    TEST_ASSERT_STR_EQ("aaaa\xC3\xA9", te.get_text().c_str(), "Batched delete undoes in one step");
+
+    // Held Enter in the search box steps one match per repeat
+    te.open_search();
+    te.type_text("a");
+    size_t first = te.editor.search_state->current_match_index;
+    event = make_key_event(0xff0d, 0, "");  // Enter
+    event.key.repeat = 2;
+    editor_handle_event(&te.editor, &event, nullptr, nullptr);
+    TEST_ASSERT_EQ((first + 3) % 4, te.editor.search_state->current_match_index, "Each repeat advances a match");
+}
+
+// Hit testing through the line index and cached x prefix sums
+TEST_CASE(test_mouse_hit_test) {
+    TestEditor te;
+    te.type_text("ab\n\xC3\xA9x\nlast");  // Line 1 starts with a 2-byte character
+    editor_refresh_text_cache(&te.editor);
+
+    // Fixed 10px advance per character; both bytes of e-acute share an x
+    const float xs[] = {0, 10, 20,  0, 0, 10, 20,  0, 10, 20, 30, 40};
+    te.editor.layout_cache.char_positions.assign(xs, xs + 12);
+    te.editor.layout_cache.valid = true;
+
+    const char* text = te.editor.cached_text;
+    float lh = 20.0f;
+    TEST_ASSERT_EQ(1, editor_mouse_to_pos(&te.editor, text, 6.0f, 5.0f, 0, 0, lh), "Nearest character on line 0");
+    TEST_ASSERT_EQ(2, editor_mouse_to_pos(&te.editor, text, 50.0f, 5.0f, 0, 0, lh), "Past line end lands on newline");
+    TEST_ASSERT_EQ(3, editor_mouse_to_pos(&te.editor, text, 4.0f, 25.0f, 0, 0, lh), "Multi-byte character at its first byte");
+    TEST_ASSERT_EQ(5, editor_mouse_to_pos(&te.editor, text, 6.0f, 25.0f, 0, 0, lh), "Closer to the next character");
+    TEST_ASSERT_EQ(8, editor_mouse_to_pos(&te.editor, text, 14.0f, 45.0f, 0, 0, lh), "Last line");
+    TEST_ASSERT_EQ(11, editor_mouse_to_pos(&te.editor, text, 45.0f, 45.0f, 0, 0, lh), "Past end of text");
+    TEST_ASSERT_EQ(11, editor_mouse_to_pos(&te.editor, text, 5.0f, 500.0f, 0, 0, lh), "Below all lines");
+}
+
 // Main function
 int main() {
     return run_all_tests();
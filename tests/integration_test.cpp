@@ -46,10 +46,12 @@ TEST_CASE(test_search_modify_workflow) {
 TEST_CASE(test_complex_undo_redo) {
     TestEditor te;
 
-    te.type_text("A");
-    te.type_text("B");
-    te.type_text("C");
-    te.type_text("D");
+    // Typed apart, so each is its own undo entry
+    const char* keys[] = {"A", "B", "C", "D"};
+    for (const char* key : keys) {
+        te.type_text(key);
+        te.update(2.0f);
+    }
 
     // Undo all
     te.press_ctrl('z');
@@ -4,6 +4,7 @@
 #include <cstdio>
 #include <cstring>
 #include <cassert>
+#include <string>
 
 void test_rope_creation() {
     printf("Test: Rope creation...\n");
@@ -48,6 +49,13 @@ void test_rope_insert() {
     assert(strcmp(str, ">> Hello World! <<") == 0);
     delete[] str;
 
+    // Text larger than a leaf, into the middle of one
+    std::string big(3 * ROPE_NODE_CAPACITY + 7, 'x');
+    rope_insert(&rope, 3, big.c_str(), big.size());
+    str = rope_to_string(&rope);
+    assert(">> " + big + "Hello World! <<" == str);
+    delete[] str;
+
     rope_free(&rope);
     printf("  PASSED\n");
 }
@@ -122,6 +130,123 @@ void test_rope_large() {
     printf("  PASSED\n");
 }
 
+void test_rope_snapshot() {
+    printf("Test: Rope snapshot...\n");
+
+    Rope rope;
+    rope_init(&rope);
+    for (int i = 0; i < 1000; i++) {
+        char line[128];
+        snprintf(line, sizeof(line), "This is line %d\n", i);
+        rope_insert(&rope, rope_length(&rope), line, strlen(line));
+    }
+    char* original = rope_to_string(&rope);
+
+    Rope snapshot;
+    rope_snapshot(&rope, &snapshot);
+
+    // Edits to the rope copy shared nodes instead of changing them
+    rope_insert(&rope, 0, ">> ", 3);
+    rope_delete(&rope, 5000, 2000);
+    rope_insert(&rope, rope_length(&rope) / 2, "middle", 6);
+
+    char* str = rope_to_string(&snapshot);
+    assert(rope_length(&snapshot) == strlen(original));
+    assert(strcmp(str, original) == 0);
+    delete[] str;
+
+    // The snapshot can be released first; the rope is unaffected
+    size_t length = rope_length(&rope);
+    rope_free(&snapshot);
+    str = rope_to_string(&rope);
+    assert(strlen(str) == length);
+    assert(strncmp(str, ">> This is line 0\n", 18) == 0);
+    delete[] str;
+
+    delete[] original;
+    rope_free(&rope);
+    printf("  PASSED\n");
+}
+
+// Heights of every node's children differ by at most one
+static int check_balanced(RopeNode* node) {
+    if (!node) return 0;
+    int left = check_balanced(node->left);
+    int right = check_balanced(node->right);
+    assert(left - right <= 1 && right - left <= 1);
+    assert(node->height == 1 + std::max(left, right));
+    return node->height;
+}
+
+void test_rope_splice() {
+    printf("Test: Rope splice...\n");
+
+    Rope rope;
+    rope_init(&rope);
+    std::string expected;
+    for (int i = 0; i < 2000; i++) {
+        char line[128];
+        snprintf(line, sizeof(line), "This is line %d\n", i);
+        rope_insert(&rope, rope_length(&rope), line, strlen(line));
+        expected += line;
+    }
+
+    Rope snapshot;
+    rope_snapshot(&rope, &snapshot);
+
+    // Every "line" becomes "row", [10000, 20000) is removed, and "end" appended
+    std::vector<RopeSplice> splices;
+    bool removed = false;
+    for (size_t pos = expected.find("line"); pos != std::string::npos; pos = expected.find("line", pos + 4)) {
+        if (pos + 4 > 10000 && pos < 20000) continue;
+        if (pos >= 20000 && !removed) {
+            splices.push_back(RopeSplice{10000, 10000, "", 0});
+            removed = true;
+        }
+        splices.push_back(RopeSplice{pos, 4, "row", 3});
+    }
+    splices.push_back(RopeSplice{expected.size(), 0, "end", 3});
+
+    std::string result;
+    size_t from = 0;
+    for (const RopeSplice& splice : splices) {
+        result += expected.substr(from, splice.pos - from);
+        result.append(splice.text, splice.length);
+        from = splice.pos + splice.removed;
+    }
+
+    rope_splice(&rope, splices.data(), splices.size());
+    assert(rope_length(&rope) == result.size());
+    char* str = rope_to_string(&rope);
+    assert(result == str);
+    delete[] str;
+    check_balanced(rope.root);
+
+    // The snapshot (sharing untouched leaves) still reads the old text
+    str = rope_to_string(&snapshot);
+    assert(expected == str);
+    delete[] str;
+    rope_free(&snapshot);
+
+    // The rebuilt rope edits normally
+    rope_insert(&rope, 5, "XY", 2);
+    rope_delete(&rope, 0, 3);
+    result.insert(5, "XY");
+    result.erase(0, 3);
+    str = rope_to_string(&rope);
+    assert(result == str);
+    delete[] str;
+
+    // Splicing everything away leaves an empty rope
+    RopeSplice all = {0, rope_length(&rope), "", 0};
+    rope_splice(&rope, &all, 1);
+    assert(rope_length(&rope) == 0);
+    assert(rope.root == nullptr);
+
+    rope_free(&rope);
+    printf("  PASSED\n");
+}
+
 int main() {
     printf("Running rope tests...\n\n");
 
@@ -130,6 +255,8 @@ int main() {
     test_rope_delete();
     test_rope_char_at();
     test_rope_large();
+    test_rope_snapshot();
+    test_rope_splice();
 
     printf("\nAll tests passed!\n");
     return 0;
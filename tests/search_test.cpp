@@ -3,6 +3,9 @@
 
 #include "test_framework.h"
 
+#include <chrono>
+#include <regex>
+
 // Basic search open/close
 TEST_CASE(test_search_open_close) {
     TestEditor te;
@@ -237,6 +240,825 @@ TEST_CASE(test_search_preserves_query) {
     TEST_ASSERT_STR_EQ("World", te.get_search_query().c_str(), "Query preserved");
 }
 
+// Reference: the original naive search (O(n*m), tolower per byte)
+static std::vector<size_t> naive_search(const char* text, size_t text_len,
+                                        const char* query, size_t query_len, bool case_sensitive) {
+    std::vector<size_t> matches;
+    if (query_len == 0 || text_len < query_len) return matches;
+    for (size_t i = 0; i <= text_len - query_len; i++) {
+        bool match = true;
+        for (size_t j = 0; j < query_len; j++) {
+            char text_ch = text[i + j];
+            char query_ch = query[j];
+            if (!case_sensitive) {
+                text_ch = tolower(text_ch);
+                query_ch = tolower(query_ch);
+            }
+            if (text_ch != query_ch) {
+                match = false;
+                break;
+            }
+        }
+        if (match) matches.push_back(i);
+    }
+    return matches;
+}
+
+// Deterministic pseudo-random sequence for the generated test texts
+static unsigned next_random(unsigned* state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state;
+}
+
+// Words picked at random from the list (seeded, so the same every run), each
+// followed by a space or, about one time in line_every, a newline; stops once
+// the text reaches size bytes, after a whole word
+static std::string make_word_soup(const char* const* words, size_t count, unsigned seed, size_t size,
+                                  unsigned line_every) {
+    std::string text;
+    text.reserve(size + 64);
+    unsigned state = seed;
+    while (text.size() < size) {
+        unsigned r = next_random(&state);
+        text += words[(r >> 16) % count];
+        text += ((r >> 8) % line_every == 0) ? '\n' : ' ';
+    }
+    return text;
+}
+
+// Deterministic word soup with some upper case and newlines
+static std::string make_search_corpus(size_t size, unsigned seed) {
+    static const char* words[] = {"the", "search", "Engine", "rope", "leaf", "needle", "haystack",
+                                  "THE", "performance", "abab", "aaaa", "x", "{", "}", "\xC3\xA9t\xC3\xA9"};
+    std::string text = make_word_soup(words, sizeof(words) / sizeof(words[0]), seed, size, 11);
+    text.resize(size);
+    return text;
+}
+
+// Rope built from many small uneven inserts, so matches straddle leaves
+static void rope_from_pieces(Rope* rope, const std::string& text) {
+    rope_init(rope);
+    for (size_t pos = 0; pos < text.size(); ) {
+        size_t piece = std::min<size_t>(1 + (pos * 7919) % 37, text.size() - pos);
+        rope_insert(rope, pos, text.data() + pos, piece);
+        pos += piece;
+    }
+}
+
+static std::vector<size_t> engine_search(Rope* rope, const char* query, bool case_sensitive) {
+    SearchPattern pattern;
+    search_pattern_init(&pattern, query, strlen(query), case_sensitive);
+    std::vector<size_t> matches;
+    search_rope(&pattern, rope, &matches);
+    return matches;
+}
+
+// Engine agrees with the naive search for every strategy, including matches
+// that straddle rope leaves
+TEST_CASE(test_search_engine_matches_naive) {
+    const char* queries[] = {"e", "E", "{", "ab", "aba", "aaa", "the", "THE", "needle haystack",
+                             "performance", "ENGINE rope", "\xC3\xA9t", "zzz"};
+
+    // Build the rope from many small inserts so leaves are short and uneven
+    std::string text = make_search_corpus(20000, 7);
+    Rope rope;
+    rope_init(&rope);
+    for (size_t pos = 0; pos < text.size(); ) {
+        size_t piece = 1 + (pos * 7919) % 37;
+        piece = std::min(piece, text.size() - pos);
+        rope_insert(&rope, pos, text.data() + pos, piece);
+        pos += piece;
+    }
+    TEST_ASSERT_EQ(text.size(), rope_length(&rope), "Rope holds corpus");
+
+    for (const char* query : queries) {
+        for (int cs = 0; cs < 2; cs++) {
+            std::vector<size_t> expected = naive_search(text.data(), text.size(), query, strlen(query), cs);
+            std::vector<size_t> actual = engine_search(&rope, query, cs);
+            if (expected != actual) {
+                printf("    query '%s' case_sensitive=%d: expected %zu matches, got %zu\n",
+                       query, cs, expected.size(), actual.size());
+            }
+            TEST_ASSERT(expected == actual, "Engine matches naive search");
+        }
+    }
+    rope_free(&rope);
+}
+
+// Case-insensitive search folds non-ASCII letters too ("Café" finds "CAFÉ"),
+// including letters whose cases differ in their lead byte (Cyrillic, Greek).
+// The reference is each word and query with its simple case folding written
+// out by hand, searched byte for byte.
+TEST_CASE(test_search_unicode_case_folding) {
+    static const char* words[][2] = {
+        {"Café", "café"}, {"CAFÉ", "café"}, {"café", "café"}, {"cafe", "cafe"}, {"Straße", "straße"},
+        {"ΣΟΦΊΑ", "σοφία"}, {"σοφία", "σοφία"}, {"σοφίας", "σοφίασ"}, {"Привет", "привет"},
+        {"ПРИВЕТ", "привет"}, {"привет", "привет"}, {"Ωmega", "ωmega"}, {"ωMEGA", "ωmega"},
+        {"naïve", "naïve"}, {"NAÏVE", "naïve"}, {"日本語", "日本語"}, {"Ǆemal", "ǆemal"},
+        {"ǆemal", "ǆemal"}, {"x", "x"}};
+    // The same seed picks the same words from either column
+    size_t word_count = sizeof(words) / sizeof(words[0]);
+    std::vector<const char*> originals, folds;
+    for (const auto& word : words) {
+        originals.push_back(word[0]);
+        folds.push_back(word[1]);
+    }
+    std::string text = make_word_soup(originals.data(), word_count, 17, 30000, 7);
+    std::string folded_text = make_word_soup(folds.data(), word_count, 17, 30000, 7);
+    TEST_ASSERT_EQ(text.size(), folded_text.size(), "Folds keep UTF-8 lengths");
+    Rope rope;
+    rope_from_pieces(&rope, text);
+
+    static const char* queries[][2] = {
+        {"café", "café"}, {"CAFÉ", "café"}, {"é", "é"}, {"σοφ", "σοφ"}, {"Σ", "σ"}, {"ς", "σ"},
+        {"ΣΟΦΊΑΣ", "σοφίασ"}, {"привет", "привет"}, {"пРИ", "при"}, {"Ω", "ω"}, {"ωmega x", "ωmega x"},
+        {"ÏVE", "ïve"}, {"日本", "日本"}, {"ǅEMAL", "ǆemal"}, {"straSSe", "strasse"}, {"cafe", "cafe"}};
+    for (const auto& query : queries) {
+        std::vector<size_t> expected = naive_search(folded_text.data(), folded_text.size(),
+                                                    query[1], strlen(query[1]), true);
+        std::vector<size_t> actual = engine_search(&rope, query[0], false);
+        if (expected != actual) {
+            printf("    query '%s': expected %zu matches, got %zu\n", query[0], expected.size(), actual.size());
+        }
+        TEST_ASSERT(expected == actual, "Unicode case-insensitive matches agree with the reference");
+    }
+    TEST_ASSERT(!naive_search(folded_text.data(), folded_text.size(), "σοφίασ", strlen("σοφίασ"), true).empty(),
+                "Final sigma folds like sigma");
+
+    std::vector<size_t> cafe = engine_search(&rope, "Café", false);
+    std::vector<size_t> exact = engine_search(&rope, "Café", true);
+    TEST_ASSERT(cafe.size() > exact.size() && !exact.empty(), "Case-sensitive search still exact");
+
+    SearchPattern pattern;
+    search_pattern_init(&pattern, "ΩΣ", strlen("ΩΣ"), false);
+    TEST_ASSERT(pattern.use_scan, "No case-invariant byte: positions are verified one by one");
+    search_pattern_init(&pattern, "cafe", 4, false);
+    TEST_ASSERT(!pattern.unicode, "ASCII needles keep the byte path");
+    rope_free(&rope);
+
+    // Through the editor, including refining as the query grows
+    TestEditor te;
+    te.type_text("CAFÉ café Café cafe ПРИВЕТ привет");
+    te.open_search();
+    te.type_text("caf");
+    TEST_ASSERT_EQ((size_t)4, te.get_search_matches(), "ASCII prefix matches all four");
+    te.type_text("é");
+    TEST_ASSERT_EQ((size_t)3, te.get_search_matches(), "Refined by code point");
+    for (int i = 0; i < 5; i++) te.press_backspace();  // Bytes, not characters
+    te.type_text("Привет");
+    TEST_ASSERT_EQ((size_t)2, te.get_search_matches(), "Cyrillic matches both cases");
+}
+
+// The parallel scan finds exactly what the single-threaded scan does, for any
+// thread count and however the ranges fall (small ranges force many boundaries)
+TEST_CASE(test_search_parallel_matches_sequential) {
+    const char* queries[] = {"e", "{", "ab", "aaa", "the", "needle haystack", "ENGINE rope", "zzz"};
+
+    std::string text = make_search_corpus(200000, 3);
+    Rope rope;
+    rope_init(&rope);
+    for (size_t pos = 0; pos < text.size(); ) {
+        size_t piece = std::min<size_t>(1 + (pos * 7919) % 301, text.size() - pos);
+        rope_insert(&rope, pos, text.data() + pos, piece);
+        pos += piece;
+    }
+
+    size_t thread_counts[] = {1, 2, 3, 8};
+    size_t range_sizes[] = {SEARCH_RANGE_BYTES, 4096, 700};
+    for (const char* query : queries) {
+        for (int cs = 0; cs < 2; cs++) {
+            std::vector<size_t> expected = engine_search(&rope, query, cs);
+            SearchPattern pattern;
+            search_pattern_init(&pattern, query, strlen(query), cs);
+            for (size_t threads : thread_counts) {
+                for (size_t range_bytes : range_sizes) {
+                    std::vector<size_t> actual;
+                    search_rope_parallel(&pattern, &rope, threads, &actual, range_bytes);
+                    if (expected != actual) {
+                        printf("    query '%s' case_sensitive=%d threads=%zu range=%zu: expected %zu, got %zu\n",
+                               query, cs, threads, range_bytes, expected.size(), actual.size());
+                    }
+                    TEST_ASSERT(expected == actual, "Parallel scan matches single-threaded scan");
+                }
+            }
+        }
+    }
+    rope_free(&rope);
+}
+
+// Growing the query filters the previous matches instead of rescanning; the
+// result must equal a full scan, including across leaf boundaries
+TEST_CASE(test_search_refine) {
+    const char* prefixes[] = {"e", "ne", "a", "th", "ENGINE", "\xC3\xA9", "x x", "needle n"};
+    const char* queries[] = {"ee", "needle ", "abab", "the", "engine rope", "\xC3\xA9t\xC3\xA9", "x x x",
+                             "needle needle"};
+
+    // Short uneven leaves (many straddles), then full leaves (candidates far apart)
+    std::string text = make_search_corpus(50000, 5);
+    for (int build = 0; build < 2; build++) {
+        Rope rope;
+        rope_init(&rope);
+        if (build == 0) {
+            for (size_t pos = 0; pos < text.size(); ) {
+                size_t piece = std::min<size_t>(1 + (pos * 7919) % 37, text.size() - pos);
+                rope_insert(&rope, pos, text.data() + pos, piece);
+                pos += piece;
+            }
+        } else {
+            rope_from_string(&rope, text.c_str());
+        }
+
+        for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+            for (int cs = 0; cs < 2; cs++) {
+                std::vector<size_t> candidates = engine_search(&rope, prefixes[q], cs);
+                std::vector<size_t> expected = engine_search(&rope, queries[q], cs);
+                SearchPattern pattern;
+                search_pattern_init(&pattern, queries[q], strlen(queries[q]), cs);
+                size_t count = search_refine(&pattern, &rope, strlen(prefixes[q]),
+                                             candidates.data(), candidates.size());
+                candidates.resize(count);
+                TEST_ASSERT(expected == candidates, "Refined matches equal a full scan");
+            }
+        }
+        rope_free(&rope);
+    }
+
+    // Through the editor: each keystroke refines, backspace falls back to a scan
+    TestEditor te;
+    te.type_text("the theme then thesis other");
+    te.open_search();
+    te.type_text("th");
+    TEST_ASSERT_EQ(5, te.get_search_matches(), "'th' matches");
+    te.type_text("e");
+    TEST_ASSERT_EQ(5, te.get_search_matches(), "'the' refined");
+    te.type_text("s");
+    TEST_ASSERT_EQ(1, te.get_search_matches(), "'thes' refined");
+    TEST_ASSERT_EQ(15, te.get_cursor(), "Cursor on the refined first match");
+    te.press_backspace();
+    te.press_backspace();
+    TEST_ASSERT_EQ(5, te.get_search_matches(), "Shorter query rescans");
+    te.press_key('c', PLATFORM_MOD_CTRL | PLATFORM_MOD_ALT);
+    te.type_text("M");
+    TEST_ASSERT_EQ(0, te.get_search_matches(), "Case-sensitive 'thM' after toggling");
+}
+
+// Edits patch the match list in place (drop, shift, rescan near the edit); after
+// every edit it must equal a full scan of the new text
+TEST_CASE(test_search_edit_maintenance) {
+    TestEditor te;
+    std::string text = make_search_corpus(20000, 9);
+    editor_rope_insert(&te.editor, 0, text.data(), text.size());
+
+    te.open_search();
+    te.type_text("aba");
+    TEST_ASSERT(te.get_search_matches() > 0, "Initial matches");
+
+    // Inserts that create, split and extend matches; deletes that join and destroy them
+    const char* inserts[] = {"ab", "a", "b", "abab", "x", "\n", "ABA"};
+    unsigned state = 1;
+    for (int i = 0; i < 300; i++) {
+        next_random(&state);
+        size_t length = rope_length(&te.editor.rope);
+        size_t pos = (state >> 8) % (length + 1);
+        if (i % 3 == 2 && length > 0) {
+            size_t count = std::min<size_t>(1 + (state >> 4) % 9, length - std::min(pos, length - 1));
+            editor_rope_delete(&te.editor, std::min(pos, length - 1), count);
+        } else {
+            const char* insert = inserts[(state >> 16) % (sizeof(inserts) / sizeof(inserts[0]))];
+            editor_rope_insert(&te.editor, pos, insert, strlen(insert));
+        }
+
+        TEST_ASSERT_EQ(te.editor.rope_version, te.editor.search_state->rope_version_at_search,
+                       "Matches kept current without a rerun");
+        std::vector<size_t> expected = engine_search(&te.editor.rope, "aba", false);
+        SearchState* search = te.editor.search_state;
+        bool same = expected.size() == search->match_count &&
+                    std::equal(expected.begin(), expected.end(), search->match_positions);
+        if (!same) {
+            printf("    edit %d at %zu: expected %zu matches, have %zu\n", i, pos, expected.size(),
+                   search->match_count);
+        }
+        TEST_ASSERT(same, "Patched matches equal a full scan");
+    }
+
+    // Undo goes through the same path (Ctrl+Z is taken by the open search box)
+    std::string before = te.get_text();
+    editor_insert_recorded(&te.editor, 10, "abab", 4);
+    editor_delete_recorded(&te.editor, 100, 7);
+    std::string edited = te.get_text();
+    editor_undo(&te.editor);
+    TEST_ASSERT(te.get_text() != edited, "Undo reverted the delete");
+    std::vector<size_t> expected = engine_search(&te.editor.rope, "aba", false);
+    TEST_ASSERT_EQ(expected.size(), te.get_search_matches(), "Matches follow the first undo");
+    editor_undo(&te.editor);
+    TEST_ASSERT(te.get_text() == before, "Undo reverted the insert");
+    expected = engine_search(&te.editor.rope, "aba", false);
+    TEST_ASSERT_EQ(expected.size(), te.get_search_matches(), "Matches follow the second undo");
+}
+
+// Deterministic log lines, some of them errors with timeouts
+static std::string make_log_corpus(size_t size, unsigned seed) {
+    static const char* levels[] = {"INFO", "DEBUG", "WARN", "ERROR", "error"};
+    static const char* messages[] = {"request done", "db timeout=", "retry in 30ms", "timeout=x",
+                                     "cache miss key=abab", "upstream timeout=", "ok"};
+    std::string text;
+    text.reserve(size + 64);
+    unsigned state = seed;
+    while (text.size() < size) {
+        next_random(&state);
+        text += levels[(state >> 16) % 5];
+        text += " req=";
+        text += std::to_string((state >> 4) % 1000);
+        text += ' ';
+        const char* message = messages[(state >> 20) % 7];
+        text += message;
+        if (message[strlen(message) - 1] == '=') {
+            text += std::to_string((state >> 8) % 5000);
+        }
+        text += ((state >> 12) % 4 == 0) ? " tail\n" : "\n";
+    }
+    text.resize(size);
+    return text;
+}
+
+static bool regex_matches(Rope* rope, const char* pattern, bool case_sensitive,
+                          std::vector<size_t>* starts, std::vector<size_t>* lengths) {
+    Regex* regex = new Regex();
+    bool ok = regex_compile(regex, pattern, strlen(pattern), case_sensitive);
+    if (ok) {
+        regex_search_rope(regex, rope, starts, lengths);
+    }
+    delete regex;
+    return ok;
+}
+
+// The regex engine finds the same leftmost-first matches as std::regex
+// (ECMAScript) for patterns that can't match the empty string
+TEST_CASE(test_regex_matches_std_regex) {
+    const char* patterns[] = {"ERROR.*timeout=\\d+", "timeout=\\d{2,3}", "a[bc]+", "(ab|ba)+",
+                              "req=[0-9]+ (db|upstream)", "\\w+ing", "e.?e", "(?:ab)*c", "x{1,2}",
+                              "[^ \\n]+e", "the|needle|haystack", "re.+?s", "[A-Z]{4,}", "\\s\\S",
+                              "(a|ab)(c|bcd)", "[\\x41-\\x45]+", "o*k", "E.*?r"};
+
+    std::string text = make_log_corpus(20000, 5) + make_search_corpus(20000, 9);
+    Rope rope;
+    rope_from_pieces(&rope, text);
+
+    for (const char* pattern : patterns) {
+        for (int cs = 0; cs < 2; cs++) {
+            std::vector<size_t> starts, lengths;
+            TEST_ASSERT(regex_matches(&rope, pattern, cs, &starts, &lengths), "Pattern compiles");
+
+            std::regex reference(pattern, cs ? std::regex::ECMAScript
+                                             : std::regex::ECMAScript | std::regex::icase);
+            std::vector<size_t> expected_starts, expected_lengths;
+            for (auto it = std::sregex_iterator(text.begin(), text.end(), reference);
+                 it != std::sregex_iterator(); ++it) {
+                expected_starts.push_back(it->position());
+                expected_lengths.push_back(it->length());
+            }
+            if (expected_starts != starts || expected_lengths != lengths) {
+                printf("    pattern '%s' case_sensitive=%d: expected %zu matches, got %zu\n",
+                       pattern, cs, expected_starts.size(), starts.size());
+            }
+            TEST_ASSERT(expected_starts == starts, "Same match starts as std::regex");
+            TEST_ASSERT(expected_lengths == lengths, "Same match lengths as std::regex");
+        }
+    }
+    rope_free(&rope);
+}
+
+// Line anchors, empty matches, syntax errors and patterns that make
+// backtracking engines take exponential time
+TEST_CASE(test_regex_anchors_and_errors) {
+    Rope rope;
+    rope_init(&rope);
+    rope_from_string(&rope, "ERROR a\nINFO ERROR b\nERROR\n");
+    std::vector<size_t> starts, lengths;
+
+    TEST_ASSERT(regex_matches(&rope, "^ERROR", true, &starts, &lengths), "Anchored pattern compiles");
+    TEST_ASSERT(starts == std::vector<size_t>({0, 21}), "^ matches only at line starts");
+    regex_matches(&rope, "[A-Z]+$", true, &starts, &lengths);
+    TEST_ASSERT(starts == std::vector<size_t>({21}), "$ matches only at line ends");
+    regex_matches(&rope, "^$", true, &starts, &lengths);
+    TEST_ASSERT(starts.empty(), "Empty matches are skipped");
+    regex_matches(&rope, "b?\\n", true, &starts, &lengths);
+    TEST_ASSERT(starts == std::vector<size_t>({7, 19, 26}), "Newlines can be matched explicitly");
+    TEST_ASSERT(lengths == std::vector<size_t>({1, 2, 1}), "Greedy optional byte taken");
+    regex_matches(&rope, "e.*?r", false, &starts, &lengths);
+    TEST_ASSERT(starts.size() == 3 && lengths[0] == 2, "Lazy repeat stops at the first r");
+
+    const char* invalid[] = {"(", "a)", "*a", "a**", "[a-", "[z-a]", "\\1", "(?=x)", "a{5,2}",
+                             "a{1001}", "\\x4", "\\", "\\bword"};
+    for (const char* pattern : invalid) {
+        TEST_ASSERT(!regex_matches(&rope, pattern, true, &starts, &lengths), "Invalid pattern rejected");
+    }
+    TEST_ASSERT(regex_matches(&rope, "a{,2}", true, &starts, &lengths), "Malformed braces are literal");
+
+    // Exponential for backtracking engines; one DFA pass here
+    std::string as(200000, 'a');
+    rope_free(&rope);
+    rope_from_string(&rope, as.c_str());
+    TEST_ASSERT(regex_matches(&rope, "(a*)*b", true, &starts, &lengths), "Nested star compiles");
+    TEST_ASSERT(starts.empty(), "(a*)*b finds nothing");
+    regex_matches(&rope, "(a|aa)*c", true, &starts, &lengths);
+    TEST_ASSERT(starts.empty(), "(a|aa)*c finds nothing");
+    regex_matches(&rope, "(a|aa)+", true, &starts, &lengths);
+    TEST_ASSERT(starts.size() == 1 && lengths[0] == as.size(), "(a|aa)+ takes the whole run");
+    rope_free(&rope);
+}
+
+// Case-insensitive regex folds literal letters like the literal engine, so a
+// query finds the same text with the regex toggle on or off
+TEST_CASE(test_regex_unicode_case_folding) {
+    static const char* words[] = {"Café", "CAFÉ", "café", "ΣΟΦΊΑ", "σοφίας", "Привет", "ПРИВЕТ",
+                                  "Ωmega", "ωMEGA", "NAÏVE", "naïve", "日本語", "Ǆemal", "ǅemal", "x"};
+    std::string text = make_word_soup(words, sizeof(words) / sizeof(words[0]), 29, 20000, 7);
+    Rope rope;
+    rope_from_pieces(&rope, text);
+
+    const char* queries[] = {"café", "CAFÉ", "é", "σοφ", "Σ", "ς", "ΣΟΦΊΑΣ", "пРИвет", "Ω", "ωmega x",
+                             "ÏVE", "日本", "ǆEMAL"};
+    for (const char* query : queries) {
+        std::vector<size_t> starts, lengths;
+        TEST_ASSERT(regex_matches(&rope, query, false, &starts, &lengths), "Pattern compiles");
+        std::vector<size_t> expected = engine_search(&rope, query, false);
+        if (expected != starts) {
+            printf("    query '%s': literal %zu matches, regex %zu\n", query, expected.size(), starts.size());
+        }
+        TEST_ASSERT(expected == starts, "Regex and literal search agree");
+    }
+
+    // A folded letter is one atom, so a quantifier repeats the whole character
+    std::vector<size_t> starts, lengths;
+    regex_matches(&rope, "CAFÉ", true, &starts, &lengths);
+    TEST_ASSERT(starts == engine_search(&rope, "CAFÉ", true), "Case-sensitive regex stays exact");
+    rope_free(&rope);
+    rope_from_string(&rope, "x\u00C9\u00E9\u00C9y");
+    regex_matches(&rope, "\u00E9+", false, &starts, &lengths);
+    TEST_ASSERT(starts == std::vector<size_t>({1}) && lengths[0] == 6, "One run of both cases");
+    rope_free(&rope);
+}
+
+// Regex mode in the editor: Ctrl+Alt+R toggles it, matches carry lengths, bad
+// patterns show no matches, and large documents are searched in the background
+TEST_CASE(test_search_regex_mode) {
+    TestEditor te;
+    te.type_text("ERROR db timeout=30\nINFO ok\nERROR upstream timeout=1500\n");
+    te.open_search();
+    te.press_key('r', PLATFORM_MOD_CTRL | PLATFORM_MOD_ALT);
+    TEST_ASSERT(te.editor.search_state->regex, "Ctrl+Alt+R enables regex mode");
+
+    te.type_text("ERROR.*timeout=\\d+");
+    SearchState* search = te.editor.search_state;
+    TEST_ASSERT_EQ((size_t)2, te.get_search_matches(), "Both error lines match");
+    TEST_ASSERT_EQ((size_t)19, editor_search_match_length(search, 0), "First match length");
+    TEST_ASSERT_EQ((size_t)27, editor_search_match_length(search, 1), "Second match length");
+    TEST_ASSERT_EQ((size_t)0, te.get_cursor(), "Cursor on first match");
+
+    te.type_text("(");
+    TEST_ASSERT(search->regex_error, "Unbalanced group reported");
+    TEST_ASSERT_EQ((size_t)0, te.get_search_matches(), "No matches for a bad pattern");
+    te.press_backspace();
+    TEST_ASSERT(!search->regex_error, "Error cleared once the pattern is fixed");
+    TEST_ASSERT_EQ((size_t)2, te.get_search_matches(), "Matches back");
+
+    // Edits rerun the search rather than patching the list
+    editor_rope_insert(&te.editor, 0, "ERROR timeout=7 ", 16);
+    editor_update(&te.editor, 0.0f);
+    TEST_ASSERT_EQ((size_t)2, te.get_search_matches(), "Greedy .* joins the edited line's matches");
+    TEST_ASSERT_EQ((size_t)35, editor_search_match_length(search, 0), "Leftmost match grew");
+
+    // Background regex search agrees with a synchronous scan
+    std::string text = make_log_corpus(3 << 20, 13);
+    rope_free(&te.editor.rope);
+    rope_from_string(&te.editor.rope, text.c_str());
+    te.editor.rope_version++;
+    editor_search_update_matches(&te.editor);
+    TEST_ASSERT(search->job != nullptr, "Large document searched in the background");
+    editor_search_wait(&te.editor);
+
+    std::vector<size_t> starts, lengths;
+    regex_matches(&te.editor.rope, "ERROR.*timeout=\\d+", false, &starts, &lengths);
+    TEST_ASSERT(!starts.empty(), "Corpus contains matches");
+    TEST_ASSERT_EQ(starts.size(), te.get_search_matches(), "Same match count as a synchronous scan");
+    TEST_ASSERT(std::equal(starts.begin(), starts.end(), search->match_positions), "Same positions");
+    TEST_ASSERT(std::equal(lengths.begin(), lengths.end(), search->match_lengths.begin()), "Same lengths");
+}
+
+// Ctrl+H replace-all: every match replaced in one rope rebuild, undone and
+// redone as a single step
+TEST_CASE(test_search_replace_all) {
+    TestEditor te;
+    te.type_text("one two one three one\nONE aaaa");
+    te.press_ctrl('h');
+    TEST_ASSERT(te.editor.search_state->replace_active, "Ctrl+H shows the replace row");
+    TEST_ASSERT(!te.editor.search_state->replace_focus, "Typing starts in the find field");
+    te.type_text("one");
+    te.press_key(0xff09);  // Tab
+    te.type_text("1");
+    TEST_ASSERT(std::string("one") == std::string(te.editor.search_state->query), "Query unchanged");
+    TEST_ASSERT(std::string("1") == std::string(te.editor.search_state->replacement), "Replacement typed");
+
+    te.editor.cursor_pos = 12;  // Inside "three"
+    size_t depth = undo_depth(&te.editor.undo);
+    te.press_key(0xff0d);       // Enter in the replace field
+    TEST_ASSERT(std::string("1 two 1 three 1\n1 aaaa") == te.get_text(), "All four replaced");
+    TEST_ASSERT_EQ((size_t)8, te.get_cursor(), "Cursor kept its place in the text");
+    TEST_ASSERT_EQ(depth + 1, undo_depth(&te.editor.undo), "One undo entry for the whole replace");
+
+    te.press_key(0xff1b);
+    te.press_ctrl('z');
+    TEST_ASSERT(std::string("one two one three one\nONE aaaa") == te.get_text(), "Undo restores every match");
+    te.press_ctrl('y');
+    TEST_ASSERT(std::string("1 two 1 three 1\n1 aaaa") == te.get_text(), "Redo replaces again");
+
+    // Overlapping matches are replaced leftmost first; replacements containing
+    // the query aren't searched again
+    te.press_ctrl('h');
+    for (int i = 0; i < 3; i++) te.press_key(0xff09);
+    TEST_ASSERT(!te.editor.search_state->replace_focus, "Tab cycles back to the find field");
+    te.press_backspace();
+    te.press_backspace();
+    te.press_backspace();
+    te.type_text("aa");
+    te.press_key(0xff09);
+    te.press_backspace();
+    te.type_text("aaa");
+    TEST_ASSERT_EQ((size_t)3, te.get_search_matches(), "Literal search counts overlapping matches");
+    TEST_ASSERT_EQ((size_t)2, editor_replace_all(&te.editor), "Two non-overlapping matches replaced");
+    TEST_ASSERT(std::string("1 two 1 three 1\n1 aaaaaa") == te.get_text(), "Replaced leftmost first");
+
+    // Regex matches have their own lengths
+    te.press_key('r', PLATFORM_MOD_CTRL | PLATFORM_MOD_ALT);
+    te.press_key(0xff09);
+    for (int i = 0; i < 2; i++) te.press_backspace();
+    te.type_text("\\d|a+");
+    te.press_key(0xff09);
+    for (int i = 0; i < 3; i++) te.press_backspace();
+    te.type_text("#");
+    te.press_key(0xff0d);
+    TEST_ASSERT(std::string("# two # three #\n# #") == te.get_text(), "Regex matches replaced");
+    te.press_key(0xff1b);
+    te.press_ctrl('z');
+    TEST_ASSERT(std::string("1 two 1 three 1\n1 aaaaaa") == te.get_text(), "Regex replace undone");
+
+    // A large document: same result as replacing in a flat string
+    std::string text = make_search_corpus(3 << 20, 21);
+    rope_free(&te.editor.rope);
+    rope_from_string(&te.editor.rope, text.c_str());
+    te.editor.rope_version++;
+    te.press_ctrl('h');
+    te.press_key('r', PLATFORM_MOD_CTRL | PLATFORM_MOD_ALT);
+    te.press_key(0xff09);
+    for (int i = 0; i < 5; i++) te.press_backspace();
+    te.type_text("needle");
+    te.press_key(0xff09);
+    te.press_backspace();
+    te.type_text("pin");
+
+    std::string expected;
+    size_t from = 0;
+    for (size_t pos = text.find("needle"); pos != std::string::npos; pos = text.find("needle", pos + 6)) {
+        expected += text.substr(from, pos - from) + "pin";
+        from = pos + 6;
+    }
+    expected += text.substr(from);
+
+    depth = undo_depth(&te.editor.undo);
+    RopeNode* root = te.editor.rope.root;
+    TEST_ASSERT(editor_replace_all(&te.editor) > 1000, "Many matches replaced");
+    TEST_ASSERT(te.get_text() == expected, "Large replace matches a flat-string replace");
+    TEST_ASSERT_EQ(depth + 1, undo_depth(&te.editor.undo), "Still a single undo entry");
+    TEST_ASSERT(undo_entry(&te.editor.undo, depth)->snapshot, "Past undo_snapshot_bytes, kept as a snapshot");
+    editor_undo(&te.editor);
+    TEST_ASSERT(te.get_text() == text, "Large replace undone");
+    TEST_ASSERT(te.editor.rope.root == root, "By swapping the old rope back in");
+    editor_redo(&te.editor);
+    TEST_ASSERT(te.get_text() == expected, "And redone");
+}
+
+// Past Config::search_match_memory only a window of matches is stored: the
+// count stays exact, navigation and the viewport load other windows on demand
+TEST_CASE(test_search_windowed_matches) {
+    TestEditor te;
+    std::string text;
+    for (int i = 0; text.size() < (1200 << 10); i++) {
+        text += "line " + std::to_string(i) + (i % 7 ? ": ab cd ab\n" : ": nothing here\n");
+    }
+    rope_free(&te.editor.rope);
+    rope_from_string(&te.editor.rope, text.c_str());
+    te.editor.rope_version++;
+
+    std::vector<size_t> expected = engine_search(&te.editor.rope, "ab", false);
+    SearchPattern pattern;
+    search_pattern_init(&pattern, "ab", 2, false);
+    for (size_t first : {(size_t)0, (size_t)1, expected[5000], expected[5000] + 1, text.size() - 3}) {
+        std::vector<size_t> from;
+        search_rope_from(&pattern, &te.editor.rope, first, 3000, &from);
+        size_t skip = std::lower_bound(expected.begin(), expected.end(), first) - expected.begin();
+        size_t want = std::min((size_t)3000, expected.size() - skip);
+        TEST_ASSERT(from.size() == want && std::equal(from.begin(), from.end(), expected.begin() + skip),
+                    "search_rope_from returns the first matches at or after its start");
+    }
+
+    SearchState* search = te.editor.search_state;
+    te.config.search_match_memory = 2 * SEARCH_CHECKPOINT_MATCHES * sizeof(size_t);
+    te.open_search();
+    te.type_text("ab");
+    editor_search_wait(&te.editor);
+    TEST_ASSERT_EQ(expected.size(), te.get_search_matches(), "Every match counted");
+    TEST_ASSERT_EQ(2 * SEARCH_CHECKPOINT_MATCHES, search->stored_count, "Only the ceiling's worth stored");
+    TEST_ASSERT(search->match_capacity <= 2 * SEARCH_CHECKPOINT_MATCHES, "Memory stays under the ceiling");
+
+    // Navigation walks the matches in order across window boundaries
+    bool in_order = true;
+    size_t index = search->stored_count - 10;
+    search->current_match_index = index;
+    for (int step = 0; step < 20; step++) {
+        editor_search_next_match(&te.editor);
+        index++;
+        in_order &= te.get_cursor() == expected[index] && te.get_search_current_match() == index;
+    }
+    TEST_ASSERT(in_order, "Next match crosses windows");
+    TEST_ASSERT(search->window_first > 0, "Window moved forward");
+    for (int step = 0; step < 30; step++) {
+        editor_search_prev_match(&te.editor);
+        index--;
+        in_order &= te.get_cursor() == expected[index] && te.get_search_current_match() == index;
+    }
+    TEST_ASSERT(in_order, "Previous match crosses windows");
+    search->current_match_index = 0;
+    editor_search_prev_match(&te.editor);
+    TEST_ASSERT_EQ(expected.back(), te.get_cursor(), "Previous from the first wraps to the last");
+    editor_search_next_match(&te.editor);
+    TEST_ASSERT_EQ(expected[0], te.get_cursor(), "Next from the last wraps to the first");
+
+    // Scrolling to a part of the text loads the window holding its matches
+    size_t middle = expected.size() / 2;
+    editor_search_load_range(&te.editor, expected[middle], expected[middle] + 40);
+    size_t local = middle - search->window_first;
+    TEST_ASSERT(local < search->stored_count && search->match_positions[local] == expected[middle] &&
+                search->window_end > expected[middle] + 40, "Viewport range covered");
+
+    // Under a larger ceiling, reloads still scan just a few checkpoints' worth
+    size_t ceiling = te.config.search_match_memory;
+    te.config.search_match_memory = 8 * SEARCH_WINDOW_MATCHES * sizeof(size_t);
+    editor_search_update_matches(&te.editor);
+    editor_search_wait(&te.editor);
+    TEST_ASSERT(expected.size() > 8 * SEARCH_WINDOW_MATCHES, "Still windowed");
+    TEST_ASSERT_EQ(8 * SEARCH_WINDOW_MATCHES, search->stored_count, "The search stores up to the ceiling");
+    editor_search_load_range(&te.editor, expected[middle], expected[middle] + 40);
+    local = middle - search->window_first;
+    TEST_ASSERT(local < search->stored_count && search->match_positions[local] == expected[middle],
+                "Viewport range covered");
+    TEST_ASSERT(search->stored_count <= SEARCH_WINDOW_MATCHES, "Reloaded window is small");
+    TEST_ASSERT(search->match_capacity <= 2 * SEARCH_WINDOW_MATCHES, "Ceiling-sized array released");
+    search->current_match_index = 1;
+    editor_search_prev_match(&te.editor);
+    editor_search_prev_match(&te.editor);
+    TEST_ASSERT_EQ(expected[expected.size() - 1], te.get_cursor(), "Window loaded at the end");
+    TEST_ASSERT(search->stored_count <= SEARCH_WINDOW_MATCHES, "Also small");
+    te.config.search_match_memory = ceiling;
+    editor_search_update_matches(&te.editor);
+    editor_search_wait(&te.editor);
+
+    // Regex matches come back with their lengths
+    te.press_key('r', PLATFORM_MOD_CTRL | PLATFORM_MOD_ALT);
+    editor_search_wait(&te.editor);
+    TEST_ASSERT_EQ(expected.size(), te.get_search_matches(), "Regex count exact too");
+    TEST_ASSERT_EQ(SEARCH_CHECKPOINT_MATCHES * 2, search->stored_count, "Regex matches windowed");
+    search->current_match_index = 0;
+    editor_search_prev_match(&te.editor);
+    TEST_ASSERT_EQ(expected.back(), te.get_cursor(), "Regex window loaded at the end");
+    TEST_ASSERT_EQ((size_t)2, editor_search_match_length(search, search->stored_count - 1), "Lengths loaded");
+
+    // Replace-all finds every match, not just the stored ones
+    te.press_key('r', PLATFORM_MOD_CTRL | PLATFORM_MOD_ALT);
+    editor_search_wait(&te.editor);
+    search->replacement[0] = 'X';
+    search->replacement_len = 1;
+    TEST_ASSERT_EQ(expected.size(), editor_replace_all(&te.editor), "Every match replaced");
+    TEST_ASSERT(te.get_text().find("ab") == std::string::npos, "None left");
+    editor_undo(&te.editor);
+    TEST_ASSERT(te.get_text() == text, "Windowed replace undone");
+
+    // In batches of the ceiling's worth, with later batches placed after the
+    // text earlier ones grew
+    te.press_key('r', PLATFORM_MOD_CTRL | PLATFORM_MOD_ALT);
+    editor_search_wait(&te.editor);
+    memcpy(search->replacement, "<ab>", 4);
+    search->replacement_len = 4;
+    TEST_ASSERT_EQ(expected.size(), editor_replace_all(&te.editor), "Every regex match replaced");
+    std::string grown;
+    size_t copied = 0;
+    for (size_t pos : expected) {
+        grown.append(text, copied, pos - copied);
+        grown += "<ab>";
+        copied = pos + 2;
+    }
+    grown.append(text, copied, std::string::npos);
+    TEST_ASSERT(te.get_text() == grown, "Batches line up with the grown text");
+    editor_undo(&te.editor);
+    TEST_ASSERT(te.get_text() == text, "Undone");
+    editor_redo(&te.editor);
+    TEST_ASSERT(te.get_text() == grown, "Redone");
+}
+
+// Benchmark against the naive implementation (ZED_SEARCH_BENCH_MB, default 8;
+// use 1024 for the 1 GB comparison - build with -O2 for meaningful numbers)
+TEST_CASE(test_search_engine_benchmark) {
+    const char* env = getenv("ZED_SEARCH_BENCH_MB");
+    size_t megabytes = env ? (size_t)atol(env) : 8;
+    if (megabytes == 0) return;
+
+    std::string text = make_search_corpus(megabytes << 20, 42);
+    Rope rope;
+    rope_init(&rope);
+    rope_from_string(&rope, text.c_str());
+    text.clear();
+    text.shrink_to_fit();
+
+    const char* queries[] = {"e", "{", "needle", "performance", "THE"};
+    for (const char* query : queries) {
+        for (int cs = 0; cs < 2; cs++) {
+            auto start = std::chrono::steady_clock::now();
+            char* flat = rope_to_string(&rope);  // The old path flattened the rope first
+            std::vector<size_t> expected = naive_search(flat, rope_length(&rope), query, strlen(query), cs);
+            delete[] flat;
+            auto middle = std::chrono::steady_clock::now();
+            std::vector<size_t> actual = engine_search(&rope, query, cs);
+            auto end = std::chrono::steady_clock::now();
+            SearchPattern pattern;
+            search_pattern_init(&pattern, query, strlen(query), cs);
+            std::vector<size_t> parallel;
+            search_rope_parallel(&pattern, &rope, search_thread_count(), &parallel);
+            auto parallel_end = std::chrono::steady_clock::now();
+
+            double naive_s = std::chrono::duration<double>(middle - start).count();
+            double engine_s = std::chrono::duration<double>(end - middle).count();
+            double parallel_s = std::chrono::duration<double>(parallel_end - end).count();
+            printf("    %zu MB '%s'%s: naive %.3f s, engine %.3f s (%.1fx), %zu threads %.3f s (%.1fx), %zu matches\n",
+                   megabytes, query, cs ? " (case)" : "", naive_s, engine_s,
+                   engine_s > 0 ? naive_s / engine_s : 0.0, search_thread_count(), parallel_s,
+                   parallel_s > 0 ? engine_s / parallel_s : 0.0, actual.size());
+            TEST_ASSERT(expected == actual, "Benchmark results agree");
+            TEST_ASSERT(parallel == actual, "Parallel benchmark results agree");
+        }
+    }
+    rope_free(&rope);
+
+    // Regex engine over a log of the same size
+    std::string log = make_log_corpus(megabytes << 20, 42);
+    rope_init(&rope);
+    rope_from_string(&rope, log.c_str());
+    log.clear();
+    log.shrink_to_fit();
+
+    const char* patterns[] = {"ERROR.*timeout=\\d+", "req=\\d+ upstream", "[a-z]+=\\d{4}"};
+    for (const char* pattern : patterns) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<size_t> starts, lengths;
+        regex_matches(&rope, pattern, false, &starts, &lengths);
+        double regex_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("    %zu MB log /%s/: regex %.3f s (%.0f MB/s), %zu matches\n", megabytes, pattern, regex_s,
+               regex_s > 0 ? megabytes / regex_s : 0.0, starts.size());
+    }
+    rope_free(&rope);
+}
+
+// Large documents are searched on a worker thread: results stream in, match a
+// synchronous scan, and typing more of the query cancels the running job
+TEST_CASE(test_search_background) {
+    TestEditor te;
+    std::string text = make_search_corpus(3 << 20, 11);
+    rope_free(&te.editor.rope);
+    rope_from_string(&te.editor.rope, text.c_str());
+
+    te.open_search();
+    te.type_text("need");
+    TEST_ASSERT(te.editor.search_state->job != nullptr, "Large document searched in the background");
+    te.type_text("le");
+    editor_search_wait(&te.editor);
+    TEST_ASSERT(te.editor.search_state->job == nullptr, "Job released once finished");
+
+    std::vector<size_t> expected = engine_search(&te.editor.rope, "needle", false);
+    TEST_ASSERT(!expected.empty(), "Corpus contains the query");
+    TEST_ASSERT_EQ(expected.size(), te.get_search_matches(), "Same match count as a synchronous scan");
+    TEST_ASSERT(std::equal(expected.begin(), expected.end(), te.editor.search_state->match_positions),
+                "Same match positions as a synchronous scan");
+    TEST_ASSERT_EQ(expected[0], te.get_cursor(), "Cursor moved to first match");
+
+    // Editing while a search runs leaves the job's snapshot intact
+    std::vector<size_t> shorter = engine_search(&te.editor.rope, "needl", false);
+    te.press_backspace();
+    TEST_ASSERT(te.editor.search_state->job != nullptr, "Shorter query restarts the search");
+    rope_insert(&te.editor.rope, 0, "needl ", 6);
+    rope_delete(&te.editor.rope, 6, 1 << 20);
+    editor_search_wait(&te.editor);
+    TEST_ASSERT_EQ(shorter.size(), te.get_search_matches(), "Results come from the snapshot, not the edited rope");
+}
+
 // Main function
 int main() {
     return run_all_tests();
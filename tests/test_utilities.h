@@ -105,8 +105,8 @@ inline EditorSnapshot capture_snapshot(Editor* editor) {
     snap.file_path = editor->file_path ? editor->file_path : "";
 
     // Undo/redo stack sizes
-    snap.undo_stack_size = editor->undo_stack.size();
-    snap.redo_stack_size = editor->redo_stack.size();
+    snap.undo_stack_size = undo_depth(&editor->undo);
+    snap.redo_stack_size = undo_redo_depth(&editor->undo);
 
     return snap;
 }
@@ -232,6 +232,7 @@ public:
         if (!platform_initialized) return;
 
         PlatformEvent event;
+        memset(&event, 0, sizeof(event));
         event.type = PLATFORM_EVENT_KEY_PRESS;
         event.key.key = key;
         event.key.mods = mods;
@@ -102,12 +102,12 @@ void test_utf8_undo_redo() {
 
     TestEditor te;
     te.type_text("世");
+    te.update(2.0f);  // Past the undo merge window
     te.type_text("界");
 
-    // Note: type_text sends events byte-by-byte, so "界" (3 bytes) requires 3 undos
-    te.press_ctrl('z');  // Undo byte 3 of "界"
-    te.press_ctrl('z');  // Undo byte 2 of "界"
-    te.press_ctrl('z');  // Undo byte 1 of "界"
+    // Note: type_text sends events byte-by-byte; the 3 bytes of "界" are typed
+    // together, so they merge into one undo entry
+    te.press_ctrl('z');
 
     char* text = rope_to_string(&te.editor.rope);
     assert(strcmp(text, "世") == 0);
@@ -115,8 +115,6 @@ void test_utf8_undo_redo() {
 
     // Redo should restore all 3 bytes
     te.press_ctrl('y');
-    te.press_ctrl('y');
-    te.press_ctrl('y');
     text = rope_to_string(&te.editor.rope);
     assert(strcmp(text, "世界") == 0);
     delete[] text;
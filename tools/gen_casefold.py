@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Generate src/casefold_table.h - Unicode simple case folding for search
+
+Usage:
+    tools/gen_casefold.py [CaseFolding.txt] > src/casefold_table.h
+
+With a CaseFolding.txt from the Unicode Character Database, the C (common)
+and S (simple) mappings are used. Without one, the same mappings are derived
+from Python's unicodedata: a code point folds to its casefold() if that is a
+single code point, else to its lower() if that is.
+
+Only mappings whose two sides have the same UTF-8 length are emitted, so a
+case-insensitive match is always as long as the query (the search code relies
+on that). The few left out - KELVIN SIGN, LATIN SMALL LETTER LONG S, ... - are
+listed in the generated header.
+"""
+
+import sys
+import unicodedata
+
+
+def utf8_length(cp):
+    return len(chr(cp).encode('utf-8', 'surrogatepass'))
+
+
+def folds_from_file(path):
+    folds = {}
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            code, status, mapping = [field.strip() for field in line.split(';')[:3]]
+            if status in ('C', 'S'):
+                folds[int(code, 16)] = int(mapping, 16)
+    return folds, 'CaseFolding.txt'
+
+
+def folds_from_python():
+    folds = {}
+    for cp in range(0x110000):
+        if 0xD800 <= cp <= 0xDFFF:
+            continue
+        c = chr(cp)
+        for candidate in (c.casefold(), c.lower()):
+            if len(candidate) == 1:
+                if ord(candidate) != cp:
+                    folds[cp] = ord(candidate)
+                break
+    return folds, 'Python unicodedata %s' % unicodedata.unidata_version
+
+
+def main():
+    folds, source = folds_from_file(sys.argv[1]) if len(sys.argv) > 1 else folds_from_python()
+
+    pairs = sorted((cp, to) for cp, to in folds.items() if utf8_length(cp) == utf8_length(to))
+    skipped = sorted((cp, to) for cp, to in folds.items() if utf8_length(cp) != utf8_length(to))
+    targets = sorted(set(to for _, to in pairs))
+
+    out = sys.stdout
+    out.write('// Unicode simple case folding tables - generated by tools/gen_casefold.py, do not edit\n')
+    out.write('// Source: %s\n' % source)
+    out.write('// Mappings that change UTF-8 length are left out:\n')
+    for cp, to in skipped:
+        name = unicodedata.name(chr(cp), '?')
+        out.write('//   U+%04X -> U+%04X  %s\n' % (cp, to, name))
+    out.write('\n#ifndef ZED_CASEFOLD_TABLE_H\n#define ZED_CASEFOLD_TABLE_H\n\n#include <cstddef>\n#include <cstdint>\n\n')
+
+    out.write('struct CaseFoldPair {\n    uint32_t from;\n    uint32_t to;\n};\n\n')
+
+    out.write('// Code points that fold to another, sorted by from\n')
+    out.write('inline constexpr CaseFoldPair CASEFOLD_PAIRS[] = {\n')
+    for i in range(0, len(pairs), 4):
+        row = pairs[i:i + 4]
+        out.write('    ' + ' '.join('{0x%04X, 0x%04X},' % pair for pair in row) + '\n')
+    out.write('};\n\n')
+
+    out.write('// Every code point something folds to, sorted\n')
+    out.write('inline constexpr uint32_t CASEFOLD_TARGETS[] = {\n')
+    for i in range(0, len(targets), 8):
+        row = targets[i:i + 8]
+        out.write('    ' + ' '.join('0x%04X,' % cp for cp in row) + '\n')
+    out.write('};\n\n')
+
+    out.write('constexpr size_t CASEFOLD_PAIR_COUNT = sizeof(CASEFOLD_PAIRS) / sizeof(CASEFOLD_PAIRS[0]);\n')
+    out.write('constexpr size_t CASEFOLD_TARGET_COUNT = sizeof(CASEFOLD_TARGETS) / sizeof(CASEFOLD_TARGETS[0]);\n')
+    out.write('\n#endif // ZED_CASEFOLD_TABLE_H\n')
+
+
+if __name__ == '__main__':
+    main()